@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#define BRL_IMPLEMENTATION
+#include <batch.h>
+
+// CPU side of the 2D batcher: writing the vertices, sorting and
+// building the indices. The GPU only pulls from the mapped buffer, so
+// this is what bounds the number of quads per frame on the CPU.
+
+#define BENCH_FRAME_MS (1000.0 / 60.0)
+#define BENCH_FRAMES 32
+#define BENCH_MAX_QUADS (1 << 22)
+
+double bench_time_ms()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+/**
+ * Average time of one frame of quad_count quads spread over a few
+ * layers and both blend modes, as a sprite heavy scene would.
+ **/
+double bench_frame(brl_batch *batch, brl_vertex *vertices, uint32_t *indices, brl_batch_run *runs, uint32_t quad_count)
+{
+  float rotation[6] = {0.8f, -0.6f, 400.0f, 0.6f, 0.8f, 300.0f};
+  double start = bench_time_ms();
+
+  for (int frame = 0; frame < BENCH_FRAMES; frame++)
+  {
+    brl_batch_begin(batch, vertices, quad_count * 4);
+    memcpy(batch->transform, rotation, sizeof(rotation));
+    for (uint32_t i = 0; i < quad_count; i++)
+    {
+      batch->layer = (i >> 4) & 3;
+      batch->pipeline = (i >> 2) & 1;
+      brl_batch_quad(batch, (float)(i & 1023), (float)(i >> 10), 8.0f, 8.0f, brl_rgba(i, i >> 8, 255, 200));
+    }
+    brl_batch_sort(batch);
+    brl_batch_build(batch, indices, runs, quad_count);
+  }
+
+  return (bench_time_ms() - start) / BENCH_FRAMES;
+}
+
+int main()
+{
+  brl_vertex *vertices = malloc(sizeof(brl_vertex) * 4 * BENCH_MAX_QUADS);
+  uint32_t *indices = malloc(sizeof(uint32_t) * 6 * BENCH_MAX_QUADS);
+  brl_batch_run *runs = malloc(sizeof(brl_batch_run) * BENCH_MAX_QUADS);
+  brl_batch batch;
+  brl_batch_init(&batch, BENCH_MAX_QUADS);
+
+#if defined(BRL_BATCH_SSE)
+  printf("BENCH: batch transform using SSE\n");
+#elif defined(BRL_BATCH_NEON)
+  printf("BENCH: batch transform using NEON\n");
+#else
+  printf("BENCH: batch transform using scalar code\n");
+#endif
+
+  uint32_t fitting = 0;
+  for (uint32_t quad_count = 1024; quad_count <= BENCH_MAX_QUADS; quad_count *= 2)
+  {
+    double ms = bench_frame(&batch, vertices, indices, runs, quad_count);
+    printf("BENCH: %8d quads  %8.3f ms/frame  %6.2f ns/quad\n", quad_count, ms, ms * 1e6 / quad_count);
+    if (ms > BENCH_FRAME_MS)
+      break;
+    fitting = quad_count * BENCH_FRAME_MS / ms;
+  }
+
+  printf("BENCH: ~%d quads per frame fit a 60 Hz frame on this CPU\n", fitting);
+
+  brl_batch_free(&batch);
+  free(vertices);
+  free(indices);
+  free(runs);
+  return 0;
+}
@@ -0,0 +1,121 @@
+#include <boreal.h>
+
+// Throughput of a compute kernel on a compute-only app. Meant to run
+// on lavapipe (see the bench-compute target of the makefile), so it
+// also works on CI machines without a GPU, where it measures how fast
+// the CPU runs SPIR-V.
+
+#define BENCH_KERNEL_PATH "./src/shaders/saxpy.spv"
+#define BENCH_GROUP_SIZE 256
+#define BENCH_MIN_FLOATS (1u << 14)
+// 32768 groups, below the 65535 every device dispatches.
+#define BENCH_MAX_FLOATS (1u << 23)
+#define BENCH_WARMUP_DISPATCHES 4
+#define BENCH_DISPATCHES 32
+#define BENCH_A 0.5f
+
+typedef struct bench_params
+{
+  float a;
+  uint32_t n;
+} bench_params;
+
+typedef struct bench_run
+{
+  uint32_t kernel;
+  uint32_t buffers[2];
+  uint32_t floats;
+  int failed;
+} bench_run;
+
+bench_run run;
+
+void bench_init(brl_app *app)
+{
+  float *x = malloc(sizeof(float) * BENCH_MAX_FLOATS);
+  for (uint32_t i = 0; i < BENCH_MAX_FLOATS; i++)
+    x[i] = (float)(i & 255);
+
+  VkResult result = brl_create_kernel(app, BENCH_KERNEL_PATH, 2, sizeof(bench_params), &run.kernel);
+  if (result == VK_SUCCESS)
+    result = brl_create_storage_buffer(app, sizeof(float) * BENCH_MAX_FLOATS, x, &run.buffers[0]);
+  if (result == VK_SUCCESS)
+    result = brl_create_storage_buffer(app, sizeof(float) * BENCH_MAX_FLOATS, NULL, &run.buffers[1]);
+  free(x);
+
+  run.floats = BENCH_MIN_FLOATS;
+  run.failed = result != VK_SUCCESS;
+}
+
+VkResult bench_dispatch(brl_app *app, uint32_t count)
+{
+  bench_params params = {BENCH_A, run.floats};
+  uint32_t groups = (run.floats + BENCH_GROUP_SIZE - 1) / BENCH_GROUP_SIZE;
+  VkResult result = VK_SUCCESS;
+  for (uint32_t i = 0; i < count && result == VK_SUCCESS; i++)
+    result = brl_dispatch(app, run.kernel, run.buffers, &params, groups, 1, 1);
+  return result == VK_SUCCESS ? brl_compute_wait(app) : result;
+}
+
+/**
+ * Every dispatch adds a * x to y, all the values involved are exact
+ * in a float so the result is checked for equality.
+ **/
+int bench_check(brl_app *app)
+{
+  const float *y = brl_storage_buffer_data(app, run.buffers[1]);
+  float dispatches = BENCH_WARMUP_DISPATCHES + BENCH_DISPATCHES;
+  for (uint32_t i = 0; i < run.floats; i++)
+  {
+    if (y[i] != 1.0f + dispatches * BENCH_A * (float)(i & 255))
+      return 0;
+  }
+  return 1;
+}
+
+/**
+ * One size per loop, the timed dispatches go in a single submit so
+ * the GPU time is the kernels only.
+ **/
+void bench_loop(brl_app *app)
+{
+  if (run.failed || run.floats > BENCH_MAX_FLOATS)
+  {
+    brl_close(app);
+    return;
+  }
+
+  float *y = brl_storage_buffer_data(app, run.buffers[1]);
+  for (uint32_t i = 0; i < run.floats; i++)
+    y[i] = 1.0f;
+
+  VkResult result = bench_dispatch(app, BENCH_WARMUP_DISPATCHES);
+  double start = brl_time_seconds();
+  if (result == VK_SUCCESS)
+    result = bench_dispatch(app, BENCH_DISPATCHES);
+  double wall = (brl_time_seconds() - start) / BENCH_DISPATCHES;
+  if (result != VK_SUCCESS || !bench_check(app))
+  {
+    printf("BENCH: %9u floats  FAILED, %s\n", run.floats, result != VK_SUCCESS ? "dispatch error" : "wrong results");
+    run.failed = 1;
+    return;
+  }
+
+  // Falls back on the wall clock, submit included, without timestamps.
+  double seconds = app->compute_time > 0.0 ? app->compute_time / BENCH_DISPATCHES : wall;
+  printf("BENCH: %9u floats  %8.3f ms/dispatch (%8.3f ms wall)  %7.2f GB/s  %7.2f GFLOP/s\n", run.floats,
+         seconds * 1000.0, wall * 1000.0, run.floats * 12.0 / seconds / 1e9, run.floats * 2.0 / seconds / 1e9);
+  run.floats *= 2;
+}
+
+int main()
+{
+  brl_app app = {
+      .init = bench_init,
+      .loop = bench_loop,
+      .compute_only = 1,
+  };
+
+  VkResult result = brl_create_app(app);
+  return result == VK_SUCCESS && !run.failed ? 0 : 1;
+}
@@ -0,0 +1,2 @@
+#define BRL_IMPLEMENTATION
+#include <boreal.h>
@@ -0,0 +1,338 @@
+#ifndef BRL_BATCH
+#define BRL_BATCH
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define BRL_BATCH_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define BRL_BATCH_NEON
+#endif
+
+#define BRL_BATCH_DEFAULT_QUADS 65536
+
+/**
+ * Vertex of the 2D batcher, positions are in pixels with the origin
+ * at the top left corner. The color is packed as R8G8B8A8, see
+ * brl_rgba.
+ **/
+typedef struct brl_vertex
+{
+  float x, y;
+  float u, v;
+  uint32_t color;
+} brl_vertex;
+
+/**
+ * One quad or triangle. The key orders the batch: layer first, then
+ * pipeline, then texture. Vertices stay where they were written, only
+ * the indices are emitted in key order.
+ **/
+typedef struct brl_batch_primitive
+{
+  uint32_t key;
+  uint32_t first_vertex;
+  uint32_t vertex_count;
+} brl_batch_primitive;
+
+/**
+ * A run of primitives sharing the same key, drawn with a single
+ * vkCmdDrawIndexed.
+ **/
+typedef struct brl_batch_run
+{
+  uint32_t key;
+  uint32_t first_index;
+  uint32_t index_count;
+} brl_batch_run;
+
+typedef struct brl_batch
+{
+  brl_vertex *vertices;
+  uint32_t vertex_count;
+  uint32_t max_vertices;
+  brl_batch_primitive *primitives;
+  brl_batch_primitive *scratch;
+  uint32_t primitive_count;
+  uint32_t max_primitives;
+  uint32_t dropped;
+  float transform[6];
+  uint32_t layer;
+  uint32_t pipeline;
+  uint32_t texture;
+} brl_batch;
+
+#define BRL_BATCH_LAYER_BITS 8
+#define BRL_BATCH_PIPELINE_BITS 8
+#define BRL_BATCH_TEXTURE_BITS 16
+
+static inline uint32_t brl_rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+  return (uint32_t)r | ((uint32_t)g << 8) | ((uint32_t)b << 16) | ((uint32_t)a << 24);
+}
+
+static inline uint32_t brl_batch_key(uint32_t layer, uint32_t pipeline, uint32_t texture)
+{
+  return (layer & 0xff) << 24 | (pipeline & 0xff) << 16 | (texture & 0xffff);
+}
+
+static inline uint32_t brl_batch_key_pipeline(uint32_t key)
+{
+  return (key >> 16) & 0xff;
+}
+
+static inline uint32_t brl_batch_key_texture(uint32_t key)
+{
+  return key & 0xffff;
+}
+
+void brl_batch_identity(float transform[6]);
+void brl_batch_init(brl_batch *batch, uint32_t max_primitives);
+void brl_batch_free(brl_batch *batch);
+void brl_batch_begin(brl_batch *batch, brl_vertex *vertices, uint32_t max_vertices);
+brl_vertex *brl_batch_push(brl_batch *batch, uint32_t vertex_count);
+void brl_batch_quad(brl_batch *batch, float x, float y, float w, float h, uint32_t color);
+void brl_batch_tri(brl_batch *batch, float x0, float y0, float x1, float y1, float x2, float y2, uint32_t color);
+void brl_batch_sort(brl_batch *batch);
+uint32_t brl_batch_build(brl_batch *batch, uint32_t *indices, brl_batch_run *runs, uint32_t max_runs);
+
+#endif
+
+#if defined(BRL_IMPLEMENTATION) && !defined(BRL_BATCH_IMPLEMENTATION)
+#define BRL_BATCH_IMPLEMENTATION
+
+void brl_batch_identity(float transform[6])
+{
+  transform[0] = 1.0f, transform[1] = 0.0f, transform[2] = 0.0f;
+  transform[3] = 0.0f, transform[4] = 1.0f, transform[5] = 0.0f;
+}
+
+void brl_batch_init(brl_batch *batch, uint32_t max_primitives)
+{
+  memset(batch, 0, sizeof(brl_batch));
+  batch->max_primitives = max_primitives;
+  batch->primitives = malloc(sizeof(brl_batch_primitive) * max_primitives);
+  batch->scratch = malloc(sizeof(brl_batch_primitive) * max_primitives);
+  brl_batch_identity(batch->transform);
+}
+
+void brl_batch_free(brl_batch *batch)
+{
+  free(batch->primitives);
+  free(batch->scratch);
+  batch->primitives = NULL;
+  batch->scratch = NULL;
+}
+
+/**
+ * Starts a new frame writing into the given vertices, usually the
+ * persistently mapped vertex buffer of the frame in flight. State
+ * (transform, layer, pipeline, texture) is reset.
+ **/
+void brl_batch_begin(brl_batch *batch, brl_vertex *vertices, uint32_t max_vertices)
+{
+  batch->vertices = vertices;
+  batch->vertex_count = 0;
+  batch->max_vertices = max_vertices;
+  batch->primitive_count = 0;
+  batch->dropped = 0;
+  batch->layer = 0;
+  batch->pipeline = 0;
+  batch->texture = 0;
+  brl_batch_identity(batch->transform);
+}
+
+/**
+ * Claims room for a primitive, NULL when the batch is full. Dropped
+ * primitives are counted so a too small batch is easy to notice.
+ **/
+brl_vertex *brl_batch_push(brl_batch *batch, uint32_t vertex_count)
+{
+  if (batch->primitive_count >= batch->max_primitives || batch->vertex_count + vertex_count > batch->max_vertices)
+  {
+    batch->dropped++;
+    return NULL;
+  }
+
+  batch->primitives[batch->primitive_count++] = (brl_batch_primitive){
+      .key = brl_batch_key(batch->layer, batch->pipeline, batch->texture),
+      .first_vertex = batch->vertex_count,
+      .vertex_count = vertex_count,
+  };
+
+  brl_vertex *vertices = batch->vertices + batch->vertex_count;
+  batch->vertex_count += vertex_count;
+  return vertices;
+}
+
+/**
+ * Applies the batch transform to four points at once and writes them
+ * out. The affine transform is [a c tx; b d ty] stored as
+ * {a, c, tx, b, d, ty}.
+ **/
+static inline void brl_batch_transform4(const float m[6], const float xs[4], const float ys[4], brl_vertex *out)
+{
+#if defined(BRL_BATCH_SSE)
+  __m128 x = _mm_loadu_ps(xs);
+  __m128 y = _mm_loadu_ps(ys);
+  __m128 tx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m[0])), _mm_mul_ps(y, _mm_set1_ps(m[1]))), _mm_set1_ps(m[2]));
+  __m128 ty = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m[3])), _mm_mul_ps(y, _mm_set1_ps(m[4]))), _mm_set1_ps(m[5]));
+  float rx[4], ry[4];
+  _mm_storeu_ps(rx, tx);
+  _mm_storeu_ps(ry, ty);
+#elif defined(BRL_BATCH_NEON)
+  float32x4_t x = vld1q_f32(xs);
+  float32x4_t y = vld1q_f32(ys);
+  float32x4_t tx = vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(m[2]), x, m[0]), y, m[1]);
+  float32x4_t ty = vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(m[5]), x, m[3]), y, m[4]);
+  float rx[4], ry[4];
+  vst1q_f32(rx, tx);
+  vst1q_f32(ry, ty);
+#else
+  float rx[4], ry[4];
+  for (int i = 0; i < 4; i++)
+  {
+    rx[i] = xs[i] * m[0] + ys[i] * m[1] + m[2];
+    ry[i] = xs[i] * m[3] + ys[i] * m[4] + m[5];
+  }
+#endif
+  for (int i = 0; i < 4; i++)
+  {
+    out[i].x = rx[i];
+    out[i].y = ry[i];
+  }
+}
+
+/**
+ * Axis aligned rectangle in the current transform, UVs span the whole
+ * texture.
+ **/
+void brl_batch_quad(brl_batch *batch, float x, float y, float w, float h, uint32_t color)
+{
+  brl_vertex *vertices = brl_batch_push(batch, 4);
+  if (vertices == NULL)
+    return;
+
+  const float xs[4] = {x, x + w, x + w, x};
+  const float ys[4] = {y, y, y + h, y + h};
+  brl_batch_transform4(batch->transform, xs, ys, vertices);
+
+  vertices[0].u = 0.0f, vertices[0].v = 0.0f;
+  vertices[1].u = 1.0f, vertices[1].v = 0.0f;
+  vertices[2].u = 1.0f, vertices[2].v = 1.0f;
+  vertices[3].u = 0.0f, vertices[3].v = 1.0f;
+  vertices[0].color = vertices[1].color = vertices[2].color = vertices[3].color = color;
+}
+
+void brl_batch_tri(brl_batch *batch, float x0, float y0, float x1, float y1, float x2, float y2, uint32_t color)
+{
+  brl_vertex *vertices = brl_batch_push(batch, 3);
+  if (vertices == NULL)
+    return;
+
+  // The fourth lane is computed and thrown away.
+  const float xs[4] = {x0, x1, x2, x2};
+  const float ys[4] = {y0, y1, y2, y2};
+  brl_vertex transformed[4];
+  brl_batch_transform4(batch->transform, xs, ys, transformed);
+
+  for (int i = 0; i < 3; i++)
+  {
+    vertices[i].x = transformed[i].x;
+    vertices[i].y = transformed[i].y;
+    vertices[i].u = 0.0f;
+    vertices[i].v = 0.0f;
+    vertices[i].color = color;
+  }
+}
+
+/**
+ * Stable LSD radix sort of the primitives on their key, one pass per
+ * key byte. Submission order is kept within a key, so primitives in
+ * the same layer with the same texture and pipeline still draw in the
+ * order they were pushed.
+ **/
+void brl_batch_sort(brl_batch *batch)
+{
+  brl_batch_primitive *src = batch->primitives;
+  brl_batch_primitive *dst = batch->scratch;
+  uint32_t count = batch->primitive_count;
+
+  for (uint32_t shift = 0; shift < 32; shift += 8)
+  {
+    uint32_t offsets[256] = {0};
+    for (uint32_t i = 0; i < count; i++)
+      offsets[(src[i].key >> shift) & 0xff]++;
+
+    // A byte shared by every key needs no pass.
+    if (count == 0 || offsets[(src[0].key >> shift) & 0xff] == count)
+      continue;
+
+    uint32_t total = 0;
+    for (uint32_t i = 0; i < 256; i++)
+    {
+      uint32_t bucket = offsets[i];
+      offsets[i] = total;
+      total += bucket;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+      dst[offsets[(src[i].key >> shift) & 0xff]++] = src[i];
+
+    brl_batch_primitive *swap = src;
+    src = dst;
+    dst = swap;
+  }
+
+  batch->primitives = src;
+  batch->scratch = dst;
+}
+
+/**
+ * Writes the indices of the sorted primitives and groups them into
+ * runs of the same key. Returns the number of runs, indices must have
+ * room for 6 per quad and 3 per triangle.
+ **/
+uint32_t brl_batch_build(brl_batch *batch, uint32_t *indices, brl_batch_run *runs, uint32_t max_runs)
+{
+  uint32_t index_count = 0;
+  uint32_t run_count = 0;
+
+  for (uint32_t i = 0; i < batch->primitive_count; i++)
+  {
+    brl_batch_primitive primitive = batch->primitives[i];
+    if (run_count == 0 || runs[run_count - 1].key != primitive.key)
+    {
+      if (run_count == max_runs)
+        break;
+      runs[run_count++] = (brl_batch_run){.key = primitive.key, .first_index = index_count};
+    }
+
+    uint32_t v = primitive.first_vertex;
+    if (primitive.vertex_count == 4)
+    {
+      indices[index_count++] = v;
+      indices[index_count++] = v + 1;
+      indices[index_count++] = v + 2;
+      indices[index_count++] = v + 2;
+      indices[index_count++] = v + 3;
+      indices[index_count++] = v;
+    }
+    else
+    {
+      indices[index_count++] = v;
+      indices[index_count++] = v + 1;
+      indices[index_count++] = v + 2;
+    }
+
+    runs[run_count - 1].index_count = index_count - runs[run_count - 1].first_index;
+  }
+
+  return run_count;
+}
+
+#endif
@@ -1,8 +1,6 @@
 #ifndef BRL_APP
 #define BRL_APP
 
-#ifdef BRL_IMPLEMENTATION
-
 #define VK_USE_PLATFORM_XCB_KHR
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -11,57 +9,485 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
-#define BRL_FILE_IMPLEMENTATION
 #include <file.h>
+#include <snapshot.h>
+#include <device.h>
+#include <batch.h>
+#include <ktx2.h>
+#include <profile.h>
+#include <telemetry.h>
+#include <image.h>
+
+// Highest API version Boreal asks for, the instance is created with
+// the lowest of this and what the loader supports.
+#define BRL_MAX_API_VERSION VK_API_VERSION_1_3
+#define BRL_MAX_DEVICE_EXTENSIONS 8
+
+#define BRL_MAX_FRAMES_IN_FLIGHT 3
+#define BRL_DEFAULT_FRAMES_IN_FLIGHT 2
+// Upper bound for a single vkWaitForPresentKHR, some compositors
+// never complete presents for minimized or occluded windows.
+#define BRL_PRESENT_WAIT_TIMEOUT 100000000ULL
+#define BRL_PRESENT_HISTORY 16
+#define BRL_DEFAULT_UPDATE_RATE 240
+#define BRL_MAX_STARTUP_STAGES 32
+#define BRL_MAX_WINDOWS 4
+// Frames being read back at once, requests fail while all are taken.
+#define BRL_MAX_READBACKS 8
+
+#define BRL_VERTEX_SHADER_PATH "./src/shaders/vertex.spv"
+#define BRL_FRAGMENT_SHADER_PATH "./src/shaders/fragment.spv"
+#define BRL_SPRITE_VERTEX_SHADER_PATH "./src/shaders/sprite_vertex.spv"
+#define BRL_SPRITE_FRAGMENT_SHADER_PATH "./src/shaders/sprite_fragment.spv"
+#define BRL_MAX_TEXTURES 256
+// Recalibrate the GPU clock against the CPU one this often, in ns.
+#define BRL_PROFILE_CALIBRATION_INTERVAL 1000000000ULL
+
+#define BRL_MAX_POST_EFFECTS 8
+// Bloom is the only effect taking two dispatches.
+#define BRL_MAX_POST_STEPS (BRL_MAX_POST_EFFECTS * 2)
+// Scene start, scene end, one per step and one for the final copy.
+#define BRL_POST_QUERIES (BRL_MAX_POST_STEPS + 3)
+#define BRL_POST_GROUP_SIZE 16
+#define BRL_HDR_FORMAT VK_FORMAT_R16G16B16A16_SFLOAT
+
+#define BRL_MAX_STORAGE_BUFFERS 64
+#define BRL_MAX_KERNELS 16
+#define BRL_MAX_KERNEL_BUFFERS 8
+// Push constants every device supports.
+#define BRL_MAX_KERNEL_PUSH_SIZE 128
+// Dispatches recorded before brl_compute_wait has to submit them.
+#define BRL_MAX_DISPATCHES 256
 
-// Using debug might take a longer time to initialize the
-// instance because of the validation layers.
-#ifdef BRL_NODEBUG
-const int enableValidationLayers = 0;
-#else
-const int enableValidationLayers = 1;
-#endif
+/**
+ * Presentation modes the application can ask for, DEFAULT keeps
+ * the historical behaviour (MAILBOX when available, FIFO otherwise).
+ * Any mode that the surface does not support falls back to FIFO,
+ * which is always available.
+ **/
+typedef enum brl_present_mode
+{
+  BRL_PRESENT_MODE_DEFAULT = 0,
+  BRL_PRESENT_MODE_MAILBOX,
+  BRL_PRESENT_MODE_FIFO,
+  BRL_PRESENT_MODE_FIFO_RELAXED,
+  BRL_PRESENT_MODE_IMMEDIATE,
+} brl_present_mode;
 
-const char *validation_layers[] = {
-    "VK_LAYER_KHRONOS_validation",
-};
-#define validation_layers_count sizeof(validation_layers) / sizeof(validation_layers[0])
+/**
+ * Blend modes of the 2D batcher, each one is its own pipeline and
+ * part of the batch sort key.
+ **/
+typedef enum brl_blend_mode
+{
+  BRL_BLEND_ALPHA,
+  BRL_BLEND_ADDITIVE,
+  BRL_BLEND_COUNT,
+} brl_blend_mode;
 
-const char *device_extensions[] = {
-    VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-};
-#define brl_extensions_count sizeof(device_extensions) / sizeof(device_extensions[0])
+/**
+ * Compute post passes that can be chained in brl_app.post_effects,
+ * they run in the given order on the HDR scene color.
+ **/
+typedef enum brl_post_effect
+{
+  BRL_POST_TONEMAP,
+  BRL_POST_FXAA,
+  BRL_POST_BLOOM,
+  BRL_POST_EFFECT_COUNT,
+} brl_post_effect;
+
+typedef enum brl_post_target_index
+{
+  BRL_POST_TARGET_HDR,
+  BRL_POST_TARGET_PING,
+  BRL_POST_TARGET_PONG,
+  BRL_POST_TARGET_BLOOM,
+  BRL_POST_TARGET_COUNT,
+} brl_post_target_index;
+
+typedef struct brl_post_target
+{
+  VkImage image;
+  VkDeviceMemory memory;
+  VkImageView view;
+} brl_post_target;
+
+/**
+ * One dispatch of the post chain, input and output are indices in
+ * brl_app.vk_post_targets, an output of -1 is the swapchain image.
+ **/
+typedef struct brl_post_step
+{
+  const char *name;
+  brl_post_effect effect;
+  int mode;
+  int input;
+  int output;
+  VkExtent2D extent;
+} brl_post_step;
+
+/**
+ * GPU zones written by the profiler build, each one is a pair of
+ * timestamps in every frame's command buffer.
+ **/
+typedef enum brl_gpu_zone
+{
+  BRL_GPU_ZONE_FRAME,
+  BRL_GPU_ZONE_SCENE,
+  BRL_GPU_ZONE_SPRITES,
+  BRL_GPU_ZONE_POST,
+  BRL_GPU_ZONE_COUNT,
+} brl_gpu_zone;
+
+/**
+ * A sampled texture. The source (a KTX2 path or a copy of the RGBA8
+ * pixels) is kept so the texture can be uploaded again after a device
+ * loss.
+ **/
+typedef struct brl_texture
+{
+  VkImage image;
+  VkDeviceMemory memory;
+  VkImageView view;
+  VkDescriptorSet set;
+  VkFormat format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t levels;
+  char *path;
+  void *pixels;
+} brl_texture;
+
+/**
+ * The compute family is only looked up for compute-only apps, the
+ * post passes otherwise run on the graphics family.
+ **/
+typedef struct brl_queue_family_indices
+{
+  int graphics_family;
+  int present_family;
+  int compute_family;
+} brl_queue_family_indices;
+
+/**
+ * Host visible storage buffer, mapped for its whole life so inputs
+ * are written and results read without any staging copy. Device local
+ * memory is used when it is also host visible (integrated GPUs,
+ * resizable BAR, lavapipe).
+ **/
+typedef struct brl_storage_buffer
+{
+  VkBuffer buffer;
+  VkDeviceMemory memory;
+  VkDeviceSize size;
+  void *mapped;
+} brl_storage_buffer;
+
+/**
+ * A compute pipeline whose storage buffers are bound to 0 up to
+ * buffers_count - 1 of set 0, with push constants of push_size bytes.
+ **/
+typedef struct brl_kernel
+{
+  VkDescriptorSetLayout set_layout;
+  VkPipelineLayout layout;
+  VkPipeline pipeline;
+  uint32_t buffers_count;
+  uint32_t push_size;
+} brl_kernel;
+
+/**
+ * One timed step of the startup, worker tells which thread ran it
+ * (0 is the main thread).
+ **/
+typedef struct brl_startup_stage
+{
+  const char *name;
+  double start;
+  double duration;
+  int worker;
+} brl_startup_stage;
+
+/**
+ * An extra window showing a region of the main one, for setups driving
+ * several displays from one process. Each frame the main image is
+ * blitted into every extra window that has an image ready, in the
+ * frame's command buffer, and all the swapchains go to a single
+ * vkQueuePresentKHR.
+ *
+ * Extra windows never block the frame: their images are acquired
+ * without waiting, and a window whose display is not ready, or whose
+ * own max_fps deadline has not passed yet, simply skips the frame. A
+ * window can run slower than the main one, never faster. A zero
+ * source extent shows the whole main image.
+ **/
+typedef struct brl_window
+{
+  int width;
+  int height;
+  const char *title;
+  brl_present_mode present_mode;
+  int max_fps;
+  VkRect2D source;
+  GLFWwindow *window;
+  VkSurfaceKHR vk_surface;
+  VkSwapchainKHR vk_swp;
+  VkImage *vk_swp_images;
+  uint32_t vk_swp_images_count;
+  VkExtent2D vk_swp_extent;
+  VkPresentModeKHR vk_present_mode;
+  VkFilter vk_filter;
+  VkSemaphore sema_image_available[BRL_MAX_FRAMES_IN_FLIGHT];
+  VkSemaphore *sema_render_finished;
+  struct timespec next_frame_time;
+  int vk_out_of_date;
+  int acquired;
+  uint32_t image_index;
+  uint64_t presented;
+  uint64_t skipped;
+} brl_window;
+
+typedef enum brl_capture_format
+{
+  // width * height * 4 bytes in the swapchain format, no header.
+  BRL_CAPTURE_RAW,
+  BRL_CAPTURE_PNG,
+} brl_capture_format;
+
+typedef enum brl_readback_state
+{
+  BRL_READBACK_FREE,
+  // Copied at the end of the next recorded frame.
+  BRL_READBACK_REQUESTED,
+  BRL_READBACK_IN_FLIGHT,
+  BRL_READBACK_READY,
+  // Queued for the capture worker, then being written by it.
+  BRL_READBACK_SAVING,
+  BRL_READBACK_WRITING,
+} brl_readback_state;
+
+/**
+ * One slot of the readback ring, a persistently mapped host buffer the
+ * frame's image is copied into. The capture worker only ever touches
+ * slots in the WRITING state.
+ **/
+typedef struct brl_readback
+{
+  VkBuffer buffer;
+  VkDeviceMemory memory;
+  VkDeviceSize capacity;
+  void *mapped;
+  atomic_int state;
+  uint64_t sequence;
+  uint32_t frame;
+  uint32_t width;
+  uint32_t height;
+  VkFormat format;
+  int release;
+  int save;
+  // Still in flight when the device was lost, see brl_readback_poll.
+  int lost;
+  brl_capture_format save_format;
+  char save_path[256];
+} brl_readback;
+
+/**
+ * Handle on a frame being read back, from brl_request_readback. It
+ * resolves once the GPU is done with the frame it was recorded in,
+ * which is when brl_draw_frame waits on that frame's fence, so
+ * frames_in_flight frames later.
+ **/
+typedef struct brl_readback_future
+{
+  uint32_t slot;
+  uint64_t sequence;
+} brl_readback_future;
+
+/**
+ * A resolved readback: width * height pixels of 4 bytes in the
+ * swapchain format, top row first, valid until brl_readback_release.
+ **/
+typedef struct brl_frame_pixels
+{
+  const void *pixels;
+  uint32_t width;
+  uint32_t height;
+  VkFormat format;
+} brl_frame_pixels;
 
 typedef struct brl_app
 {
   void (*init)();
   void (*loop)();
   void (*clean)();
+  void (*update)();
+  size_t frame_state_size;
+  brl_snapshot frame_snapshot;
+  const void *frame_state;
+  int render_thread;
+  int update_rate;
+  struct timespec next_update_time;
+  pthread_t vk_render_thread;
+  atomic_int running;
   GLFWwindow *window;
   VkInstance vk_instance;
+  uint32_t vk_api_version;
+  VkPhysicalDevice vk_physical_device;
   VkDevice vk_device;
+  VkResult vk_result;
+  uint32_t device_lost_count;
   VkQueue vk_queue;
   VkQueue vk_present_queue;
   VkSurfaceKHR vk_window_surface;
   VkSwapchainKHR vk_swp;
   VkImage *vk_swp_images;
   VkFormat vk_swp_image_format;
+  VkColorSpaceKHR vk_swp_color_space;
   VkExtent2D vk_swp_extent;
   VkImageView *vk_swp_image_views;
+  VkSampleCountFlagBits msaa_samples;
+  VkSampleCountFlagBits vk_msaa_samples;
+  VkFormat vk_depth_format;
+  VkImage vk_color_image;
+  VkDeviceMemory vk_color_image_memory;
+  VkImageView vk_color_image_view;
+  VkImage vk_depth_image;
+  VkDeviceMemory vk_depth_image_memory;
+  VkImageView vk_depth_image_view;
   VkRenderPass vk_render_pass;
+  int dynamic_rendering;
+  VkBool32 vk_dynamic_rendering;
+  PFN_vkCmdBeginRenderingKHR vk_cmd_begin_rendering;
+  PFN_vkCmdEndRenderingKHR vk_cmd_end_rendering;
   VkPipelineLayout vk_pipeline_layout;
   VkPipeline vk_pipeline;
   VkFramebuffer *vk_frame_buffers;
   VkCommandPool vk_command_pool;
-  VkCommandBuffer vk_command_buffer;
-  VkSemaphore sema_image_available;
-  VkSemaphore sema_render_finished;
-  VkFence fence_in_flight;
+  VkCommandBuffer vk_command_buffers[BRL_MAX_FRAMES_IN_FLIGHT];
+  VkSemaphore sema_image_available[BRL_MAX_FRAMES_IN_FLIGHT];
+  VkSemaphore *sema_render_finished;
+  brl_queue_family_indices vk_queue_families;
+  VkCommandPool vk_present_command_pool;
+  VkCommandBuffer *vk_present_command_buffers;
+  VkSemaphore *sema_present_ready;
+  VkFence fence_in_flight[BRL_MAX_FRAMES_IN_FLIGHT];
+  uint32_t frames_in_flight;
+  uint32_t vk_frames_in_flight;
+  uint32_t current_frame;
   uint32_t vk_swp_images_count;
+  brl_present_mode present_mode;
+  VkPresentModeKHR vk_present_mode;
+  uint32_t swp_image_count;
+  int max_fps;
+  struct timespec next_frame_time;
+  int low_latency;
+  VkBool32 vk_present_wait;
+  PFN_vkWaitForPresentKHR vk_wait_for_present;
+  VkBool32 vk_memory_budget;
+  uint64_t present_id;
+  double input_times[BRL_PRESENT_HISTORY];
+  double present_latency;
   int width;
   int height;
+  int offscreen;
+  int compute_only;
+  VkDeviceMemory *vk_offscreen_memory;
+  uint32_t last_image;
+  atomic_int closing;
+  brl_window windows[BRL_MAX_WINDOWS];
+  uint32_t windows_count;
+  int capture;
+  VkBool32 vk_capture;
+  brl_readback readbacks[BRL_MAX_READBACKS];
+  uint64_t readback_sequence;
+  uint64_t readbacks_saved;
+  uint64_t readbacks_dropped;
+  pthread_t vk_capture_worker;
+  int capture_worker_running;
+  int capture_worker_stop;
+  pthread_mutex_t capture_lock;
+  pthread_cond_t capture_wake;
+
+  brl_post_effect post_effects[BRL_MAX_POST_EFFECTS];
+  uint32_t post_effects_count;
+  float exposure;
+  float bloom_threshold;
+  float bloom_intensity;
+  VkBool32 vk_post;
+  VkBool32 vk_post_storage;
+  VkFormat vk_color_format;
+  brl_post_target vk_post_targets[BRL_POST_TARGET_COUNT];
+  int vk_post_result;
+  VkDescriptorSetLayout vk_post_set_layout;
+  VkPipelineLayout vk_post_layout;
+  VkPipeline vk_post_pipelines[BRL_POST_EFFECT_COUNT];
+  VkDescriptorPool vk_post_descriptor_pool;
+  VkDescriptorSet *vk_post_sets;
+  brl_post_step vk_post_steps[BRL_MAX_POST_STEPS];
+  uint32_t vk_post_steps_count;
+  VkQueryPool vk_timestamp_pool;
+  float vk_timestamp_period;
+  VkBool32 vk_timestamps_pending[BRL_MAX_FRAMES_IN_FLIGHT];
+  double post_timings[BRL_MAX_POST_STEPS + 2];
+
+  uint32_t max_quads;
+  uint32_t vk_max_quads;
+  brl_batch batch;
+  int batch_open;
+  uint32_t batch_dropped;
+  brl_batch_run *vk_batch_runs;
+  VkBuffer vk_batch_buffer;
+  VkDeviceMemory vk_batch_memory;
+  char *vk_batch_mapped;
+  VkDeviceSize vk_batch_frame_size;
+  brl_texture textures[BRL_MAX_TEXTURES];
+  uint32_t textures_count;
+  VkDescriptorSetLayout vk_texture_set_layout;
+  VkDescriptorPool vk_texture_pool;
+  VkSampler vk_sampler;
+  VkBool32 vk_texture_bc;
+  VkBool32 vk_texture_astc;
+  VkPipelineLayout vk_sprite_layout;
+  VkPipeline vk_sprite_pipelines[BRL_BLEND_COUNT];
+
+  brl_storage_buffer storage_buffers[BRL_MAX_STORAGE_BUFFERS];
+  uint32_t storage_buffers_count;
+  brl_kernel kernels[BRL_MAX_KERNELS];
+  uint32_t kernels_count;
+  VkDescriptorPool vk_compute_pool;
+  uint32_t compute_dispatches;
+  VkQueryPool vk_compute_timestamps;
+  float vk_compute_period;
+  double compute_time;
+
+#ifdef BRL_PROFILE
+  brl_profile_ring *profile_gpu_ring;
+  VkQueryPool vk_profile_pool;
+  float vk_profile_period;
+  VkBool32 vk_profile_pending[BRL_MAX_FRAMES_IN_FLIGHT];
+  uint64_t profile_submit_time[BRL_MAX_FRAMES_IN_FLIGHT];
+  VkBool32 vk_calibrated_timestamps;
+  PFN_vkGetCalibratedTimestampsEXT vk_get_calibrated_timestamps;
+  uint64_t profile_gpu_base;
+  uint64_t profile_cpu_base;
+#endif
+
+  double startup_time;
+  int first_frame_done;
+  brl_startup_stage startup_stages[BRL_MAX_STARTUP_STAGES];
+  atomic_uint startup_stage_count;
+  pthread_t vk_shader_loader;
+  int shaders_loading;
+  brl_file shader_files[2];
+  pthread_t vk_pipeline_worker;
+  VkResult pipeline_result;
 } brl_app;
 
 typedef struct brl_swp_sup_details
@@ -73,11 +499,123 @@ typedef struct brl_swp_sup_details
   uint32_t present_modes_counts;
 } brl_swp_sup_details;
 
-typedef struct brl_queue_family_indices
+/**
+ * Device memory of one heap. Without VK_EXT_memory_budget only the
+ * size is known, budget and usage are then 0.
+ **/
+typedef struct brl_memory_heap
 {
-  int graphics_family;
-  int present_family;
-} brl_queue_family_indices;
+  VkDeviceSize size;
+  VkDeviceSize budget;
+  VkDeviceSize usage;
+  VkMemoryHeapFlags flags;
+} brl_memory_heap;
+
+typedef struct brl_memory_usage
+{
+  size_t host_bytes;
+  size_t host_peak_bytes;
+  size_t host_allocations;
+  int objects[BRL_OBJECT_TYPE_COUNT];
+  VkBool32 budget;
+  uint32_t heaps_count;
+  brl_memory_heap heaps[VK_MAX_MEMORY_HEAPS];
+} brl_memory_usage;
+
+/**
+ * Boreal follows the single header pattern: this part only declares.
+ * Exactly one translation unit defines BRL_IMPLEMENTATION before
+ * including boreal.h to compile the implementation (src/boreal.c), the
+ * others include it as is. BRL_PROFILE and BRL_NODEBUG change the
+ * layout of brl_app and what the implementation does, every
+ * translation unit of a program must be built with the same ones.
+ **/
+
+VkResult brl_create_app(brl_app app);
+VkResult brl_draw_frame(brl_app *app);
+VkResult brl_read_frame(brl_app *app, void *pixels);
+void brl_close(brl_app *app);
+int brl_should_close(brl_app *app);
+void brl_poll_events(brl_app *app);
+void brl_mark_input(brl_app *app);
+double brl_time_seconds();
+
+VkResult brl_create_texture(brl_app *app, uint32_t width, uint32_t height, const void *pixels, uint32_t *texture);
+VkResult brl_load_texture(brl_app *app, const char *path, uint32_t *texture);
+void brl_draw_quad(brl_app *app, float x, float y, float w, float h, uint32_t color);
+void brl_draw_tri(brl_app *app, float x0, float y0, float x1, float y1, float x2, float y2, uint32_t color);
+void brl_draw_transform(brl_app *app, const float transform[6]);
+void brl_draw_layer(brl_app *app, uint32_t layer);
+void brl_draw_blend(brl_app *app, brl_blend_mode blend);
+void brl_draw_texture(brl_app *app, uint32_t texture);
+
+VkResult brl_create_storage_buffer(brl_app *app, VkDeviceSize size, const void *data, uint32_t *buffer);
+void *brl_storage_buffer_data(brl_app *app, uint32_t buffer);
+VkResult brl_create_kernel(brl_app *app, const char *path, uint32_t buffers_count, uint32_t push_size, uint32_t *kernel);
+VkResult brl_dispatch(brl_app *app, uint32_t kernel, const uint32_t *buffers, const void *push_constants, uint32_t groups_x, uint32_t groups_y, uint32_t groups_z);
+VkResult brl_compute_wait(brl_app *app);
+
+VkResult brl_request_readback(brl_app *app, brl_readback_future *future);
+VkResult brl_readback_poll(brl_app *app, brl_readback_future future, brl_frame_pixels *pixels);
+VkResult brl_readback_save(brl_app *app, brl_readback_future future, const char *path, brl_capture_format format);
+void brl_readback_release(brl_app *app, brl_readback_future future);
+
+VkResult brl_error(char *message, VkResult result);
+VkResult brl_create_shader_module(brl_app *app, brl_file file, VkShaderModule *module);
+VkResult brl_create_host_buffer(brl_app *app, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags preferred, VkBuffer *buffer, VkDeviceMemory *memory);
+void brl_query_memory(brl_app *app, brl_memory_usage *usage);
+void brl_memory_report(brl_app *app);
+void brl_print_post_timings(brl_app *app);
+void brl_startup_report(brl_app *app);
+
+#endif
+
+#if defined(BRL_IMPLEMENTATION) && !defined(BRL_APP_IMPLEMENTATION)
+#define BRL_APP_IMPLEMENTATION
+
+// The helpers were included above already, including them again
+// compiles their implementation when boreal.h itself was first
+// included without BRL_IMPLEMENTATION.
+#include <file.h>
+#include <snapshot.h>
+#include <device.h>
+#include <batch.h>
+#include <ktx2.h>
+#include <profile.h>
+#include <telemetry.h>
+#include <image.h>
+
+// Using debug might take a longer time to initialize the
+// instance because of the validation layers.
+#ifdef BRL_NODEBUG
+const int enableValidationLayers = 0;
+#else
+const int enableValidationLayers = 1;
+#endif
+
+const char *validation_layers[] = {
+    "VK_LAYER_KHRONOS_validation",
+};
+#define validation_layers_count sizeof(validation_layers) / sizeof(validation_layers[0])
+
+const char *device_extensions[] = {
+    VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+};
+#define brl_extensions_count sizeof(device_extensions) / sizeof(device_extensions[0])
+
+int brl_is_queue_family_shared(brl_queue_family_indices indices)
+{
+  return indices.graphics_family == indices.present_family;
+}
+
+/**
+ * Family of brl_app.vk_queue, the one every frame or dispatch is
+ * submitted to.
+ **/
+int brl_submit_family(brl_app *app)
+{
+  return app->compute_only ? app->vk_queue_families.compute_family : app->vk_queue_families.graphics_family;
+}
 
 int brl_clamp(int value, int min, int max)
 {
@@ -85,41 +623,66 @@ int brl_clamp(int value, int min, int max)
   return t > max ? max : t;
 }
 
-void brl_exit_error(char *message)
+/**
+ * Reports a failed Vulkan call and hands its result back so the
+ * creation functions can propagate it with a single return.
+ **/
+VkResult brl_error(char *message, VkResult result)
 {
-  printf("BOREAL_ERROR: %s\n", message);
-  exit(1);
+  printf("BOREAL_ERROR: %s (VkResult %d)\n", message, result);
+  return result;
 }
 
-brl_swp_sup_details brl_query_swp_support(brl_app *app, VkPhysicalDevice device)
+#define BRL_CHECK(call)               \
+  do                                  \
+  {                                   \
+    VkResult brl_check_result = call; \
+    if (brl_check_result != VK_SUCCESS) \
+      return brl_check_result;        \
+  } while (0)
+
+brl_swp_sup_details brl_query_surface_support(VkPhysicalDevice device, VkSurfaceKHR surface)
 {
-  brl_swp_sup_details details;
+  brl_swp_sup_details details = {0};
 
-  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, app->vk_window_surface, &details.capabilities);
+  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
 
   uint32_t format_count;
-  vkGetPhysicalDeviceSurfaceFormatsKHR(device, app->vk_window_surface, &format_count, NULL);
+  vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &format_count, NULL);
   if (format_count != 0)
   {
     VkSurfaceFormatKHR *formats = malloc(sizeof(VkSurfaceFormatKHR) * format_count);
-    vkGetPhysicalDeviceSurfaceFormatsKHR(device, app->vk_window_surface, &format_count, formats);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &format_count, formats);
     details.formats = formats;
     details.formats_count = format_count;
   }
 
   uint32_t present_mode_count;
-  vkGetPhysicalDeviceSurfacePresentModesKHR(device, app->vk_window_surface, &present_mode_count, NULL);
-  if (format_count != 0)
+  vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &present_mode_count, NULL);
+  if (present_mode_count != 0)
   {
     VkPresentModeKHR *present_modes = malloc(sizeof(VkPresentModeKHR) * present_mode_count);
-    vkGetPhysicalDeviceSurfacePresentModesKHR(device, app->vk_window_surface, &present_mode_count, present_modes);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &present_mode_count, present_modes);
     details.present_modes = present_modes;
     details.present_modes_counts = present_mode_count;
   }
   return details;
 }
 
-int brl_device_extension_support(VkPhysicalDevice device)
+brl_swp_sup_details brl_query_swp_support(brl_app *app, VkPhysicalDevice device)
+{
+  return brl_query_surface_support(device, app->vk_window_surface);
+}
+
+void brl_free_swp_support(brl_swp_sup_details *details)
+{
+  free(details->formats);
+  free(details->present_modes);
+  details->formats = NULL;
+  details->present_modes = NULL;
+}
+
+int brl_has_device_extension(VkPhysicalDevice device, const char *extension_name)
 {
   uint32_t extension_count;
   vkEnumerateDeviceExtensionProperties(device, NULL, &extension_count, NULL);
@@ -127,19 +690,25 @@ int brl_device_extension_support(VkPhysicalDevice device)
   VkExtensionProperties *properties = malloc(sizeof(VkExtensionProperties) * extension_count);
   vkEnumerateDeviceExtensionProperties(device, NULL, &extension_count, properties);
 
-  for (int i = 0; i < brl_extensions_count; i++)
+  int found = 0;
+  for (int i = 0; i < extension_count; i++)
   {
-    int found = 0;
-    for (int j = 0; j < extension_count; j++)
+    if (strcmp(properties[i].extensionName, extension_name) == 0)
     {
-      VkExtensionProperties property = properties[j];
-      if (strcmp(property.extensionName, device_extensions[i]))
-      {
-        found = 1;
-        break;
-      }
+      found = 1;
+      break;
     }
-    if (!found)
+  }
+
+  free(properties);
+  return found;
+}
+
+int brl_device_extension_support(VkPhysicalDevice device)
+{
+  for (int i = 0; i < brl_extensions_count; i++)
+  {
+    if (!brl_has_device_extension(device, device_extensions[i]))
       return 0;
   }
 
@@ -169,10 +738,12 @@ int brl_check_validation_layer_support()
 
     if (!layer_found)
     {
-      printf("Validation layer '%s' not found.\n");
+      printf("Validation layer '%s' not found.\n", validation_layers[i]);
+      free(properties);
       return 0;
     }
   }
+  free(properties);
   return 1;
 }
 
@@ -180,24 +751,37 @@ int brl_check_validation_layer_support()
  * Create a new VkInstance and insert it into the brl_app
  * this include validation layers setup and extension listings
  **/
-void brl_create_instance(brl_app *app)
+VkResult brl_create_instance(brl_app *app)
 {
+  // vkEnumerateInstanceVersion does not exist on 1.0 loaders, and
+  // 1.0 implementations refuse any apiVersion above 1.0.
+  uint32_t api_version = VK_API_VERSION_1_0;
+  PFN_vkEnumerateInstanceVersion enumerate_instance_version =
+      (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(VK_NULL_HANDLE, "vkEnumerateInstanceVersion");
+  if (enumerate_instance_version)
+    enumerate_instance_version(&api_version);
+
+  if (api_version > BRL_MAX_API_VERSION)
+    api_version = BRL_MAX_API_VERSION;
+
   VkApplicationInfo app_info = {
       .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
       .pApplicationName = "Boreal",
       .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
-      .apiVersion = VK_API_VERSION_1_0,
       .pEngineName = "No Engine",
       .engineVersion = VK_MAKE_VERSION(1, 0, 0),
-      .apiVersion = VK_API_VERSION_1_0,
+      .apiVersion = api_version,
   };
 
+  // Offscreen rendering needs no surface, and so no GLFW.
   uint32_t glfw_extensions_count = 0;
-  const char **required_extensions = glfwGetRequiredInstanceExtensions(&glfw_extensions_count);
+  const char **required_extensions = NULL;
+  if (!app->offscreen)
+    required_extensions = glfwGetRequiredInstanceExtensions(&glfw_extensions_count);
 
   // Adding validations layers
-  if (!brl_check_validation_layer_support())
-    exit(1);
+  if (enableValidationLayers && !brl_check_validation_layer_support())
+    return brl_error("Validation layers requested but not available.", VK_ERROR_LAYER_NOT_PRESENT);
 
   VkInstanceCreateInfo instance_create_info = {
       .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
@@ -209,21 +793,30 @@ void brl_create_instance(brl_app *app)
       .ppEnabledLayerNames = enableValidationLayers ? validation_layers : NULL,
   };
 
-  VkInstance instance = malloc(sizeof(VkInstance));
-  VkResult result = vkCreateInstance(&instance_create_info, NULL, &instance);
+  VkInstance instance = VK_NULL_HANDLE;
+  VkResult result = brl_object_created(BRL_OBJECT_INSTANCE, vkCreateInstance(&instance_create_info, BRL_ALLOCATOR, &instance));
   if (result != VK_SUCCESS)
-  {
-    printf("Couldn't create VkInstance.\n");
-    exit(1);
-  }
+    return brl_error("Couldn't create VkInstance.", result);
 
-  printf("-> Created VkInstance\n");
+  printf("-> Created VkInstance (API %d.%d)\n", VK_API_VERSION_MAJOR(api_version), VK_API_VERSION_MINOR(api_version));
   app->vk_instance = instance;
+  app->vk_api_version = api_version;
+  return VK_SUCCESS;
 }
 
+/**
+ * A family that can both render and present is always preferred, the
+ * swapchain images then never change queue family. Otherwise the
+ * first graphics family and the first present family are used, and
+ * the images are handed over with ownership transfer barriers.
+ *
+ * Compute-only apps look for a compute family without graphics, the
+ * dedicated compute queue of discrete GPUs, and take the first compute
+ * family otherwise.
+ **/
 brl_queue_family_indices brl_find_queue_families(brl_app *app, VkPhysicalDevice device)
 {
-  brl_queue_family_indices indices = {-1, -1};
+  brl_queue_family_indices indices = {-1, -1, -1};
 
   uint32_t queue_family_count = 0;
   vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, NULL);
@@ -231,78 +824,165 @@ brl_queue_family_indices brl_find_queue_families(brl_app *app, VkPhysicalDevice
   VkQueueFamilyProperties *queue_families = malloc(sizeof(VkQueueFamilyProperties) * queue_family_count);
   vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, queue_families);
 
-  for (int i = 0; i < queue_family_count; i++)
+  int compute_dedicated = 0;
+  for (int i = 0; i < queue_family_count && app->compute_only; i++)
   {
-    VkQueueFamilyProperties queue_family = queue_families[i];
-    if (queue_family.queueFlags & VK_QUEUE_GRAPHICS_BIT)
-      indices.graphics_family = i;
+    VkQueueFlags flags = queue_families[i].queueFlags;
+    int dedicated = !(flags & VK_QUEUE_GRAPHICS_BIT);
+    if ((flags & VK_QUEUE_COMPUTE_BIT) && (indices.compute_family == -1 || (dedicated && !compute_dedicated)))
+    {
+      indices.compute_family = i;
+      compute_dedicated = dedicated;
+    }
+  }
 
-    VkBool32 presentSupport = VK_FALSE;
-    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, app->vk_window_surface, &presentSupport);
-    if (presentSupport)
+  for (int i = 0; i < queue_family_count && !app->compute_only; i++)
+  {
+    int graphics = (queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+
+    VkBool32 present_support = app->offscreen ? graphics : VK_FALSE;
+    if (!app->offscreen)
+      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, app->vk_window_surface, &present_support);
+
+    if (graphics && present_support)
+    {
+      indices.graphics_family = i;
       indices.present_family = i;
+      break;
+    }
+
+    if (graphics && indices.graphics_family == -1)
+      indices.graphics_family = i;
 
-    i++;
+    if (present_support && indices.present_family == -1)
+      indices.present_family = i;
   }
+
+  free(queue_families);
   return indices;
 }
 
-int brl_is_queue_family_complete(brl_queue_family_indices indices)
+int brl_is_queue_family_complete(brl_app *app, brl_queue_family_indices indices)
 {
+  if (app->compute_only)
+    return indices.compute_family != -1;
   return indices.graphics_family != -1 && indices.present_family != -1;
 }
 
 /**
- * This function checks for the physical device suitability
- * of the application.
- * The rules that are being set are the followings:
- *
- * - The physical device must have a graphical queue family
- * - The physical device must be a discrete GPU type
- * - The physical device must have a geometry shader feature
+ * Copies out of Vulkan everything brl_score_device needs. The device
+ * UUID needs Vulkan 1.1, on older instances selection by UUID is not
+ * available and only the index can be used.
  **/
-int brl_is_physical_device_suitable(brl_app *app, VkPhysicalDevice device)
+void brl_query_device_info(brl_app *app, VkPhysicalDevice device, brl_device_info *info)
 {
-  VkPhysicalDeviceProperties properties;
-  vkGetPhysicalDeviceProperties(device, &properties);
+  memset(info, 0, sizeof(brl_device_info));
+  vkGetPhysicalDeviceProperties(device, &info->properties);
+  vkGetPhysicalDeviceMemoryProperties(device, &info->memory);
+  vkGetPhysicalDeviceFeatures(device, &info->features);
 
-  VkPhysicalDeviceFeatures features;
-  vkGetPhysicalDeviceFeatures(device, &features);
+  if (app->vk_api_version >= VK_API_VERSION_1_1)
+  {
+    VkPhysicalDeviceIDProperties id_properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES,
+    };
+    VkPhysicalDeviceProperties2 properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &id_properties,
+    };
+    vkGetPhysicalDeviceProperties2(device, &properties);
+    memcpy(info->uuid, id_properties.deviceUUID, VK_UUID_SIZE);
+    info->has_uuid = 1;
+  }
 
-  brl_queue_family_indices families_indices = brl_find_queue_families(app, device);
-  if (!brl_is_queue_family_complete(families_indices))
-    return 0;
+  uint32_t queue_family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, NULL);
+  if (queue_family_count > BRL_MAX_QUEUE_FAMILIES)
+    queue_family_count = BRL_MAX_QUEUE_FAMILIES;
+  vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, info->queue_families);
+  info->queue_family_count = queue_family_count;
+  info->compute_only = app->compute_only;
+
+  // Offscreen frames are "presented" by the graphics queue itself.
+  if (app->offscreen)
+  {
+    for (uint32_t i = 0; i < queue_family_count; i++)
+      info->present_support[i] = (info->queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+    info->extensions_supported = 1;
+    info->surface_supported = 1;
+    return;
+  }
 
-  if (!brl_device_extension_support(device))
-    return 0;
+  for (uint32_t i = 0; i < queue_family_count; i++)
+    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, app->vk_window_surface, &info->present_support[i]);
 
-  brl_swp_sup_details swp_support = brl_query_swp_support(app, device);
-  if (swp_support.formats == NULL || swp_support.present_modes == NULL)
-    return 0;
+  info->extensions_supported = brl_device_extension_support(device);
 
-  return 1;
+  uint32_t formats_count = 0, present_modes_count = 0;
+  if (info->extensions_supported)
+  {
+    vkGetPhysicalDeviceSurfaceFormatsKHR(device, app->vk_window_surface, &formats_count, NULL);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(device, app->vk_window_surface, &present_modes_count, NULL);
+  }
+  info->surface_supported = formats_count > 0 && present_modes_count > 0;
 }
 
-VkPresentModeKHR brl_pick_swp_present_mode(VkPresentModeKHR *present_modes, uint32_t present_modes_count)
+VkPresentModeKHR brl_pick_swp_present_mode(brl_present_mode preferred, VkPresentModeKHR *present_modes, uint32_t present_modes_count)
 {
+  VkPresentModeKHR wanted;
+  switch (preferred)
+  {
+  case BRL_PRESENT_MODE_FIFO:
+    return VK_PRESENT_MODE_FIFO_KHR;
+  case BRL_PRESENT_MODE_FIFO_RELAXED:
+    wanted = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+    break;
+  case BRL_PRESENT_MODE_IMMEDIATE:
+    wanted = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    break;
+  default:
+    wanted = VK_PRESENT_MODE_MAILBOX_KHR;
+    break;
+  }
+
   for (int i = 0; i < present_modes_count; i++)
   {
     VkPresentModeKHR present_mode = present_modes[i];
-    if (present_mode == VK_PRESENT_MODE_MAILBOX_KHR)
+    if (present_mode == wanted)
       return present_mode;
   }
 
   return VK_PRESENT_MODE_FIFO_KHR;
 }
 
-VkExtent2D brl_pick_swp_extent(brl_app *app, VkSurfaceCapabilitiesKHR capabilities)
+/**
+ * The image count asked in brl_app.swp_image_count is clamped to the
+ * surface limits, 0 keeps one image above the minimum so the driver
+ * never has to wait on us to release an image.
+ **/
+uint32_t brl_pick_swp_image_count(brl_app *app, VkSurfaceCapabilitiesKHR capabilities)
+{
+  uint32_t image_count = app->swp_image_count ? app->swp_image_count : capabilities.minImageCount + 1;
+
+  if (image_count < capabilities.minImageCount)
+    image_count = capabilities.minImageCount;
+
+  if (capabilities.maxImageCount > 0 && image_count > capabilities.maxImageCount)
+    image_count = capabilities.maxImageCount;
+
+  return image_count;
+}
+
+/**
+ * When the surface leaves the extent to the swapchain (Wayland), the
+ * window's requested size is used. Windows are not resizable, and this
+ * runs on the render thread, where GLFW cannot be queried.
+ **/
+VkExtent2D brl_pick_swp_extent(int width, int height, VkSurfaceCapabilitiesKHR capabilities)
 {
   if (capabilities.currentExtent.width != UINT32_MAX)
     return capabilities.currentExtent;
 
-  int width, height;
-  glfwGetFramebufferSize(app->window, &width, &height);
-
   VkExtent2D actual_extent = {
       .width = width,
       .height = height,
@@ -330,35 +1010,43 @@ VkSurfaceFormatKHR brl_pick_swp_surface_format(VkSurfaceFormatKHR *formats, uint
  * computer's physical devices and pick one that is suitable
  * to our needs.
  *
- * The check of a physical device suitability is done
- * through the brl_is_physical_device_suitable function
+ * Every device is ranked by brl_score_device (device.h), the
+ * BRL_DEVICE environment variable can force a device by index or UUID.
  **/
-VkPhysicalDevice brl_pick_physical_device(brl_app *app)
+VkResult brl_pick_physical_device(brl_app *app, VkPhysicalDevice *physical_device)
 {
-  VkPhysicalDevice physical_device = VK_NULL_HANDLE;
+  *physical_device = VK_NULL_HANDLE;
   uint32_t device_count = 0;
   vkEnumeratePhysicalDevices(app->vk_instance, &device_count, NULL);
   if (device_count == 0)
-    brl_exit_error("Failed to find any GPU with Vulkan support.");
+    return brl_error("Failed to find any GPU with Vulkan support.", VK_ERROR_INCOMPATIBLE_DRIVER);
 
   VkPhysicalDevice *devices = malloc(sizeof(VkPhysicalDevice) * device_count);
+  brl_device_info *infos = malloc(sizeof(brl_device_info) * device_count);
   vkEnumeratePhysicalDevices(app->vk_instance, &device_count, devices);
-  for (int i = 0; i < device_count; i++)
+  for (uint32_t i = 0; i < device_count; i++)
   {
-    VkPhysicalDevice device = devices[i];
-    if (brl_is_physical_device_suitable(app, device))
-    {
-      physical_device = device;
-      break;
-    }
+    brl_query_device_info(app, devices[i], &infos[i]);
+    printf("   [%d] %s (score %lld)\n", i, infos[i].properties.deviceName, (long long)brl_score_device(&infos[i]));
+  }
 
-    if (physical_device == VK_NULL_HANDLE)
-      brl_exit_error("No suitable physical device.");
+  int selected = brl_select_device(infos, device_count, getenv(BRL_DEVICE_ENV));
+  if (selected != -1)
+  {
+    *physical_device = devices[selected];
+    printf("SET: physical device ([%d] %s)\n", selected, infos[selected].properties.deviceName);
   }
+  free(devices);
+  free(infos);
 
-  return physical_device;
+  if (*physical_device == VK_NULL_HANDLE)
+    return brl_error("No suitable physical device.", VK_ERROR_INCOMPATIBLE_DRIVER);
+
+  app->vk_physical_device = *physical_device;
+  return VK_SUCCESS;
 }
 
+#ifdef BRL_LIST_EXTENSIONS
 void brl_list_available_extensions()
 {
   uint32_t extension_count = 0;
@@ -377,51 +1065,215 @@ void brl_list_available_extensions()
 
   free(properties);
 }
+#endif
 
 /**
- * Creating a logical device from a physical device
- * This do a slight check on the queues to be sure we do not
- * create 2 devices queues that have the same family index.
+ * Dynamic rendering is core in Vulkan 1.3 and available through
+ * VK_KHR_dynamic_rendering on 1.2 devices. The extension path needs
+ * vkGetPhysicalDeviceFeatures2, so a 1.0 instance never uses it.
+ * Returns 0 when unsupported, 1 when core and 2 when through the
+ * extension.
  **/
-void brl_create_logical_device(brl_app *app, VkPhysicalDevice physical_device)
+int brl_dynamic_rendering_support(brl_app *app, VkPhysicalDevice physical_device)
 {
-  brl_queue_family_indices indices = brl_find_queue_families(app, physical_device);
+  if (app->vk_api_version < VK_API_VERSION_1_2)
+    return 0;
 
-  VkPhysicalDeviceFeatures device_features = {0};
-  VkDeviceCreateInfo device_info = {
-      .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-      .pEnabledFeatures = &device_features,
-  };
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physical_device, &properties);
 
-  float queue_priority = 1.0f;
-  VkBool32 is_multiple = indices.graphics_family != indices.present_family;
+  int support = 0;
+  if (app->vk_api_version >= VK_API_VERSION_1_3 && properties.apiVersion >= VK_API_VERSION_1_3)
+    support = 1;
+  else if (properties.apiVersion >= VK_API_VERSION_1_2 && brl_has_device_extension(physical_device, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME))
+    support = 2;
 
-  VkDeviceQueueCreateInfo queue_create_infos[2];
-  VkDeviceQueueCreateInfo queue_create_info;
+  if (!support)
+    return 0;
 
-  if (is_multiple)
-  {
-    uint32_t unique_queue_families[] = {indices.graphics_family, indices.present_family};
-    uint32_t info_sizes = sizeof(unique_queue_families) / sizeof(unique_queue_families[0]);
+  VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamic_rendering_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+  };
+  VkPhysicalDeviceFeatures2 features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+      .pNext = &dynamic_rendering_features,
+  };
+  vkGetPhysicalDeviceFeatures2(physical_device, &features);
 
-    for (int i = 0; i < info_sizes; i++)
-    {
-      queue_create_infos[i] = (VkDeviceQueueCreateInfo){
-          .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-          .queueFamilyIndex = unique_queue_families[i],
-          .queueCount = 1,
-          .pQueuePriorities = &queue_priority,
-      };
-    }
+  return dynamic_rendering_features.dynamicRendering ? support : 0;
+}
 
-    device_info.queueCreateInfoCount = info_sizes;
-    device_info.pQueueCreateInfos = queue_create_infos;
-  }
-  else
+/**
+ * VK_KHR_present_wait lets us block until a given present has
+ * actually reached the display, which is what allows sampling input
+ * as late as possible. Both extensions and features are needed.
+ **/
+int brl_present_wait_support(brl_app *app, VkPhysicalDevice physical_device)
+{
+  if (app->vk_api_version < VK_API_VERSION_1_1)
+    return 0;
+
+  if (!brl_has_device_extension(physical_device, VK_KHR_PRESENT_ID_EXTENSION_NAME) ||
+      !brl_has_device_extension(physical_device, VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+    return 0;
+
+  VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+  };
+  VkPhysicalDevicePresentIdFeaturesKHR present_id_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+      .pNext = &present_wait_features,
+  };
+  VkPhysicalDeviceFeatures2 features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+      .pNext = &present_id_features,
+  };
+  vkGetPhysicalDeviceFeatures2(physical_device, &features);
+
+  return present_id_features.presentId && present_wait_features.presentWait;
+}
+
+/**
+ * VK_EXT_memory_budget reports how much of each heap the process uses
+ * and may use, through vkGetPhysicalDeviceMemoryProperties2.
+ **/
+int brl_memory_budget_support(brl_app *app, VkPhysicalDevice physical_device)
+{
+  return app->vk_api_version >= VK_API_VERSION_1_1 &&
+         brl_has_device_extension(physical_device, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+}
+
+#ifdef BRL_PROFILE
+/**
+ * Calibrated timestamps give the GPU clock and CLOCK_MONOTONIC at the
+ * same instant, which is what places GPU zones on the CPU timeline.
+ **/
+int brl_calibrated_timestamps_support(brl_app *app, VkPhysicalDevice physical_device)
+{
+  if (!brl_has_device_extension(physical_device, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME))
+    return 0;
+
+  PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT get_time_domains =
+      (PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT)vkGetInstanceProcAddr(app->vk_instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT");
+  if (get_time_domains == NULL)
+    return 0;
+
+  VkTimeDomainEXT domains[8];
+  uint32_t domains_count = 8;
+  if (get_time_domains(physical_device, &domains_count, domains) < 0)
+    return 0;
+
+  int device = 0, monotonic = 0;
+  for (uint32_t i = 0; i < domains_count; i++)
+  {
+    device |= domains[i] == VK_TIME_DOMAIN_DEVICE_EXT;
+    monotonic |= domains[i] == VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+  }
+
+  return device && monotonic;
+}
+#endif
+
+/**
+ * Drops unknown effects from brl_app.post_effects, they index the
+ * post pipelines and shaders.
+ **/
+void brl_validate_post_effects(brl_app *app)
+{
+  if (app->post_effects_count > BRL_MAX_POST_EFFECTS)
+  {
+    printf("BOREAL_WARNING: Only %d post effects are supported.\n", BRL_MAX_POST_EFFECTS);
+    app->post_effects_count = BRL_MAX_POST_EFFECTS;
+  }
+
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < app->post_effects_count; i++)
+  {
+    if ((uint32_t)app->post_effects[i] >= BRL_POST_EFFECT_COUNT)
+    {
+      printf("BOREAL_WARNING: Unknown post effect %d ignored.\n", app->post_effects[i]);
+      continue;
+    }
+    app->post_effects[count++] = app->post_effects[i];
+  }
+  app->post_effects_count = count;
+}
+
+/**
+ * Creating a logical device from a physical device
+ * This do a slight check on the queues to be sure we do not
+ * create 2 devices queues that have the same family index.
+ **/
+VkResult brl_create_logical_device(brl_app *app, VkPhysicalDevice physical_device)
+{
+  brl_queue_family_indices indices = brl_find_queue_families(app, physical_device);
+  if (!brl_is_queue_family_complete(app, indices))
+    return brl_error(app->compute_only ? "No compute queue family." : "No graphics or present queue family.", VK_ERROR_FEATURE_NOT_PRESENT);
+
+  app->vk_queue_families = indices;
+  if (app->compute_only)
+    printf("SET: queue families (compute on family %d)\n", indices.compute_family);
+  else if (brl_is_queue_family_shared(indices))
+    printf("SET: queue families (graphics and present on family %d)\n", indices.graphics_family);
+  else
+    printf("SET: queue families (graphics on %d, present on %d, exclusive with ownership transfer)\n",
+           indices.graphics_family, indices.present_family);
+
+  VkPhysicalDeviceFeatures device_features = {0};
+
+  // The post passes write the swapchain and the HDR targets through
+  // the same shader binding, which needs format-less storage writes.
+  VkPhysicalDeviceFeatures supported_features;
+  vkGetPhysicalDeviceFeatures(physical_device, &supported_features);
+  brl_validate_post_effects(app);
+  app->vk_post = app->post_effects_count > 0 && !app->compute_only;
+  if (app->vk_post && !supported_features.shaderStorageImageWriteWithoutFormat)
+  {
+    printf("Storage writes without format not supported, post processing disabled.\n");
+    app->vk_post = VK_FALSE;
+  }
+  device_features.shaderStorageImageWriteWithoutFormat = app->vk_post;
+
+  // Block compressed textures are only loaded when the device samples
+  // them natively, there is no CPU decode fallback.
+  app->vk_texture_bc = supported_features.textureCompressionBC;
+  app->vk_texture_astc = supported_features.textureCompressionASTC_LDR;
+  device_features.textureCompressionBC = app->vk_texture_bc;
+  device_features.textureCompressionASTC_LDR = app->vk_texture_astc;
+  VkDeviceCreateInfo device_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+      .pEnabledFeatures = &device_features,
+  };
+
+  float queue_priority = 1.0f;
+  VkBool32 is_multiple = indices.graphics_family != indices.present_family;
+
+  VkDeviceQueueCreateInfo queue_create_infos[2];
+  VkDeviceQueueCreateInfo queue_create_info;
+
+  if (is_multiple)
+  {
+    uint32_t unique_queue_families[] = {indices.graphics_family, indices.present_family};
+    uint32_t info_sizes = sizeof(unique_queue_families) / sizeof(unique_queue_families[0]);
+
+    for (int i = 0; i < info_sizes; i++)
+    {
+      queue_create_infos[i] = (VkDeviceQueueCreateInfo){
+          .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+          .queueFamilyIndex = unique_queue_families[i],
+          .queueCount = 1,
+          .pQueuePriorities = &queue_priority,
+      };
+    }
+
+    device_info.queueCreateInfoCount = info_sizes;
+    device_info.pQueueCreateInfos = queue_create_infos;
+  }
+  else
   {
     queue_create_info = (VkDeviceQueueCreateInfo){
         .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-        .queueFamilyIndex = indices.graphics_family,
+        .queueFamilyIndex = brl_submit_family(app),
         .queueCount = 1,
         .pQueuePriorities = &queue_priority,
     };
@@ -440,549 +1292,5047 @@ void brl_create_logical_device(brl_app *app, VkPhysicalDevice physical_device)
     device_info.enabledLayerCount = 0;
   }
 
-  device_info.enabledExtensionCount = brl_extensions_count;
-  device_info.ppEnabledExtensionNames = device_extensions;
+  const char *extensions[BRL_MAX_DEVICE_EXTENSIONS];
+  uint32_t extensions_count = 0;
+  for (int i = 0; i < brl_extensions_count && !app->offscreen; i++)
+    extensions[extensions_count++] = device_extensions[i];
+
+  VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamic_rendering_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+      .dynamicRendering = VK_TRUE,
+  };
+
+  VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+      .presentWait = VK_TRUE,
+  };
+  VkPhysicalDevicePresentIdFeaturesKHR present_id_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+      .pNext = &present_wait_features,
+      .presentId = VK_TRUE,
+  };
+
+  int dynamic_rendering = app->dynamic_rendering && !app->compute_only ? brl_dynamic_rendering_support(app, physical_device) : 0;
+  if (dynamic_rendering)
+  {
+    dynamic_rendering_features.pNext = (void *)device_info.pNext;
+    device_info.pNext = &dynamic_rendering_features;
+  }
+  if (dynamic_rendering == 2)
+    extensions[extensions_count++] = VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME;
+
+  int present_wait = app->low_latency && !app->offscreen ? brl_present_wait_support(app, physical_device) : 0;
+  if (present_wait)
+  {
+    present_wait_features.pNext = (void *)device_info.pNext;
+    device_info.pNext = &present_id_features;
+    extensions[extensions_count++] = VK_KHR_PRESENT_ID_EXTENSION_NAME;
+    extensions[extensions_count++] = VK_KHR_PRESENT_WAIT_EXTENSION_NAME;
+  }
+
+  int memory_budget = brl_memory_budget_support(app, physical_device);
+  if (memory_budget)
+    extensions[extensions_count++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
 
-  VkDevice device = malloc(sizeof(VkDevice));
-  if (vkCreateDevice(physical_device, &device_info, NULL, &device) != VK_SUCCESS)
-    brl_exit_error("Failed to create logical device.");
+#ifdef BRL_PROFILE
+  int calibrated_timestamps = brl_calibrated_timestamps_support(app, physical_device);
+  if (calibrated_timestamps)
+    extensions[extensions_count++] = VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME;
+#endif
+
+  device_info.enabledExtensionCount = extensions_count;
+  device_info.ppEnabledExtensionNames = extensions;
+
+  VkDevice device = VK_NULL_HANDLE;
+  VkResult result = brl_object_created(BRL_OBJECT_DEVICE, vkCreateDevice(physical_device, &device_info, BRL_ALLOCATOR, &device));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create logical device.", result);
 
   printf("-> Created VkDevice\n");
   app->vk_device = device;
+
+  app->vk_dynamic_rendering = dynamic_rendering != 0;
+  if (app->vk_dynamic_rendering)
+  {
+    app->vk_cmd_begin_rendering = (PFN_vkCmdBeginRenderingKHR)vkGetDeviceProcAddr(device, dynamic_rendering == 1 ? "vkCmdBeginRendering" : "vkCmdBeginRenderingKHR");
+    app->vk_cmd_end_rendering = (PFN_vkCmdEndRenderingKHR)vkGetDeviceProcAddr(device, dynamic_rendering == 1 ? "vkCmdEndRendering" : "vkCmdEndRenderingKHR");
+    printf("SET: vk_dynamic_rendering (%s)\n", dynamic_rendering == 1 ? "core" : VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+  }
+  else if (app->dynamic_rendering)
+  {
+    printf("Dynamic rendering not supported, using render pass fallback.\n");
+  }
+
+  app->vk_present_wait = present_wait;
+  if (app->vk_present_wait)
+  {
+    app->vk_wait_for_present = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(device, "vkWaitForPresentKHR");
+    printf("SET: vk_present_wait (%s)\n", VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+  }
+  else if (app->low_latency)
+  {
+    printf("Present wait not supported, low latency mode only uses the frame limiter.\n");
+  }
+
+  app->vk_memory_budget = memory_budget;
+  if (app->vk_memory_budget)
+    printf("SET: vk_memory_budget (%s)\n", VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+#ifdef BRL_PROFILE
+  app->vk_calibrated_timestamps = calibrated_timestamps;
+  if (calibrated_timestamps)
+  {
+    app->vk_get_calibrated_timestamps = (PFN_vkGetCalibratedTimestampsEXT)vkGetDeviceProcAddr(device, "vkGetCalibratedTimestampsEXT");
+    app->vk_calibrated_timestamps = app->vk_get_calibrated_timestamps != NULL;
+  }
+  if (app->vk_calibrated_timestamps)
+    printf("SET: vk_calibrated_timestamps (%s)\n", VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+  else
+    printf("Calibrated timestamps not supported, GPU zones are aligned on submits.\n");
+#endif
+
+  return VK_SUCCESS;
 }
 
 void brl_set_device_queue(brl_app *app, VkPhysicalDevice physical_device)
 {
-  brl_queue_family_indices indices = brl_find_queue_families(app, physical_device);
-  VkQueue queue = malloc(sizeof(VkQueue));
-  vkGetDeviceQueue(app->vk_device, indices.graphics_family, 0, &queue);
+  VkQueue queue = VK_NULL_HANDLE;
+  vkGetDeviceQueue(app->vk_device, brl_submit_family(app), 0, &queue);
   app->vk_queue = queue;
   printf("SET: vk_queue (Device queue)\n");
 }
 
 void brl_set_present_queue(brl_app *app, VkPhysicalDevice physical_device)
 {
-  brl_queue_family_indices indices = brl_find_queue_families(app, physical_device);
-  VkQueue queue = malloc(sizeof(VkQueue));
-  vkGetDeviceQueue(app->vk_device, indices.present_family, 0, &queue);
+  VkQueue queue = VK_NULL_HANDLE;
+  vkGetDeviceQueue(app->vk_device, app->vk_queue_families.present_family, 0, &queue);
   app->vk_present_queue = queue;
   printf("SET: vk_present_queue (Presentation queue)\n");
 }
 
-void brl_create_window_surface(brl_app *app)
+VkResult brl_create_window_surface(brl_app *app)
 {
 
-  VkSurfaceKHR window_surface = malloc(sizeof(VkSurfaceKHR));
-  VkResult result = glfwCreateWindowSurface(app->vk_instance, app->window, NULL, &window_surface);
+  VkSurfaceKHR window_surface = VK_NULL_HANDLE;
+  VkResult result = brl_object_created(BRL_OBJECT_SURFACE, glfwCreateWindowSurface(app->vk_instance, app->window, BRL_ALLOCATOR, &window_surface));
   if (result != VK_SUCCESS)
-    brl_exit_error("Failed to create window surface.");
+    return brl_error("Failed to create window surface.", result);
 
   printf("-> Created VkSurfaceKHR (window surface)\n");
   app->vk_window_surface = window_surface;
+  return VK_SUCCESS;
 }
 
-void brl_create_swp(brl_app *app, VkPhysicalDevice physical_device)
+/**
+ * Offscreen images are RGBA so a readback is directly usable as
+ * pixels. Like on a surface, a UNORM format that allows storage lets
+ * the last post pass write the image directly.
+ **/
+void brl_pick_offscreen_format(brl_app *app, VkPhysicalDevice physical_device)
 {
-  brl_swp_sup_details swp_support = brl_query_swp_support(app, physical_device);
-  VkSurfaceFormatKHR surface_format = brl_pick_swp_surface_format(swp_support.formats, swp_support.formats_count);
-  VkPresentModeKHR present_mode = brl_pick_swp_present_mode(swp_support.present_modes, swp_support.present_modes_counts);
-  VkExtent2D extent = brl_pick_swp_extent(app, swp_support.capabilities);
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(physical_device, VK_FORMAT_R8G8B8A8_UNORM, &properties);
+  app->vk_post_storage = app->vk_post && (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
+
+  app->vk_swp_image_format = app->vk_post_storage ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R8G8B8A8_SRGB;
+  app->vk_swp_color_space = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+  app->vk_color_format = app->vk_post ? BRL_HDR_FORMAT : app->vk_swp_image_format;
+  printf("SET: offscreen format (%s)\n", app->vk_post_storage ? "UNORM, compute writes the image" : "sRGB");
+}
+
+/**
+ * The surface format is picked ahead of the swapchain so the render
+ * pass and the pipeline can be built without waiting for it.
+ **/
+void brl_pick_swp_format(brl_app *app, VkPhysicalDevice physical_device)
+{
+  if (app->offscreen)
+  {
+    brl_pick_offscreen_format(app, physical_device);
+    return;
+  }
+
+  uint32_t formats_count = 0;
+  vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, app->vk_window_surface, &formats_count, NULL);
+  VkSurfaceFormatKHR *formats = malloc(sizeof(VkSurfaceFormatKHR) * formats_count);
+  vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, app->vk_window_surface, &formats_count, formats);
+
+  VkSurfaceFormatKHR surface_format = brl_pick_swp_surface_format(formats, formats_count);
+
+  // The last post pass can write the swapchain image directly when it
+  // allows storage usage, which sRGB formats never do. Otherwise its
+  // result is blitted, which also takes care of the sRGB encoding.
+  app->vk_post_storage = VK_FALSE;
+  if (app->vk_post)
+  {
+    VkSurfaceCapabilitiesKHR capabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, app->vk_window_surface, &capabilities);
+
+    for (uint32_t i = 0; i < formats_count && (capabilities.supportedUsageFlags & VK_IMAGE_USAGE_STORAGE_BIT); i++)
+    {
+      VkFormatProperties properties;
+      vkGetPhysicalDeviceFormatProperties(physical_device, formats[i].format, &properties);
+      VkBool32 unorm = formats[i].format == VK_FORMAT_B8G8R8A8_UNORM || formats[i].format == VK_FORMAT_R8G8B8A8_UNORM;
+      if (unorm && formats[i].colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR &&
+          (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT))
+      {
+        surface_format = formats[i];
+        app->vk_post_storage = VK_TRUE;
+        break;
+      }
+    }
+
+    printf("SET: post output (%s)\n", app->vk_post_storage ? "compute writes the swapchain" : "blit to the swapchain");
+  }
+
+  app->vk_swp_image_format = surface_format.format;
+  app->vk_swp_color_space = surface_format.colorSpace;
+  app->vk_color_format = app->vk_post ? BRL_HDR_FORMAT : surface_format.format;
+  free(formats);
+}
+
+/**
+ * Layout a finished frame is handed over in. Offscreen images are
+ * left ready to be copied from instead of presented.
+ **/
+VkImageLayout brl_present_layout(brl_app *app)
+{
+  return app->offscreen ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+}
+
+VkImageUsageFlags brl_swp_post_usage(brl_app *app)
+{
+  if (!app->vk_post)
+    return 0;
 
-  uint32_t image_count = swp_support.capabilities.minImageCount + 1;
+  return app->vk_post_storage ? VK_IMAGE_USAGE_STORAGE_BIT : VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+}
+
+VkResult brl_create_offscreen_images(brl_app *app, VkPhysicalDevice physical_device);
+
+VkResult brl_create_swp(brl_app *app, VkPhysicalDevice physical_device, VkSwapchainKHR old_swapchain)
+{
+  if (app->offscreen)
+    return brl_create_offscreen_images(app, physical_device);
 
-  if (swp_support.capabilities.maxImageCount > 0 && image_count > swp_support.capabilities.maxImageCount)
-    image_count = swp_support.capabilities.maxImageCount;
+  brl_swp_sup_details swp_support = brl_query_swp_support(app, physical_device);
+  VkPresentModeKHR present_mode = brl_pick_swp_present_mode(app->present_mode, swp_support.present_modes, swp_support.present_modes_counts);
+  VkExtent2D extent = brl_pick_swp_extent(app->width, app->height, swp_support.capabilities);
+  uint32_t image_count = brl_pick_swp_image_count(app, swp_support.capabilities);
+  VkSurfaceTransformFlagBitsKHR transform = swp_support.capabilities.currentTransform;
+  VkImageUsageFlags supported_usage = swp_support.capabilities.supportedUsageFlags;
+  brl_free_swp_support(&swp_support);
+
+  // Extra windows and readbacks copy from the main swapchain image.
+  VkImageUsageFlags copy_usage = app->windows_count || app->vk_capture ? VK_IMAGE_USAGE_TRANSFER_SRC_BIT : 0;
+  if ((supported_usage & copy_usage) != copy_usage)
+    return brl_error("The swap chain images cannot be copied from, extra windows and readbacks need it.", VK_ERROR_FEATURE_NOT_PRESENT);
 
   VkSwapchainCreateInfoKHR create_info = {
       .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
       .surface = app->vk_window_surface,
       .minImageCount = image_count,
-      .imageFormat = surface_format.format,
-      .imageColorSpace = surface_format.colorSpace,
+      .imageFormat = app->vk_swp_image_format,
+      .imageColorSpace = app->vk_swp_color_space,
       .imageExtent = extent,
       .imageArrayLayers = 1,
-      .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-      .preTransform = swp_support.capabilities.currentTransform,
+      .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | brl_swp_post_usage(app) | copy_usage,
+      .preTransform = transform,
       .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
       .presentMode = present_mode,
       .clipped = VK_TRUE,
-      .oldSwapchain = VK_NULL_HANDLE,
+      .oldSwapchain = old_swapchain,
   };
 
-  brl_queue_family_indices indices = brl_find_queue_families(app, physical_device);
-  uint32_t indices_arr[] = {indices.graphics_family, indices.present_family};
-
-  if (indices.graphics_family != indices.present_family)
-  {
-    create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-    create_info.queueFamilyIndexCount = 2;
-    create_info.pQueueFamilyIndices = indices_arr;
-  }
-  else
-  {
-    create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    create_info.queueFamilyIndexCount = 0;
-    create_info.pQueueFamilyIndices = NULL;
-  }
+  // Concurrent sharing can disable framebuffer compression, with
+  // separate families the images are transferred explicitly instead
+  // (see brl_release_swp_image and brl_create_present_acquires).
+  create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  create_info.queueFamilyIndexCount = 0;
+  create_info.pQueueFamilyIndices = NULL;
 
-  VkSwapchainKHR swapchain = malloc(sizeof(VkSwapchainKHR));
-  VkResult result = vkCreateSwapchainKHR(app->vk_device, &create_info, NULL, &swapchain);
+  VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+  VkResult result = brl_object_created(BRL_OBJECT_SWAPCHAIN, vkCreateSwapchainKHR(app->vk_device, &create_info, BRL_ALLOCATOR, &swapchain));
   if (result != VK_SUCCESS)
-    brl_exit_error("Couldn't create the swap chain.");
+    return brl_error("Couldn't create the swap chain.", result);
 
-  printf("-> Created VkSwapchainKHR (swapchain)\n");
+  printf("-> Created VkSwapchainKHR (swapchain, present mode %d)\n", present_mode);
 
   vkGetSwapchainImagesKHR(app->vk_device, swapchain, &image_count, NULL);
   VkImage *images = malloc(sizeof(VkImage) * image_count);
   vkGetSwapchainImagesKHR(app->vk_device, swapchain, &image_count, images);
 
-  app->vk_swp_image_format = surface_format.format;
   app->vk_swp_extent = extent;
   app->vk_swp = swapchain;
   app->vk_swp_images = images;
   app->vk_swp_images_count = image_count;
+  app->vk_present_mode = present_mode;
+  return VK_SUCCESS;
 }
 
-void brl_create_image_views(brl_app *app)
+/**
+ * Extra windows and their surfaces live as long as the instance, like
+ * the main ones. GLFW windows are opened from the main thread by
+ * brl_create_app.
+ **/
+void brl_open_windows(brl_app *app)
 {
-  VkImageView *image_views = malloc(sizeof(VkImageView) * app->vk_swp_images_count);
-  for (size_t i = 0; i < app->vk_swp_images_count; i++)
+  for (uint32_t i = 0; i < app->windows_count; i++)
   {
-    VkImageViewCreateInfo create_info = {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-        .image = app->vk_swp_images[i],
-        .viewType = VK_IMAGE_VIEW_TYPE_2D,
-        .format = app->vk_swp_image_format,
-        .components.r = VK_COMPONENT_SWIZZLE_IDENTITY,
-        .components.g = VK_COMPONENT_SWIZZLE_IDENTITY,
-        .components.b = VK_COMPONENT_SWIZZLE_IDENTITY,
-        .components.a = VK_COMPONENT_SWIZZLE_IDENTITY,
-        .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-        .subresourceRange.baseMipLevel = 0,
-        .subresourceRange.levelCount = 1,
-        .subresourceRange.baseArrayLayer = 0,
-        .subresourceRange.layerCount = 1,
-    };
-
-    VkResult result = vkCreateImageView(app->vk_device, &create_info, NULL, &image_views[i]);
-    if (result != VK_SUCCESS)
-      brl_exit_error("Failed to create image views.");
+    brl_window *window = &app->windows[i];
+    window->window = glfwCreateWindow(window->width, window->height, window->title ? window->title : "BOREAL APP", NULL, NULL);
   }
-  app->vk_swp_image_views = image_views;
 }
 
-void brl_free_app(brl_app app)
+void brl_close_windows(brl_app *app)
 {
-  vkDestroySemaphore(app.vk_device, app.sema_image_available, NULL);
-  vkDestroySemaphore(app.vk_device, app.sema_render_finished, NULL);
-  vkDestroyFence(app.vk_device, app.fence_in_flight, NULL);
+  for (uint32_t i = 0; i < app->windows_count; i++)
+  {
+    if (app->windows[i].window)
+      glfwDestroyWindow(app->windows[i].window);
+    app->windows[i].window = NULL;
+  }
+}
 
-  vkDestroyCommandPool(app.vk_device, app.vk_command_pool, NULL);
-  for (size_t i = 0; i < app.vk_swp_images_count; i++)
-    vkDestroyFramebuffer(app.vk_device, app.vk_frame_buffers[i], NULL);
+VkResult brl_create_window_surfaces(brl_app *app)
+{
+  for (uint32_t i = 0; i < app->windows_count; i++)
+  {
+    brl_window *window = &app->windows[i];
+    VkResult result = brl_object_created(BRL_OBJECT_SURFACE, glfwCreateWindowSurface(app->vk_instance, window->window, BRL_ALLOCATOR, &window->vk_surface));
+    if (result != VK_SUCCESS)
+      return brl_error("Failed to create an extra window surface.", result);
+  }
 
-  vkDestroyPipeline(app.vk_device, app.vk_pipeline, NULL);
-  vkDestroyPipelineLayout(app.vk_device, app.vk_pipeline_layout, NULL);
-  vkDestroyRenderPass(app.vk_device, app.vk_render_pass, NULL);
-  for (size_t i = 0; i < app.vk_swp_images_count; i++)
-    vkDestroyImageView(app.vk_device, app.vk_swp_image_views[i], NULL);
+  printf("-> Created VkSurfaceKHR (extra windows, x%d)\n", app->windows_count);
+  return VK_SUCCESS;
+}
 
-  vkDestroySwapchainKHR(app.vk_device, app.vk_swp, NULL);
-  vkDestroySurfaceKHR(app.vk_instance, app.vk_window_surface, NULL);
-  vkDestroyDevice(app.vk_device, NULL);
-  vkDestroyInstance(app.vk_instance, NULL);
+void brl_free_window_surfaces(brl_app *app)
+{
+  for (uint32_t i = 0; i < app->windows_count; i++)
+  {
+    brl_window *window = &app->windows[i];
+    if (window->vk_surface != VK_NULL_HANDLE)
+      BRL_DESTROY(BRL_OBJECT_SURFACE, vkDestroySurfaceKHR, app->vk_instance, window->vk_surface);
+    window->vk_surface = VK_NULL_HANDLE;
+  }
 }
 
-VkShaderModule brl_create_shader_module(brl_app *app, brl_file file)
+/**
+ * Blits convert between formats but not between color encodings, an
+ * extra window has to store colors the way the main swapchain does.
+ **/
+VkSurfaceFormatKHR brl_pick_window_format(brl_app *app, VkSurfaceFormatKHR *formats, uint32_t formats_count)
 {
-  VkShaderModuleCreateInfo create_info = {
-      .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-      .codeSize = file.size,
-      .pCode = (uint32_t *)file.data,
-  };
+  for (uint32_t i = 0; i < formats_count; i++)
+  {
+    if (formats[i].format == app->vk_swp_image_format && formats[i].colorSpace == app->vk_swp_color_space)
+      return formats[i];
+  }
 
-  VkShaderModule module;
-  VkResult result = vkCreateShaderModule(app->vk_device, &create_info, NULL, &module);
-  if (result != VK_SUCCESS)
-    brl_exit_error("Failed to create shader module.");
+  printf("BOREAL_WARNING: Extra window cannot use the main swapchain format, colors may differ.\n");
+  return brl_pick_swp_surface_format(formats, formats_count);
+}
 
-  return module;
+void brl_free_window_swp(brl_app *app, brl_window *window)
+{
+  for (uint32_t i = 0; window->sema_render_finished && i < window->vk_swp_images_count; i++)
+    BRL_DESTROY(BRL_OBJECT_SEMAPHORE, vkDestroySemaphore, app->vk_device, window->sema_render_finished[i]);
+  free(window->sema_render_finished);
+  window->sema_render_finished = NULL;
+  free(window->vk_swp_images);
+  window->vk_swp_images = NULL;
+  window->vk_swp_images_count = 0;
 }
 
-void brl_create_gfx_pipeline(brl_app *app)
+/**
+ * Creates the swapchain of an extra window, replacing the previous one
+ * if any. A window without any area (minimized) keeps no swapchain and
+ * stays out of date until it has one again.
+ **/
+VkResult brl_create_window_swp(brl_app *app, brl_window *window, VkPhysicalDevice physical_device)
 {
-  brl_file vshader_file = brl_read("./src/shaders/vertex.spv");
-  brl_file fshader_file = brl_read("./src/shaders/fragment.spv");
+  brl_swp_sup_details swp_support = brl_query_surface_support(physical_device, window->vk_surface);
+  VkExtent2D extent = brl_pick_swp_extent(window->width, window->height, swp_support.capabilities);
+  if (extent.width == 0 || extent.height == 0)
+  {
+    brl_free_swp_support(&swp_support);
+    window->vk_out_of_date = 1;
+    return VK_SUCCESS;
+  }
 
-  VkShaderModule vshader = brl_create_shader_module(app, vshader_file);
-  VkShaderModule fshader = brl_create_shader_module(app, fshader_file);
+  VkSurfaceFormatKHR surface_format = brl_pick_window_format(app, swp_support.formats, swp_support.formats_count);
+  VkPresentModeKHR present_mode = brl_pick_swp_present_mode(window->present_mode, swp_support.present_modes, swp_support.present_modes_counts);
+  uint32_t image_count = brl_pick_swp_image_count(app, swp_support.capabilities);
+  VkSurfaceTransformFlagBitsKHR transform = swp_support.capabilities.currentTransform;
+  VkImageUsageFlags supported_usage = swp_support.capabilities.supportedUsageFlags;
+  brl_free_swp_support(&swp_support);
 
-  brl_file_close(vshader_file);
-  brl_file_close(fshader_file);
+  VkFormatProperties source, target;
+  vkGetPhysicalDeviceFormatProperties(physical_device, app->vk_swp_image_format, &source);
+  vkGetPhysicalDeviceFormatProperties(physical_device, surface_format.format, &target);
+  if (!(supported_usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT) ||
+      !(source.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT) ||
+      !(target.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT))
+    return brl_error("The main swap chain cannot be blitted to an extra window.", VK_ERROR_FORMAT_NOT_SUPPORTED);
 
-  VkPipelineShaderStageCreateInfo vshader_info = {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-      .stage = VK_SHADER_STAGE_VERTEX_BIT,
-      .module = vshader,
-      .pName = "main",
-  };
+  window->vk_filter = (source.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
 
-  VkPipelineShaderStageCreateInfo fshader_info = {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-      .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-      .module = fshader,
-      .pName = "main",
+  VkSwapchainCreateInfoKHR create_info = {
+      .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+      .surface = window->vk_surface,
+      .minImageCount = image_count,
+      .imageFormat = surface_format.format,
+      .imageColorSpace = surface_format.colorSpace,
+      .imageExtent = extent,
+      .imageArrayLayers = 1,
+      .imageUsage = VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+      .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
+      .preTransform = transform,
+      .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+      .presentMode = present_mode,
+      .clipped = VK_TRUE,
+      .oldSwapchain = window->vk_swp,
   };
 
-  VkPipelineShaderStageCreateInfo shader_stages[] = {vshader_info, fshader_info};
+  VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+  VkResult result = brl_object_created(BRL_OBJECT_SWAPCHAIN, vkCreateSwapchainKHR(app->vk_device, &create_info, BRL_ALLOCATOR, &swapchain));
+  brl_free_window_swp(app, window);
+  if (window->vk_swp != VK_NULL_HANDLE)
+    BRL_DESTROY(BRL_OBJECT_SWAPCHAIN, vkDestroySwapchainKHR, app->vk_device, window->vk_swp);
+  window->vk_swp = swapchain;
+  if (result != VK_SUCCESS)
+    return brl_error("Couldn't create an extra window swap chain.", result);
 
-  VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
-  VkPipelineDynamicStateCreateInfo dynamic_state = {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-      .dynamicStateCount = 2,
-      .pDynamicStates = dynamic_states,
-  };
+  vkGetSwapchainImagesKHR(app->vk_device, swapchain, &image_count, NULL);
+  window->vk_swp_images = malloc(sizeof(VkImage) * image_count);
+  vkGetSwapchainImagesKHR(app->vk_device, swapchain, &image_count, window->vk_swp_images);
+  window->vk_swp_images_count = image_count;
+  window->vk_swp_extent = extent;
+  window->vk_present_mode = present_mode;
+  window->vk_out_of_date = 0;
 
-  VkPipelineVertexInputStateCreateInfo vertex_input_info = {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-      .vertexBindingDescriptionCount = 0,
-      .pVertexBindingDescriptions = NULL,
-      .vertexAttributeDescriptionCount = 0,
-      .pVertexAttributeDescriptions = NULL,
+  VkSemaphoreCreateInfo semaphore_create_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
   };
 
-  VkPipelineInputAssemblyStateCreateInfo input_assembly = {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-      .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-      .primitiveRestartEnable = VK_FALSE,
-  };
+  window->sema_render_finished = calloc(image_count, sizeof(VkSemaphore));
+  for (uint32_t i = 0; i < image_count; i++)
+  {
+    result = brl_object_created(BRL_OBJECT_SEMAPHORE, vkCreateSemaphore(app->vk_device, &semaphore_create_info, BRL_ALLOCATOR, &window->sema_render_finished[i]));
+    if (result != VK_SUCCESS)
+      return brl_error("Failed to create semaphores", result);
+  }
 
-  VkViewport viewport = {
-      .x = 0.0f,
-      .y = 0.0f,
-      .width = app->vk_swp_extent.width,
-      .height = app->vk_swp_extent.height,
-      .minDepth = 0.0f,
-      .maxDepth = 1.0f,
-  };
+  printf("-> Created VkSwapchainKHR (extra window %dx%d, present mode %d)\n", extent.width, extent.height, present_mode);
+  return VK_SUCCESS;
+}
 
-  VkRect2D scissor = {
-      .offset = {0, 0},
-      .extent = app->vk_swp_extent,
+/**
+ * Extra windows are presented from the graphics queue. With separate
+ * graphics and present families the main image would already be
+ * released to the present queue when the blits run, so they need a
+ * family doing both.
+ **/
+VkResult brl_create_window_objects(brl_app *app, VkPhysicalDevice physical_device)
+{
+  if (app->windows_count == 0)
+    return VK_SUCCESS;
+  if (!brl_is_queue_family_shared(app->vk_queue_families))
+    return brl_error("Extra windows need a queue family with graphics and present.", VK_ERROR_FEATURE_NOT_PRESENT);
+
+  VkSemaphoreCreateInfo semaphore_create_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
   };
 
-  VkPipelineViewportStateCreateInfo viewport_state = {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+  for (uint32_t i = 0; i < app->windows_count; i++)
+  {
+    brl_window *window = &app->windows[i];
+    VkBool32 present_support = VK_FALSE;
+    vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, app->vk_queue_families.graphics_family, window->vk_surface, &present_support);
+    if (!present_support)
+      return brl_error("The graphics queue cannot present to an extra window.", VK_ERROR_FEATURE_NOT_PRESENT);
+
+    for (uint32_t j = 0; j < app->vk_frames_in_flight; j++)
+    {
+      VkResult result = brl_object_created(BRL_OBJECT_SEMAPHORE, vkCreateSemaphore(app->vk_device, &semaphore_create_info, BRL_ALLOCATOR, &window->sema_image_available[j]));
+      if (result != VK_SUCCESS)
+        return brl_error("Failed to create semaphores", result);
+    }
+
+    BRL_CHECK(brl_create_window_swp(app, window, physical_device));
+    clock_gettime(CLOCK_MONOTONIC, &window->next_frame_time);
+    window->acquired = 0;
+  }
+
+  return VK_SUCCESS;
+}
+
+void brl_free_window_objects(brl_app *app)
+{
+  for (uint32_t i = 0; i < app->windows_count; i++)
+  {
+    brl_window *window = &app->windows[i];
+    brl_free_window_swp(app, window);
+    if (window->vk_swp != VK_NULL_HANDLE)
+      BRL_DESTROY(BRL_OBJECT_SWAPCHAIN, vkDestroySwapchainKHR, app->vk_device, window->vk_swp);
+    window->vk_swp = VK_NULL_HANDLE;
+
+    for (uint32_t j = 0; j < BRL_MAX_FRAMES_IN_FLIGHT; j++)
+    {
+      BRL_DESTROY(BRL_OBJECT_SEMAPHORE, vkDestroySemaphore, app->vk_device, window->sema_image_available[j]);
+      window->sema_image_available[j] = VK_NULL_HANDLE;
+    }
+  }
+}
+
+VkResult brl_create_image_view(brl_app *app, VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, VkImageView *image_view)
+{
+  VkImageViewCreateInfo create_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      .image = image,
+      .viewType = VK_IMAGE_VIEW_TYPE_2D,
+      .format = format,
+      .components.r = VK_COMPONENT_SWIZZLE_IDENTITY,
+      .components.g = VK_COMPONENT_SWIZZLE_IDENTITY,
+      .components.b = VK_COMPONENT_SWIZZLE_IDENTITY,
+      .components.a = VK_COMPONENT_SWIZZLE_IDENTITY,
+      .subresourceRange.aspectMask = aspect_flags,
+      .subresourceRange.baseMipLevel = 0,
+      .subresourceRange.levelCount = 1,
+      .subresourceRange.baseArrayLayer = 0,
+      .subresourceRange.layerCount = 1,
+  };
+
+  VkResult result = brl_object_created(BRL_OBJECT_IMAGE_VIEW, vkCreateImageView(app->vk_device, &create_info, BRL_ALLOCATOR, image_view));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create image views.", result);
+
+  return VK_SUCCESS;
+}
+
+VkResult brl_create_image_views(brl_app *app)
+{
+  VkImageView *image_views = calloc(app->vk_swp_images_count, sizeof(VkImageView));
+  app->vk_swp_image_views = image_views;
+  for (size_t i = 0; i < app->vk_swp_images_count; i++)
+    BRL_CHECK(brl_create_image_view(app, app->vk_swp_images[i], app->vk_swp_image_format, VK_IMAGE_ASPECT_COLOR_BIT, &image_views[i]));
+
+  return VK_SUCCESS;
+}
+
+/**
+ * Looks for a memory type matching both the resource type filter
+ * and the requested properties. Returns -1 when none is found so the
+ * caller can retry with a less strict set of properties.
+ **/
+int brl_find_memory_type(VkPhysicalDevice physical_device, uint32_t type_filter, VkMemoryPropertyFlags properties)
+{
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+  for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++)
+  {
+    if ((type_filter & (1 << i)) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties)
+      return i;
+  }
+
+  return -1;
+}
+
+/**
+ * Creates a 2D image with its own memory allocation.
+ * Transient attachments are placed in lazily allocated memory when
+ * the device exposes it, on tiled GPUs they then never leave the
+ * tile memory. Otherwise we fall back to plain device local memory.
+ **/
+VkResult brl_create_image_levels(brl_app *app, VkPhysicalDevice physical_device, VkExtent2D extent, uint32_t levels, VkSampleCountFlagBits samples, VkFormat format, VkImageUsageFlags usage, VkImage *image, VkDeviceMemory *memory)
+{
+  VkImageCreateInfo create_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      .imageType = VK_IMAGE_TYPE_2D,
+      .extent.width = extent.width,
+      .extent.height = extent.height,
+      .extent.depth = 1,
+      .mipLevels = levels,
+      .arrayLayers = 1,
+      .format = format,
+      .tiling = VK_IMAGE_TILING_OPTIMAL,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+      .usage = usage,
+      .samples = samples,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+  };
+
+  VkResult result = brl_object_created(BRL_OBJECT_IMAGE, vkCreateImage(app->vk_device, &create_info, BRL_ALLOCATOR, image));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create image.", result);
+
+  VkMemoryRequirements requirements;
+  vkGetImageMemoryRequirements(app->vk_device, *image, &requirements);
+
+  int memory_type = -1;
+  if (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
+    memory_type = brl_find_memory_type(physical_device, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+
+  if (memory_type == -1)
+    memory_type = brl_find_memory_type(physical_device, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  if (memory_type == -1)
+    return brl_error("Failed to find a suitable memory type for image.", VK_ERROR_OUT_OF_DEVICE_MEMORY);
+
+  VkMemoryAllocateInfo alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+      .allocationSize = requirements.size,
+      .memoryTypeIndex = memory_type,
+  };
+
+  result = brl_object_created(BRL_OBJECT_MEMORY, vkAllocateMemory(app->vk_device, &alloc_info, BRL_ALLOCATOR, memory));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to allocate image memory.", result);
+
+  return vkBindImageMemory(app->vk_device, *image, *memory, 0);
+}
+
+VkResult brl_create_image(brl_app *app, VkPhysicalDevice physical_device, VkExtent2D extent, VkSampleCountFlagBits samples, VkFormat format, VkImageUsageFlags usage, VkImage *image, VkDeviceMemory *memory)
+{
+  return brl_create_image_levels(app, physical_device, extent, 1, samples, format, usage, image, memory);
+}
+
+/**
+ * Buffer in host visible, coherent memory. The preferred properties
+ * (DEVICE_LOCAL for data the GPU reads often, HOST_CACHED for
+ * readbacks) are dropped when no memory type has them. On failure the
+ * handles that were created are left for the caller to destroy.
+ **/
+VkResult brl_create_host_buffer(brl_app *app, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags preferred, VkBuffer *buffer, VkDeviceMemory *memory)
+{
+  VkBufferCreateInfo buffer_info = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .size = size,
+      .usage = usage,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+  };
+  VkResult result = brl_object_created(BRL_OBJECT_BUFFER, vkCreateBuffer(app->vk_device, &buffer_info, BRL_ALLOCATOR, buffer));
+  if (result != VK_SUCCESS)
+    return result;
+
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(app->vk_device, *buffer, &requirements);
+
+  VkMemoryPropertyFlags host = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  int memory_type = brl_find_memory_type(app->vk_physical_device, requirements.memoryTypeBits, host | preferred);
+  if (memory_type == -1)
+    memory_type = brl_find_memory_type(app->vk_physical_device, requirements.memoryTypeBits, host);
+  if (memory_type == -1)
+    return VK_ERROR_FEATURE_NOT_PRESENT;
+
+  VkMemoryAllocateInfo alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+      .allocationSize = requirements.size,
+      .memoryTypeIndex = memory_type,
+  };
+  result = brl_object_created(BRL_OBJECT_MEMORY, vkAllocateMemory(app->vk_device, &alloc_info, BRL_ALLOCATOR, memory));
+  if (result != VK_SUCCESS)
+    return result;
+
+  return vkBindBufferMemory(app->vk_device, *buffer, *memory, 0);
+}
+
+/**
+ * Stand-in for the swapchain when rendering offscreen, one image per
+ * frame in flight so frame N always renders to image N and the frame
+ * fence also guards the image. They can be copied from for readbacks.
+ **/
+VkResult brl_create_offscreen_images(brl_app *app, VkPhysicalDevice physical_device)
+{
+  uint32_t image_count = app->vk_frames_in_flight;
+  VkExtent2D extent = {app->width, app->height};
+  app->vk_swp_images = calloc(image_count, sizeof(VkImage));
+  app->vk_offscreen_memory = calloc(image_count, sizeof(VkDeviceMemory));
+  app->vk_swp_images_count = image_count;
+  app->vk_swp_extent = extent;
+  app->vk_present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+
+  VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | brl_swp_post_usage(app);
+  for (uint32_t i = 0; i < image_count; i++)
+    BRL_CHECK(brl_create_image(app, physical_device, extent, VK_SAMPLE_COUNT_1_BIT, app->vk_swp_image_format, usage,
+                               &app->vk_swp_images[i], &app->vk_offscreen_memory[i]));
+
+  printf("-> Created offscreen images (%dx%d, x%d)\n", extent.width, extent.height, image_count);
+  return VK_SUCCESS;
+}
+
+VkFormat brl_find_depth_format(VkPhysicalDevice physical_device)
+{
+  VkFormat candidates[] = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT};
+  for (int i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++)
+  {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, candidates[i], &properties);
+    if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+      return candidates[i];
+  }
+
+  return VK_FORMAT_UNDEFINED;
+}
+
+/**
+ * Resolves the sample count requested in brl_app.msaa_samples
+ * against what the device supports for both color and depth
+ * attachments. The highest supported count that is not above
+ * the requested one is used, 0 or 1 disables multisampling.
+ **/
+VkResult brl_pick_msaa_samples(brl_app *app, VkPhysicalDevice physical_device)
+{
+  // The scene is depth tested with or without multisampling.
+  app->vk_depth_format = brl_find_depth_format(physical_device);
+  if (app->vk_depth_format == VK_FORMAT_UNDEFINED)
+    return brl_error("Failed to find a supported depth format.", VK_ERROR_FORMAT_NOT_SUPPORTED);
+
+  app->vk_msaa_samples = VK_SAMPLE_COUNT_1_BIT;
+  if (app->msaa_samples <= VK_SAMPLE_COUNT_1_BIT)
+    return VK_SUCCESS;
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physical_device, &properties);
+  VkSampleCountFlags counts = properties.limits.framebufferColorSampleCounts & properties.limits.framebufferDepthSampleCounts;
+
+  for (VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_64_BIT; samples > VK_SAMPLE_COUNT_1_BIT; samples >>= 1)
+  {
+    if (samples <= app->msaa_samples && (counts & samples))
+    {
+      app->vk_msaa_samples = samples;
+      break;
+    }
+  }
+
+  printf("SET: vk_msaa_samples (%d samples)\n", app->vk_msaa_samples);
+  return VK_SUCCESS;
+}
+
+/**
+ * The depth attachment, and with multisampling the multisampled color
+ * attachment, only live for the duration of the subpass: color is
+ * resolved into the scene image and depth is discarded, so both are
+ * transient.
+ **/
+VkResult brl_create_scene_targets(brl_app *app, VkPhysicalDevice physical_device)
+{
+  BRL_CHECK(brl_create_image(app, physical_device, app->vk_swp_extent, app->vk_msaa_samples, app->vk_depth_format,
+                             VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                             &app->vk_depth_image, &app->vk_depth_image_memory));
+  BRL_CHECK(brl_create_image_view(app, app->vk_depth_image, app->vk_depth_format, VK_IMAGE_ASPECT_DEPTH_BIT, &app->vk_depth_image_view));
+
+  if (app->vk_msaa_samples == VK_SAMPLE_COUNT_1_BIT)
+  {
+    printf("-> Created depth attachment\n");
+    return VK_SUCCESS;
+  }
+
+  BRL_CHECK(brl_create_image(app, physical_device, app->vk_swp_extent, app->vk_msaa_samples, app->vk_color_format,
+                             VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+                             &app->vk_color_image, &app->vk_color_image_memory));
+  BRL_CHECK(brl_create_image_view(app, app->vk_color_image, app->vk_color_format, VK_IMAGE_ASPECT_COLOR_BIT, &app->vk_color_image_view));
+
+  printf("-> Created MSAA color and depth attachments\n");
+  return VK_SUCCESS;
+}
+
+void brl_free_scene_targets(brl_app *app)
+{
+  BRL_DESTROY(BRL_OBJECT_IMAGE_VIEW, vkDestroyImageView, app->vk_device, app->vk_color_image_view);
+  BRL_DESTROY(BRL_OBJECT_IMAGE, vkDestroyImage, app->vk_device, app->vk_color_image);
+  BRL_DESTROY(BRL_OBJECT_MEMORY, vkFreeMemory, app->vk_device, app->vk_color_image_memory);
+  BRL_DESTROY(BRL_OBJECT_IMAGE_VIEW, vkDestroyImageView, app->vk_device, app->vk_depth_image_view);
+  BRL_DESTROY(BRL_OBJECT_IMAGE, vkDestroyImage, app->vk_device, app->vk_depth_image);
+  BRL_DESTROY(BRL_OBJECT_MEMORY, vkFreeMemory, app->vk_device, app->vk_depth_image_memory);
+  app->vk_color_image_view = VK_NULL_HANDLE;
+  app->vk_color_image = VK_NULL_HANDLE;
+  app->vk_color_image_memory = VK_NULL_HANDLE;
+  app->vk_depth_image_view = VK_NULL_HANDLE;
+  app->vk_depth_image = VK_NULL_HANDLE;
+  app->vk_depth_image_memory = VK_NULL_HANDLE;
+}
+
+#ifdef BRL_PROFILE
+/**
+ * GPU side of the profiler. Every frame brackets a few zones of its
+ * command buffer with timestamps, read back once the frame's fence
+ * has signaled and pushed to a "GPU" ring like any CPU zone.
+ *
+ * With VK_EXT_calibrated_timestamps the ticks are converted through a
+ * GPU/CPU clock pair taken every BRL_PROFILE_CALIBRATION_INTERVAL.
+ * Without it, the start of each frame is pinned to its submit time,
+ * which shifts the zones by the queue latency but keeps durations.
+ **/
+const char *brl_gpu_zone_names[BRL_GPU_ZONE_COUNT] = {
+    "gpu frame",
+    "gpu scene",
+    "gpu sprites",
+    "gpu post",
+};
+
+VkResult brl_create_gpu_profiler(brl_app *app)
+{
+  if (app->profile_gpu_ring == NULL)
+    app->profile_gpu_ring = brl_profile_add_ring("GPU");
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(app->vk_physical_device, &properties);
+  app->vk_profile_period = properties.limits.timestampPeriod;
+  app->profile_cpu_base = 0;
+  memset(app->vk_profile_pending, 0, sizeof(app->vk_profile_pending));
+
+  if (!properties.limits.timestampComputeAndGraphics || app->vk_profile_period == 0.0f)
+  {
+    printf("Timestamps not supported, no GPU zones.\n");
+    return VK_SUCCESS;
+  }
+
+  VkQueryPoolCreateInfo query_pool_info = {
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = BRL_GPU_ZONE_COUNT * 2 * BRL_MAX_FRAMES_IN_FLIGHT,
+  };
+  VkResult result = brl_object_created(BRL_OBJECT_QUERY_POOL, vkCreateQueryPool(app->vk_device, &query_pool_info, BRL_ALLOCATOR, &app->vk_profile_pool));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create profiler query pool.", result);
+
+  return VK_SUCCESS;
+}
+
+void brl_free_gpu_profiler(brl_app *app)
+{
+  BRL_DESTROY(BRL_OBJECT_QUERY_POOL, vkDestroyQueryPool, app->vk_device, app->vk_profile_pool);
+  app->vk_profile_pool = VK_NULL_HANDLE;
+}
+
+void brl_gpu_timestamp(brl_app *app, VkCommandBuffer command_buffer, brl_gpu_zone zone, int end)
+{
+  if (app->vk_profile_pool == VK_NULL_HANDLE)
+    return;
+
+  uint32_t query = (app->current_frame * BRL_GPU_ZONE_COUNT + zone) * 2 + end;
+  vkCmdWriteTimestamp(command_buffer, end ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                      app->vk_profile_pool, query);
+}
+
+void brl_gpu_profile_begin_frame(brl_app *app, VkCommandBuffer command_buffer)
+{
+  if (app->vk_profile_pool == VK_NULL_HANDLE)
+    return;
+
+  vkCmdResetQueryPool(command_buffer, app->vk_profile_pool, app->current_frame * BRL_GPU_ZONE_COUNT * 2, BRL_GPU_ZONE_COUNT * 2);
+  app->vk_profile_pending[app->current_frame] = VK_TRUE;
+  brl_gpu_timestamp(app, command_buffer, BRL_GPU_ZONE_FRAME, 0);
+}
+
+void brl_gpu_calibrate(brl_app *app)
+{
+  uint64_t now = brl_profile_now();
+  if (app->profile_cpu_base != 0 && now - app->profile_cpu_base < BRL_PROFILE_CALIBRATION_INTERVAL)
+    return;
+
+  VkCalibratedTimestampInfoEXT infos[2] = {
+      {.sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT, .timeDomain = VK_TIME_DOMAIN_DEVICE_EXT},
+      {.sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT, .timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT},
+  };
+  uint64_t timestamps[2];
+  uint64_t deviation;
+  if (app->vk_get_calibrated_timestamps(app->vk_device, 2, infos, timestamps, &deviation) != VK_SUCCESS)
+    return;
+
+  app->profile_gpu_base = timestamps[0];
+  app->profile_cpu_base = timestamps[1];
+}
+
+/**
+ * Zones that were not recorded this frame (no post chain, no sprites)
+ * have no available timestamps and are skipped.
+ **/
+void brl_read_gpu_zones(brl_app *app, uint32_t frame)
+{
+  if (!app->vk_profile_pending[frame])
+    return;
+
+  uint64_t results[BRL_GPU_ZONE_COUNT * 2][2];
+  VkResult result = vkGetQueryPoolResults(app->vk_device, app->vk_profile_pool, frame * BRL_GPU_ZONE_COUNT * 2, BRL_GPU_ZONE_COUNT * 2,
+                                          sizeof(results), results, sizeof(results[0]),
+                                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+  app->vk_profile_pending[frame] = VK_FALSE;
+  if (result != VK_SUCCESS && result != VK_NOT_READY)
+    return;
+
+  uint64_t gpu_base = results[0][0];
+  uint64_t cpu_base = app->profile_submit_time[frame];
+  if (app->vk_calibrated_timestamps)
+  {
+    brl_gpu_calibrate(app);
+    gpu_base = app->profile_gpu_base;
+    cpu_base = app->profile_cpu_base;
+  }
+
+  for (uint32_t zone = 0; zone < BRL_GPU_ZONE_COUNT; zone++)
+  {
+    uint64_t *begin = results[zone * 2];
+    uint64_t *end = results[zone * 2 + 1];
+    if (!begin[1] || !end[1])
+      continue;
+
+    int64_t start = (int64_t)((double)(int64_t)(begin[0] - gpu_base) * app->vk_profile_period);
+    int64_t stop = (int64_t)((double)(int64_t)(end[0] - gpu_base) * app->vk_profile_period);
+    brl_profile_record(app->profile_gpu_ring, brl_gpu_zone_names[zone], cpu_base + start, cpu_base + stop);
+  }
+}
+
+#define BRL_GPU_ZONE_BEGIN(app, command_buffer, zone) brl_gpu_timestamp(app, command_buffer, zone, 0)
+#define BRL_GPU_ZONE_END(app, command_buffer, zone) brl_gpu_timestamp(app, command_buffer, zone, 1)
+#else
+#define BRL_GPU_ZONE_BEGIN(app, command_buffer, zone) ((void)0)
+#define BRL_GPU_ZONE_END(app, command_buffer, zone) ((void)0)
+#endif
+
+void brl_free_post_targets(brl_app *app);
+void brl_free_post_pipelines(brl_app *app);
+void brl_free_sprites(brl_app *app);
+void brl_free_textures(brl_app *app);
+void brl_free_compute(brl_app *app);
+void brl_free_readbacks(brl_app *app);
+
+/**
+ * Destroys everything that is sized after the swapchain images, the
+ * device must be idle. Handles that were never created are
+ * VK_NULL_HANDLE, which every vkDestroy* call accepts, so this also
+ * cleans up after a partially failed creation.
+ **/
+void brl_free_swp_targets(brl_app *app)
+{
+  brl_free_post_targets(app);
+
+  if (app->vk_present_command_buffers)
+    vkFreeCommandBuffers(app->vk_device, app->vk_present_command_pool, app->vk_swp_images_count, app->vk_present_command_buffers);
+  free(app->vk_present_command_buffers);
+  app->vk_present_command_buffers = NULL;
+
+  if (app->sema_present_ready)
+  {
+    for (uint32_t i = 0; i < app->vk_swp_images_count; i++)
+      BRL_DESTROY(BRL_OBJECT_SEMAPHORE, vkDestroySemaphore, app->vk_device, app->sema_present_ready[i]);
+  }
+  free(app->sema_present_ready);
+  app->sema_present_ready = NULL;
+
+  if (app->sema_render_finished)
+  {
+    for (uint32_t i = 0; i < app->vk_swp_images_count; i++)
+      BRL_DESTROY(BRL_OBJECT_SEMAPHORE, vkDestroySemaphore, app->vk_device, app->sema_render_finished[i]);
+  }
+  free(app->sema_render_finished);
+  app->sema_render_finished = NULL;
+
+  if (app->vk_frame_buffers)
+  {
+    for (size_t i = 0; i < app->vk_swp_images_count; i++)
+      BRL_DESTROY(BRL_OBJECT_FRAMEBUFFER, vkDestroyFramebuffer, app->vk_device, app->vk_frame_buffers[i]);
+  }
+  free(app->vk_frame_buffers);
+  app->vk_frame_buffers = NULL;
+
+  brl_free_scene_targets(app);
+
+  if (app->vk_swp_image_views)
+  {
+    for (size_t i = 0; i < app->vk_swp_images_count; i++)
+      BRL_DESTROY(BRL_OBJECT_IMAGE_VIEW, vkDestroyImageView, app->vk_device, app->vk_swp_image_views[i]);
+  }
+  free(app->vk_swp_image_views);
+  app->vk_swp_image_views = NULL;
+}
+
+void brl_free_swp(brl_app *app)
+{
+  brl_free_swp_targets(app);
+  for (uint32_t i = 0; app->vk_offscreen_memory && i < app->vk_swp_images_count; i++)
+  {
+    BRL_DESTROY(BRL_OBJECT_IMAGE, vkDestroyImage, app->vk_device, app->vk_swp_images[i]);
+    BRL_DESTROY(BRL_OBJECT_MEMORY, vkFreeMemory, app->vk_device, app->vk_offscreen_memory[i]);
+  }
+  free(app->vk_offscreen_memory);
+  app->vk_offscreen_memory = NULL;
+  free(app->vk_swp_images);
+  app->vk_swp_images = NULL;
+  // Without a surface VK_KHR_swapchain is not enabled at all.
+  if (app->vk_swp != VK_NULL_HANDLE)
+    BRL_DESTROY(BRL_OBJECT_SWAPCHAIN, vkDestroySwapchainKHR, app->vk_device, app->vk_swp);
+  app->vk_swp = VK_NULL_HANDLE;
+}
+
+/**
+ * Destroys every object owned by the logical device, and the device
+ * itself. The instance and the window surface survive, which is what
+ * device lost recovery needs.
+ **/
+void brl_free_device_objects(brl_app *app)
+{
+  // Reads the fences to keep what completed.
+  brl_free_readbacks(app);
+  brl_free_swp(app);
+  brl_free_window_objects(app);
+
+  for (uint32_t i = 0; i < app->vk_frames_in_flight; i++)
+  {
+    BRL_DESTROY(BRL_OBJECT_SEMAPHORE, vkDestroySemaphore, app->vk_device, app->sema_image_available[i]);
+    BRL_DESTROY(BRL_OBJECT_FENCE, vkDestroyFence, app->vk_device, app->fence_in_flight[i]);
+    app->sema_image_available[i] = VK_NULL_HANDLE;
+    app->fence_in_flight[i] = VK_NULL_HANDLE;
+  }
+
+  BRL_DESTROY(BRL_OBJECT_COMMAND_POOL, vkDestroyCommandPool, app->vk_device, app->vk_command_pool);
+  BRL_DESTROY(BRL_OBJECT_COMMAND_POOL, vkDestroyCommandPool, app->vk_device, app->vk_present_command_pool);
+  app->vk_present_command_pool = VK_NULL_HANDLE;
+  brl_free_post_pipelines(app);
+  brl_free_sprites(app);
+  brl_free_textures(app);
+  brl_free_compute(app);
+#ifdef BRL_PROFILE
+  brl_free_gpu_profiler(app);
+#endif
+  BRL_DESTROY(BRL_OBJECT_PIPELINE, vkDestroyPipeline, app->vk_device, app->vk_pipeline);
+  BRL_DESTROY(BRL_OBJECT_PIPELINE_LAYOUT, vkDestroyPipelineLayout, app->vk_device, app->vk_pipeline_layout);
+  BRL_DESTROY(BRL_OBJECT_RENDER_PASS, vkDestroyRenderPass, app->vk_device, app->vk_render_pass);
+  app->vk_command_pool = VK_NULL_HANDLE;
+  app->vk_pipeline = VK_NULL_HANDLE;
+  app->vk_pipeline_layout = VK_NULL_HANDLE;
+  app->vk_render_pass = VK_NULL_HANDLE;
+
+  brl_object_destroyed(BRL_OBJECT_DEVICE, app->vk_device != VK_NULL_HANDLE);
+  vkDestroyDevice(app->vk_device, BRL_ALLOCATOR);
+  app->vk_device = VK_NULL_HANDLE;
+}
+
+/**
+ * Snapshot of the host memory held by the driver, the live objects and
+ * the usage of every device memory heap. Cheap enough to call every
+ * frame, the budget is the driver's estimate of what the process can
+ * use before allocations start failing or paging.
+ **/
+void brl_query_memory(brl_app *app, brl_memory_usage *usage)
+{
+  memset(usage, 0, sizeof(brl_memory_usage));
+  usage->host_bytes = atomic_load(&brl_memory.host_live_bytes);
+  usage->host_peak_bytes = atomic_load(&brl_memory.host_peak_bytes);
+  usage->host_allocations = atomic_load(&brl_memory.host_live_allocations);
+  for (int i = 0; i < BRL_OBJECT_TYPE_COUNT; i++)
+    usage->objects[i] = brl_live_objects(i);
+
+  if (app->vk_physical_device == VK_NULL_HANDLE)
+    return;
+
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+  };
+  VkPhysicalDeviceMemoryProperties2 properties = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+      .pNext = app->vk_memory_budget ? &budget : NULL,
+  };
+  if (app->vk_api_version >= VK_API_VERSION_1_1)
+    vkGetPhysicalDeviceMemoryProperties2(app->vk_physical_device, &properties);
+  else
+    vkGetPhysicalDeviceMemoryProperties(app->vk_physical_device, &properties.memoryProperties);
+
+  usage->budget = app->vk_memory_budget;
+  usage->heaps_count = properties.memoryProperties.memoryHeapCount;
+  for (uint32_t i = 0; i < usage->heaps_count; i++)
+  {
+    usage->heaps[i].size = properties.memoryProperties.memoryHeaps[i].size;
+    usage->heaps[i].flags = properties.memoryProperties.memoryHeaps[i].flags;
+    if (usage->budget)
+    {
+      usage->heaps[i].budget = budget.heapBudget[i];
+      usage->heaps[i].usage = budget.heapUsage[i];
+    }
+  }
+}
+
+/**
+ * Prints brl_query_memory, can be called at any time while the device
+ * exists and runs once more at shutdown.
+ **/
+void brl_memory_report(brl_app *app)
+{
+  brl_memory_usage usage;
+  brl_query_memory(app, &usage);
+
+  brl_print_host_memory();
+  brl_print_objects();
+
+  for (uint32_t i = 0; i < usage.heaps_count; i++)
+  {
+    brl_memory_heap heap = usage.heaps[i];
+    const char *kind = heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT ? "device local" : "host";
+    if (usage.budget)
+      printf("-> Heap %d (%s): %.1f / %.1f MiB used of a %.1f MiB budget%s\n", i, kind,
+             heap.usage / 1048576.0, heap.size / 1048576.0, heap.budget / 1048576.0,
+             heap.usage > heap.budget ? ", OVER BUDGET" : "");
+    else
+      printf("-> Heap %d (%s): %.1f MiB, usage unknown without %s\n", i, kind, heap.size / 1048576.0, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  }
+}
+
+void brl_window_report(brl_app *app)
+{
+  for (uint32_t i = 0; i < app->windows_count; i++)
+    printf("-> Extra window %d: %llu frames presented, %llu skipped\n", i,
+           (unsigned long long)app->windows[i].presented, (unsigned long long)app->windows[i].skipped);
+}
+
+void brl_free_app(brl_app app)
+{
+  brl_free_device_objects(&app);
+  for (uint32_t i = 0; i < app.textures_count; i++)
+  {
+    free(app.textures[i].path);
+    free(app.textures[i].pixels);
+  }
+  if (app.vk_window_surface != VK_NULL_HANDLE)
+    BRL_DESTROY(BRL_OBJECT_SURFACE, vkDestroySurfaceKHR, app.vk_instance, app.vk_window_surface);
+  brl_free_window_surfaces(&app);
+  brl_object_destroyed(BRL_OBJECT_INSTANCE, app.vk_instance != VK_NULL_HANDLE);
+  vkDestroyInstance(app.vk_instance, BRL_ALLOCATOR);
+}
+
+VkResult brl_create_shader_module(brl_app *app, brl_file file, VkShaderModule *module)
+{
+  if (file.data == NULL)
+    return brl_error("Failed to read shader file.", VK_ERROR_INITIALIZATION_FAILED);
+
+  VkShaderModuleCreateInfo create_info = {
+      .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+      .codeSize = file.size,
+      .pCode = (uint32_t *)file.data,
+  };
+
+  VkResult result = brl_object_created(BRL_OBJECT_SHADER_MODULE, vkCreateShaderModule(app->vk_device, &create_info, BRL_ALLOCATOR, module));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create shader module.", result);
+
+  return VK_SUCCESS;
+}
+
+/**
+ * What differs between the graphics pipelines Boreal builds, the rest
+ * of the state is shared: triangle lists, dynamic viewport and scissor
+ * and the attachments of the scene render pass.
+ **/
+typedef struct brl_pipeline_desc
+{
+  VkShaderModule vertex;
+  VkShaderModule fragment;
+  const VkPipelineVertexInputStateCreateInfo *vertex_input;
+  VkCullModeFlags cull_mode;
+  VkBool32 depth_test;
+  VkPipelineColorBlendAttachmentState blend;
+  VkPipelineLayout layout;
+} brl_pipeline_desc;
+
+VkResult brl_build_gfx_pipeline(brl_app *app, const brl_pipeline_desc *desc, VkPipeline *pipeline)
+{
+  VkPipelineShaderStageCreateInfo shader_stages[] = {
+      {
+          .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+          .stage = VK_SHADER_STAGE_VERTEX_BIT,
+          .module = desc->vertex,
+          .pName = "main",
+      },
+      {
+          .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+          .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+          .module = desc->fragment,
+          .pName = "main",
+      },
+  };
+
+  VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+  VkPipelineDynamicStateCreateInfo dynamic_state = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+      .dynamicStateCount = 2,
+      .pDynamicStates = dynamic_states,
+  };
+
+  VkPipelineVertexInputStateCreateInfo empty_vertex_input = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+  };
+
+  VkPipelineInputAssemblyStateCreateInfo input_assembly = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+      .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+      .primitiveRestartEnable = VK_FALSE,
+  };
+
+  // Viewport and scissor are dynamic states, set when recording.
+  VkPipelineViewportStateCreateInfo viewport_state = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
       .viewportCount = 1,
-      .pViewports = &viewport,
+      .pViewports = NULL,
       .scissorCount = 1,
-      .pScissors = &scissor,
+      .pScissors = NULL,
+  };
+
+  VkPipelineRasterizationStateCreateInfo rasterizer = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+      .depthClampEnable = VK_FALSE,
+      .rasterizerDiscardEnable = VK_FALSE,
+      .polygonMode = VK_POLYGON_MODE_FILL,
+      .lineWidth = 1.0f,
+      .cullMode = desc->cull_mode,
+      .frontFace = VK_FRONT_FACE_CLOCKWISE,
+      .depthBiasEnable = VK_FALSE,
+  };
+
+  VkPipelineMultisampleStateCreateInfo multi_sampling = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+      .sampleShadingEnable = VK_FALSE,
+      .rasterizationSamples = app->vk_msaa_samples,
+  };
+
+  VkPipelineDepthStencilStateCreateInfo depth_stencil = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+      .depthTestEnable = desc->depth_test,
+      .depthWriteEnable = desc->depth_test,
+      .depthCompareOp = VK_COMPARE_OP_LESS,
+      .depthBoundsTestEnable = VK_FALSE,
+      .stencilTestEnable = VK_FALSE,
+  };
+
+  VkPipelineColorBlendStateCreateInfo color_blending = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+      .logicOpEnable = VK_FALSE,
+      .attachmentCount = 1,
+      .pAttachments = &desc->blend,
+  };
+
+  VkPipelineRenderingCreateInfoKHR rendering_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR,
+      .colorAttachmentCount = 1,
+      .pColorAttachmentFormats = &app->vk_color_format,
+      .depthAttachmentFormat = app->vk_depth_format,
+      .stencilAttachmentFormat = VK_FORMAT_UNDEFINED,
+  };
+
+  VkGraphicsPipelineCreateInfo create_info = {
+      .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+      .pNext = app->vk_dynamic_rendering ? &rendering_info : NULL,
+      .stageCount = 2,
+      .pStages = shader_stages,
+      .pVertexInputState = desc->vertex_input ? desc->vertex_input : &empty_vertex_input,
+      .pInputAssemblyState = &input_assembly,
+      .pViewportState = &viewport_state,
+      .pRasterizationState = &rasterizer,
+      .pMultisampleState = &multi_sampling,
+      .pDepthStencilState = &depth_stencil,
+      .pColorBlendState = &color_blending,
+      .pDynamicState = &dynamic_state,
+      .layout = desc->layout,
+      .renderPass = app->vk_render_pass,
+      .subpass = 0,
+      .basePipelineHandle = VK_NULL_HANDLE,
+      .basePipelineIndex = -1,
+  };
+
+  return brl_object_created(BRL_OBJECT_PIPELINE, vkCreateGraphicsPipelines(app->vk_device, VK_NULL_HANDLE, 1, &create_info, BRL_ALLOCATOR, pipeline));
+}
+
+/**
+ * Only depends on the device, the surface format, the MSAA settings
+ * and the render pass when dynamic rendering is off, so it can be
+ * compiled while the swapchain is being created.
+ **/
+VkResult brl_create_gfx_pipeline(brl_app *app, brl_file vshader_file, brl_file fshader_file)
+{
+  VkShaderModule vshader = VK_NULL_HANDLE;
+  VkShaderModule fshader = VK_NULL_HANDLE;
+  VkResult shader_result = brl_create_shader_module(app, vshader_file, &vshader);
+  if (shader_result == VK_SUCCESS)
+    shader_result = brl_create_shader_module(app, fshader_file, &fshader);
+
+  if (shader_result != VK_SUCCESS)
+  {
+    BRL_DESTROY(BRL_OBJECT_SHADER_MODULE, vkDestroyShaderModule, app->vk_device, vshader);
+    return shader_result;
+  }
+
+  VkPipelineLayoutCreateInfo pipeline_layout_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+  };
+
+  VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
+  VkResult pipeline_result = brl_object_created(BRL_OBJECT_PIPELINE_LAYOUT, vkCreatePipelineLayout(app->vk_device, &pipeline_layout_info, BRL_ALLOCATOR, &pipeline_layout));
+  if (pipeline_result != VK_SUCCESS)
+  {
+    BRL_DESTROY(BRL_OBJECT_SHADER_MODULE, vkDestroyShaderModule, app->vk_device, vshader);
+    BRL_DESTROY(BRL_OBJECT_SHADER_MODULE, vkDestroyShaderModule, app->vk_device, fshader);
+    return brl_error("Failed to create pipeline layout.", pipeline_result);
+  }
+
+  printf("-> Created pipeline layout\n");
+  app->vk_pipeline_layout = pipeline_layout;
+
+  brl_pipeline_desc desc = {
+      .vertex = vshader,
+      .fragment = fshader,
+      .cull_mode = VK_CULL_MODE_BACK_BIT,
+      .depth_test = VK_TRUE,
+      .blend = {
+          .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+          .blendEnable = VK_FALSE,
+      },
+      .layout = app->vk_pipeline_layout,
+  };
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkResult result = brl_build_gfx_pipeline(app, &desc, &pipeline);
+  BRL_DESTROY(BRL_OBJECT_SHADER_MODULE, vkDestroyShaderModule, app->vk_device, vshader);
+  BRL_DESTROY(BRL_OBJECT_SHADER_MODULE, vkDestroyShaderModule, app->vk_device, fshader);
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create the render pipeline.", result);
+
+  printf("-> Created VkPipeline (Graphics pipeline)\n");
+
+  app->vk_pipeline = pipeline;
+  return VK_SUCCESS;
+}
+
+/**
+ * Without multisampling the subpass renders straight into the
+ * swapchain image. With it, the subpass renders into the transient
+ * multisampled attachments and resolves into the swapchain image
+ * through pResolveAttachments, so no separate resolve pass is needed
+ * and the multisampled data is never written back to memory.
+ **/
+VkResult brl_create_render_pass(brl_app *app)
+{
+  VkBool32 multisampled = app->vk_msaa_samples != VK_SAMPLE_COUNT_1_BIT;
+
+  // With a post chain the scene ends up in the HDR target, in the
+  // GENERAL layout the compute passes read it in.
+  VkImageLayout scene_layout = app->vk_post ? VK_IMAGE_LAYOUT_GENERAL : brl_present_layout(app);
+
+  VkAttachmentDescription color_attachment = {
+      .format = app->vk_color_format,
+      .samples = app->vk_msaa_samples,
+      .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+      .storeOp = multisampled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+      .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+      .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+      .finalLayout = multisampled ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : scene_layout,
+  };
+
+  VkAttachmentDescription depth_attachment = {
+      .format = app->vk_depth_format,
+      .samples = app->vk_msaa_samples,
+      .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+      .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+      .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+      .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+      .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+  };
+
+  VkAttachmentDescription resolve_attachment = {
+      .format = app->vk_color_format,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+      .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+      .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+      .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+      .finalLayout = scene_layout,
+  };
+
+  VkAttachmentReference color_attachment_ref = {
+      .attachment = 0,
+      .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+  };
+
+  VkAttachmentReference depth_attachment_ref = {
+      .attachment = 1,
+      .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+  };
+
+  VkAttachmentReference resolve_attachment_ref = {
+      .attachment = 2,
+      .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+  };
+
+  VkSubpassDescription subpass = {
+      .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+      .colorAttachmentCount = 1,
+      .pColorAttachments = &color_attachment_ref,
+      .pDepthStencilAttachment = &depth_attachment_ref,
+      .pResolveAttachments = multisampled ? &resolve_attachment_ref : NULL,
+  };
+
+  VkSubpassDependency dependency = {
+      .srcSubpass = VK_SUBPASS_EXTERNAL,
+      .dstSubpass = 0,
+      .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                      (app->vk_post ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : 0),
+      .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+      .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+      .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+  };
+
+  VkAttachmentDescription attachments[] = {color_attachment, depth_attachment, resolve_attachment};
+  VkRenderPassCreateInfo create_info = {
+      .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+      .attachmentCount = multisampled ? 3 : 2,
+      .pAttachments = attachments,
+      .subpassCount = 1,
+      .pSubpasses = &subpass,
+      .dependencyCount = 1,
+      .pDependencies = &dependency,
+  };
+
+  VkRenderPass render_pass = VK_NULL_HANDLE;
+  VkResult result = brl_object_created(BRL_OBJECT_RENDER_PASS, vkCreateRenderPass(app->vk_device, &create_info, BRL_ALLOCATOR, &render_pass));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create render pass.", result);
+
+  printf("-> Created VkRenderPass\n");
+  app->vk_render_pass = render_pass;
+  return VK_SUCCESS;
+}
+
+/**
+ * Where the scene is rendered: the swapchain image itself, or the
+ * HDR target when the post chain is on.
+ **/
+VkImage brl_scene_image(brl_app *app, uint32_t image_index)
+{
+  return app->vk_post ? app->vk_post_targets[BRL_POST_TARGET_HDR].image : app->vk_swp_images[image_index];
+}
+
+VkImageView brl_scene_view(brl_app *app, uint32_t image_index)
+{
+  return app->vk_post ? app->vk_post_targets[BRL_POST_TARGET_HDR].view : app->vk_swp_image_views[image_index];
+}
+
+VkResult brl_create_frame_buffer(brl_app *app)
+{
+  VkFramebuffer *frame_buffers = calloc(app->vk_swp_images_count, sizeof(VkFramebuffer));
+  app->vk_frame_buffers = frame_buffers;
+  for (size_t i = 0; i < app->vk_swp_images_count; i++)
+  {
+    VkBool32 multisampled = app->vk_msaa_samples != VK_SAMPLE_COUNT_1_BIT;
+    VkImageView scene_view = brl_scene_view(app, i);
+    VkImageView attachments[] = {scene_view, app->vk_depth_image_view};
+    VkImageView msaa_attachments[] = {app->vk_color_image_view, app->vk_depth_image_view, scene_view};
+    VkFramebufferCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+        .renderPass = app->vk_render_pass,
+        .attachmentCount = multisampled ? 3 : 2,
+        .pAttachments = multisampled ? msaa_attachments : attachments,
+        .width = app->vk_swp_extent.width,
+        .height = app->vk_swp_extent.height,
+        .layers = 1,
+    };
+
+    VkResult result = brl_object_created(BRL_OBJECT_FRAMEBUFFER, vkCreateFramebuffer(app->vk_device, &create_info, BRL_ALLOCATOR, &frame_buffers[i]));
+    if (result != VK_SUCCESS)
+      return brl_error("Couldn't create framebuffers.", result);
+  }
+  printf("-> Created VkFrameBuffer (Frame buffers)\n");
+  return VK_SUCCESS;
+}
+
+VkResult brl_create_command_pool(brl_app *app, VkPhysicalDevice physical_device)
+{
+  VkCommandPoolCreateInfo create_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+      .queueFamilyIndex = brl_submit_family(app),
+  };
+
+  VkCommandPool command_pool = VK_NULL_HANDLE;
+  VkResult result = brl_object_created(BRL_OBJECT_COMMAND_POOL, vkCreateCommandPool(app->vk_device, &create_info, BRL_ALLOCATOR, &command_pool));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create command pool.", result);
+
+  printf("-> Created VkCommandPool\n");
+  app->vk_command_pool = command_pool;
+
+  if (brl_is_queue_family_shared(app->vk_queue_families))
+    return VK_SUCCESS;
+
+  // Holds the pre-recorded ownership acquires run on the present queue.
+  create_info.flags = 0;
+  create_info.queueFamilyIndex = app->vk_queue_families.present_family;
+  result = brl_object_created(BRL_OBJECT_COMMAND_POOL, vkCreateCommandPool(app->vk_device, &create_info, BRL_ALLOCATOR, &app->vk_present_command_pool));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create present command pool.", result);
+
+  printf("-> Created VkCommandPool (present family)\n");
+  return VK_SUCCESS;
+}
+
+/**
+ * More frames in flight let the CPU run further ahead of the GPU,
+ * which helps throughput but adds a frame of latency each.
+ **/
+void brl_pick_frames_in_flight(brl_app *app)
+{
+  uint32_t frames = app->frames_in_flight ? app->frames_in_flight : BRL_DEFAULT_FRAMES_IN_FLIGHT;
+  app->vk_frames_in_flight = frames > BRL_MAX_FRAMES_IN_FLIGHT ? BRL_MAX_FRAMES_IN_FLIGHT : frames;
+  app->current_frame = 0;
+  printf("SET: vk_frames_in_flight (%d frames)\n", app->vk_frames_in_flight);
+}
+
+VkResult brl_create_command_buffer(brl_app *app)
+{
+  VkCommandBufferAllocateInfo alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .commandPool = app->vk_command_pool,
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = app->vk_frames_in_flight,
+  };
+
+  VkResult result = vkAllocateCommandBuffers(app->vk_device, &alloc_info, app->vk_command_buffers);
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to allocate command buffer", result);
+
+  printf("-> Allocated VkCommandBuffer (x%d)\n", app->vk_frames_in_flight);
+  return VK_SUCCESS;
+}
+
+/**
+ * Same as brl_image_barrier, but also moves the image from one queue
+ * family to another. The same barrier has to be recorded on both
+ * queues, the release on the source and the acquire on the
+ * destination.
+ **/
+void brl_image_ownership_barrier(VkCommandBuffer command_buffer, VkImage image, VkImageAspectFlags aspect_flags,
+                                 uint32_t src_family, uint32_t dst_family,
+                                 VkImageLayout old_layout, VkImageLayout new_layout,
+                                 VkPipelineStageFlags src_stage, VkAccessFlags src_access,
+                                 VkPipelineStageFlags dst_stage, VkAccessFlags dst_access)
+{
+  VkImageMemoryBarrier barrier = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .srcAccessMask = src_access,
+      .dstAccessMask = dst_access,
+      .oldLayout = old_layout,
+      .newLayout = new_layout,
+      .srcQueueFamilyIndex = src_family,
+      .dstQueueFamilyIndex = dst_family,
+      .image = image,
+      .subresourceRange.aspectMask = aspect_flags,
+      .subresourceRange.baseMipLevel = 0,
+      .subresourceRange.levelCount = 1,
+      .subresourceRange.baseArrayLayer = 0,
+      .subresourceRange.layerCount = 1,
+  };
+
+  vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+void brl_image_barrier(VkCommandBuffer command_buffer, VkImage image, VkImageAspectFlags aspect_flags,
+                       VkImageLayout old_layout, VkImageLayout new_layout,
+                       VkPipelineStageFlags src_stage, VkAccessFlags src_access,
+                       VkPipelineStageFlags dst_stage, VkAccessFlags dst_access)
+{
+  brl_image_ownership_barrier(command_buffer, image, aspect_flags, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                              old_layout, new_layout, src_stage, src_access, dst_stage, dst_access);
+}
+
+/**
+ * Layout the swapchain image is left in by the last write of the
+ * frame, before it goes to PRESENT_SRC.
+ **/
+VkImageLayout brl_swp_final_layout(brl_app *app)
+{
+  if (app->vk_post)
+    return app->vk_post_storage ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+
+  return app->vk_dynamic_rendering ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : brl_present_layout(app);
+}
+
+/**
+ * Hands the rendered swapchain image to the present family. Only
+ * needed when presenting from another family, the matching acquire
+ * is recorded once per image by brl_create_present_acquires.
+ **/
+void brl_release_swp_image(brl_app *app, VkCommandBuffer command_buffer, uint32_t image_index)
+{
+  VkPipelineStageFlags stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  VkAccessFlags access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  if (app->vk_post)
+  {
+    stage = app->vk_post_storage ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+    access = app->vk_post_storage ? VK_ACCESS_SHADER_WRITE_BIT : VK_ACCESS_TRANSFER_WRITE_BIT;
+  }
+
+  brl_image_ownership_barrier(command_buffer, app->vk_swp_images[image_index], VK_IMAGE_ASPECT_COLOR_BIT,
+                              app->vk_queue_families.graphics_family, app->vk_queue_families.present_family,
+                              brl_swp_final_layout(app), VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                              stage, access, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+}
+
+/**
+ * Post processing
+ *
+ * With brl_app.post_effects set, the scene is rendered into an HDR
+ * target and brl_app.post_effects run on it as compute passes, in
+ * order, ping-ponging between two scratch targets. The last pass
+ * writes the swapchain image directly when it allows storage usage,
+ * otherwise its output is blitted into it.
+ *
+ * Every pass is bracketed by timestamps, brl_app.post_timings holds
+ * the GPU time in milliseconds of the scene, of each step and of the
+ * final copy, as last measured.
+ **/
+const char *brl_post_shader_paths[BRL_POST_EFFECT_COUNT] = {
+    "./src/shaders/tonemap.spv",
+    "./src/shaders/fxaa.spv",
+    "./src/shaders/bloom.spv",
+};
+
+typedef struct brl_post_params
+{
+  float params[4];
+  int32_t info[4];
+} brl_post_params;
+
+/**
+ * Layouts shared by the pipelines and the descriptor sets of the
+ * chain. Created on the main thread before the pipeline worker
+ * starts, brl_create_post_targets allocates from them meanwhile.
+ **/
+VkResult brl_create_post_layouts(brl_app *app)
+{
+  if (!app->vk_post)
+    return VK_SUCCESS;
+
+  VkDescriptorSetLayoutBinding bindings[3];
+  for (uint32_t i = 0; i < 3; i++)
+  {
+    bindings[i] = (VkDescriptorSetLayoutBinding){
+        .binding = i,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    };
+  }
+
+  VkDescriptorSetLayoutCreateInfo set_layout_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+      .bindingCount = 3,
+      .pBindings = bindings,
+  };
+  VkResult result = brl_object_created(BRL_OBJECT_DESCRIPTOR_SET_LAYOUT, vkCreateDescriptorSetLayout(app->vk_device, &set_layout_info, BRL_ALLOCATOR, &app->vk_post_set_layout));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create post descriptor set layout.", result);
+
+  VkPushConstantRange push_constant_range = {
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      .offset = 0,
+      .size = sizeof(brl_post_params),
+  };
+  VkPipelineLayoutCreateInfo layout_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      .setLayoutCount = 1,
+      .pSetLayouts = &app->vk_post_set_layout,
+      .pushConstantRangeCount = 1,
+      .pPushConstantRanges = &push_constant_range,
+  };
+  result = brl_object_created(BRL_OBJECT_PIPELINE_LAYOUT, vkCreatePipelineLayout(app->vk_device, &layout_info, BRL_ALLOCATOR, &app->vk_post_layout));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create post pipeline layout.", result);
+
+  return VK_SUCCESS;
+}
+
+/**
+ * Device level part of the chain: one compute pipeline per effect in
+ * use and the timestamp query pool. It only needs the layouts, so it
+ * is built on the pipeline worker at startup.
+ **/
+VkResult brl_create_post_pipelines(brl_app *app)
+{
+  if (!app->vk_post)
+    return VK_SUCCESS;
+
+  VkResult result = VK_SUCCESS;
+  for (uint32_t i = 0; i < app->post_effects_count && i < BRL_MAX_POST_EFFECTS; i++)
+  {
+    brl_post_effect effect = app->post_effects[i];
+    if (app->vk_post_pipelines[effect] != VK_NULL_HANDLE)
+      continue;
+
+    brl_file file = brl_read((char *)brl_post_shader_paths[effect]);
+    VkShaderModule module = VK_NULL_HANDLE;
+    result = brl_create_shader_module(app, file, &module);
+    brl_file_close(file);
+    if (result != VK_SUCCESS)
+      return result;
+
+    VkComputePipelineCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        .stage = {
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+            .module = module,
+            .pName = "main",
+        },
+        .layout = app->vk_post_layout,
+    };
+    result = brl_object_created(BRL_OBJECT_PIPELINE, vkCreateComputePipelines(app->vk_device, VK_NULL_HANDLE, 1, &create_info, BRL_ALLOCATOR, &app->vk_post_pipelines[effect]));
+    BRL_DESTROY(BRL_OBJECT_SHADER_MODULE, vkDestroyShaderModule, app->vk_device, module);
+    if (result != VK_SUCCESS)
+      return brl_error("Failed to create post pipeline.", result);
+  }
+
+  printf("-> Created VkPipeline (Post chain, %d effects)\n", app->post_effects_count);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(app->vk_physical_device, &properties);
+
+  uint32_t queue_family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(app->vk_physical_device, &queue_family_count, NULL);
+  VkQueueFamilyProperties *queue_families = malloc(sizeof(VkQueueFamilyProperties) * queue_family_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(app->vk_physical_device, &queue_family_count, queue_families);
+  uint32_t timestamp_bits = queue_families[app->vk_queue_families.graphics_family].timestampValidBits;
+  free(queue_families);
+
+  memset(app->vk_timestamps_pending, 0, sizeof(app->vk_timestamps_pending));
+  if (timestamp_bits == 0 || properties.limits.timestampPeriod == 0.0f)
+  {
+    printf("Timestamps not supported on the graphics queue, no post timings.\n");
+    return VK_SUCCESS;
+  }
+
+  VkQueryPoolCreateInfo query_pool_info = {
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = BRL_POST_QUERIES * BRL_MAX_FRAMES_IN_FLIGHT,
+  };
+  result = brl_object_created(BRL_OBJECT_QUERY_POOL, vkCreateQueryPool(app->vk_device, &query_pool_info, BRL_ALLOCATOR, &app->vk_timestamp_pool));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create timestamp query pool.", result);
+
+  app->vk_timestamp_period = properties.limits.timestampPeriod;
+  return VK_SUCCESS;
+}
+
+void brl_free_post_pipelines(brl_app *app)
+{
+  for (uint32_t i = 0; i < BRL_POST_EFFECT_COUNT; i++)
+  {
+    BRL_DESTROY(BRL_OBJECT_PIPELINE, vkDestroyPipeline, app->vk_device, app->vk_post_pipelines[i]);
+    app->vk_post_pipelines[i] = VK_NULL_HANDLE;
+  }
+
+  BRL_DESTROY(BRL_OBJECT_PIPELINE_LAYOUT, vkDestroyPipelineLayout, app->vk_device, app->vk_post_layout);
+  BRL_DESTROY(BRL_OBJECT_DESCRIPTOR_SET_LAYOUT, vkDestroyDescriptorSetLayout, app->vk_device, app->vk_post_set_layout);
+  BRL_DESTROY(BRL_OBJECT_QUERY_POOL, vkDestroyQueryPool, app->vk_device, app->vk_timestamp_pool);
+  app->vk_post_layout = VK_NULL_HANDLE;
+  app->vk_post_set_layout = VK_NULL_HANDLE;
+  app->vk_timestamp_pool = VK_NULL_HANDLE;
+}
+
+const char *brl_post_effect_name(brl_post_effect effect, int mode)
+{
+  switch (effect)
+  {
+  case BRL_POST_TONEMAP:
+    return "tonemap";
+  case BRL_POST_FXAA:
+    return "fxaa";
+  default:
+    return mode == 0 ? "bloom extract" : "bloom composite";
+  }
+}
+
+/**
+ * Turns brl_app.post_effects into dispatches. Full resolution passes
+ * alternate between the two scratch targets, bloom first writes its
+ * own half resolution target then composites into the next one.
+ **/
+void brl_build_post_steps(brl_app *app)
+{
+  VkExtent2D extent = app->vk_swp_extent;
+  VkExtent2D half_extent = {
+      .width = extent.width > 1 ? (extent.width + 1) / 2 : 1,
+      .height = extent.height > 1 ? (extent.height + 1) / 2 : 1,
+  };
+
+  int current = BRL_POST_TARGET_HDR;
+  int next = BRL_POST_TARGET_PING;
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < app->post_effects_count && i < BRL_MAX_POST_EFFECTS; i++)
+  {
+    brl_post_effect effect = app->post_effects[i];
+    if (effect == BRL_POST_BLOOM)
+    {
+      app->vk_post_steps[count++] = (brl_post_step){
+          .name = brl_post_effect_name(effect, 0),
+          .effect = effect,
+          .mode = 0,
+          .input = current,
+          .output = BRL_POST_TARGET_BLOOM,
+          .extent = half_extent,
+      };
+    }
+
+    app->vk_post_steps[count++] = (brl_post_step){
+        .name = brl_post_effect_name(effect, 1),
+        .effect = effect,
+        .mode = 1,
+        .input = current,
+        .output = next,
+        .extent = extent,
+    };
+    current = next;
+    next = next == BRL_POST_TARGET_PING ? BRL_POST_TARGET_PONG : BRL_POST_TARGET_PING;
+  }
+
+  if (app->vk_post_storage)
+    app->vk_post_steps[count - 1].output = -1;
+
+  app->vk_post_steps_count = count;
+  app->vk_post_result = current;
+}
+
+VkImageView brl_post_view(brl_app *app, int target, uint32_t image_index)
+{
+  return target == -1 ? app->vk_swp_image_views[image_index] : app->vk_post_targets[target].view;
+}
+
+/**
+ * Swapchain sized part of the chain: the HDR and scratch targets, and
+ * one descriptor set per step and swapchain image. The sets never
+ * change afterwards, recording only picks the right one.
+ **/
+VkResult brl_create_post_targets(brl_app *app, VkPhysicalDevice physical_device)
+{
+  if (!app->vk_post)
+    return VK_SUCCESS;
+
+  brl_build_post_steps(app);
+
+  VkExtent2D half_extent = app->vk_swp_extent;
+  for (uint32_t i = 0; i < app->vk_post_steps_count; i++)
+  {
+    if (app->vk_post_steps[i].output == BRL_POST_TARGET_BLOOM)
+      half_extent = app->vk_post_steps[i].extent;
+  }
+
+  VkImageUsageFlags usages[BRL_POST_TARGET_COUNT] = {
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+      VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+      VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+      VK_IMAGE_USAGE_STORAGE_BIT,
+  };
+  for (uint32_t i = 0; i < BRL_POST_TARGET_COUNT; i++)
+  {
+    brl_post_target *target = &app->vk_post_targets[i];
+    VkExtent2D extent = i == BRL_POST_TARGET_BLOOM ? half_extent : app->vk_swp_extent;
+    BRL_CHECK(brl_create_image(app, physical_device, extent, VK_SAMPLE_COUNT_1_BIT, BRL_HDR_FORMAT, usages[i],
+                               &target->image, &target->memory));
+    BRL_CHECK(brl_create_image_view(app, target->image, BRL_HDR_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, &target->view));
+  }
+
+  uint32_t sets_count = app->vk_post_steps_count * app->vk_swp_images_count;
+  VkDescriptorPoolSize pool_size = {
+      .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+      .descriptorCount = sets_count * 3,
+  };
+  VkDescriptorPoolCreateInfo pool_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+      .maxSets = sets_count,
+      .poolSizeCount = 1,
+      .pPoolSizes = &pool_size,
+  };
+  VkResult result = brl_object_created(BRL_OBJECT_DESCRIPTOR_POOL, vkCreateDescriptorPool(app->vk_device, &pool_info, BRL_ALLOCATOR, &app->vk_post_descriptor_pool));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create post descriptor pool.", result);
+
+  VkDescriptorSetLayout *layouts = malloc(sizeof(VkDescriptorSetLayout) * sets_count);
+  for (uint32_t i = 0; i < sets_count; i++)
+    layouts[i] = app->vk_post_set_layout;
+
+  app->vk_post_sets = calloc(sets_count, sizeof(VkDescriptorSet));
+  VkDescriptorSetAllocateInfo alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+      .descriptorPool = app->vk_post_descriptor_pool,
+      .descriptorSetCount = sets_count,
+      .pSetLayouts = layouts,
+  };
+  result = vkAllocateDescriptorSets(app->vk_device, &alloc_info, app->vk_post_sets);
+  free(layouts);
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to allocate post descriptor sets.", result);
+
+  for (uint32_t image_index = 0; image_index < app->vk_swp_images_count; image_index++)
+  {
+    for (uint32_t i = 0; i < app->vk_post_steps_count; i++)
+    {
+      brl_post_step step = app->vk_post_steps[i];
+      VkDescriptorImageInfo images[3] = {
+          {.imageView = brl_post_view(app, step.input, image_index), .imageLayout = VK_IMAGE_LAYOUT_GENERAL},
+          {.imageView = brl_post_view(app, step.output, image_index), .imageLayout = VK_IMAGE_LAYOUT_GENERAL},
+          {.imageView = app->vk_post_targets[BRL_POST_TARGET_BLOOM].view, .imageLayout = VK_IMAGE_LAYOUT_GENERAL},
+      };
+
+      VkWriteDescriptorSet write = {
+          .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+          .dstSet = app->vk_post_sets[image_index * app->vk_post_steps_count + i],
+          .dstBinding = 0,
+          .descriptorCount = 3,
+          .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+          .pImageInfo = images,
+      };
+      vkUpdateDescriptorSets(app->vk_device, 1, &write, 0, NULL);
+    }
+  }
+
+  printf("-> Created post targets (%d steps)\n", app->vk_post_steps_count);
+  return VK_SUCCESS;
+}
+
+void brl_free_post_targets(brl_app *app)
+{
+  BRL_DESTROY(BRL_OBJECT_DESCRIPTOR_POOL, vkDestroyDescriptorPool, app->vk_device, app->vk_post_descriptor_pool);
+  app->vk_post_descriptor_pool = VK_NULL_HANDLE;
+  free(app->vk_post_sets);
+  app->vk_post_sets = NULL;
+
+  for (uint32_t i = 0; i < BRL_POST_TARGET_COUNT; i++)
+  {
+    brl_post_target *target = &app->vk_post_targets[i];
+    BRL_DESTROY(BRL_OBJECT_IMAGE_VIEW, vkDestroyImageView, app->vk_device, target->view);
+    BRL_DESTROY(BRL_OBJECT_IMAGE, vkDestroyImage, app->vk_device, target->image);
+    BRL_DESTROY(BRL_OBJECT_MEMORY, vkFreeMemory, app->vk_device, target->memory);
+    *target = (brl_post_target){0};
+  }
+}
+
+void brl_post_timestamp(brl_app *app, VkCommandBuffer command_buffer, VkPipelineStageFlagBits stage, uint32_t query)
+{
+  if (app->vk_timestamp_pool != VK_NULL_HANDLE)
+    vkCmdWriteTimestamp(command_buffer, stage, app->vk_timestamp_pool, app->current_frame * BRL_POST_QUERIES + query);
+}
+
+/**
+ * Resets this frame's queries, this has to happen outside of any
+ * render pass, so before the scene.
+ **/
+void brl_post_begin_frame(brl_app *app, VkCommandBuffer command_buffer)
+{
+  if (!app->vk_post || app->vk_timestamp_pool == VK_NULL_HANDLE)
+    return;
+
+  vkCmdResetQueryPool(command_buffer, app->vk_timestamp_pool, app->current_frame * BRL_POST_QUERIES, BRL_POST_QUERIES);
+  brl_post_timestamp(app, command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0);
+  app->vk_timestamps_pending[app->current_frame] = VK_TRUE;
+}
+
+void brl_compute_barrier(VkCommandBuffer command_buffer, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access)
+{
+  VkMemoryBarrier barrier = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+      .dstAccessMask = dst_access,
+  };
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dst_stage, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+/**
+ * Records the chain after the scene, the HDR target is expected in
+ * the GENERAL layout with the color writes made visible to compute.
+ **/
+void brl_record_post_chain(brl_app *app, VkCommandBuffer command_buffer, uint32_t image_index)
+{
+  brl_post_timestamp(app, command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 1);
+
+  // Scratch targets are shared by the frames in flight, their content
+  // is discarded but the previous frame must be done with them.
+  for (uint32_t i = BRL_POST_TARGET_PING; i < BRL_POST_TARGET_COUNT; i++)
+    brl_image_barrier(command_buffer, app->vk_post_targets[i].image, VK_IMAGE_ASPECT_COLOR_BIT,
+                      VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+                      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+  // Chained to the acquire semaphore, which waits at the color
+  // attachment output stage.
+  brl_image_barrier(command_buffer, app->vk_swp_images[image_index], VK_IMAGE_ASPECT_COLOR_BIT,
+                    VK_IMAGE_LAYOUT_UNDEFINED, brl_swp_final_layout(app),
+                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+                    app->vk_post_storage ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    app->vk_post_storage ? VK_ACCESS_SHADER_WRITE_BIT : VK_ACCESS_TRANSFER_WRITE_BIT);
+
+  brl_post_params params = {
+      .params = {
+          app->exposure > 0.0f ? app->exposure : 1.0f,
+          app->bloom_threshold > 0.0f ? app->bloom_threshold : 1.0f,
+          app->bloom_intensity > 0.0f ? app->bloom_intensity : 0.5f,
+          0.0f,
+      },
+  };
+
+  for (uint32_t i = 0; i < app->vk_post_steps_count; i++)
+  {
+    brl_post_step step = app->vk_post_steps[i];
+    params.info[0] = step.mode;
+    params.info[1] = step.output == -1;
+    params.info[2] = step.extent.width;
+    params.info[3] = step.extent.height;
+
+    VkDescriptorSet set = app->vk_post_sets[image_index * app->vk_post_steps_count + i];
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, app->vk_post_pipelines[step.effect]);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, app->vk_post_layout, 0, 1, &set, 0, NULL);
+    vkCmdPushConstants(command_buffer, app->vk_post_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+    vkCmdDispatch(command_buffer,
+                  (step.extent.width + BRL_POST_GROUP_SIZE - 1) / BRL_POST_GROUP_SIZE,
+                  (step.extent.height + BRL_POST_GROUP_SIZE - 1) / BRL_POST_GROUP_SIZE, 1);
+    brl_post_timestamp(app, command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 2 + i);
+
+    if (i + 1 < app->vk_post_steps_count)
+      brl_compute_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+  }
+
+  if (!app->vk_post_storage)
+  {
+    brl_compute_barrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+    VkImageBlit region = {
+        .srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+        .srcOffsets = {{0, 0, 0}, {app->vk_swp_extent.width, app->vk_swp_extent.height, 1}},
+        .dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+        .dstOffsets = {{0, 0, 0}, {app->vk_swp_extent.width, app->vk_swp_extent.height, 1}},
+    };
+    vkCmdBlitImage(command_buffer, app->vk_post_targets[app->vk_post_result].image, VK_IMAGE_LAYOUT_GENERAL,
+                   app->vk_swp_images[image_index], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, VK_FILTER_NEAREST);
+  }
+  brl_post_timestamp(app, command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 2 + app->vk_post_steps_count);
+
+  if (!brl_is_queue_family_shared(app->vk_queue_families))
+  {
+    brl_release_swp_image(app, command_buffer, image_index);
+    return;
+  }
+
+  brl_image_barrier(command_buffer, app->vk_swp_images[image_index], VK_IMAGE_ASPECT_COLOR_BIT,
+                    brl_swp_final_layout(app), brl_present_layout(app),
+                    app->vk_post_storage ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    app->vk_post_storage ? VK_ACCESS_SHADER_WRITE_BIT : VK_ACCESS_TRANSFER_WRITE_BIT,
+                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+}
+
+/**
+ * Called once the frame's fence is signaled, so the queries written
+ * the last time this frame slot was used are available.
+ **/
+void brl_read_post_timings(brl_app *app, uint32_t frame)
+{
+  if (!app->vk_timestamps_pending[frame])
+    return;
+
+  uint64_t timestamps[BRL_POST_QUERIES];
+  uint32_t count = app->vk_post_steps_count + 3;
+  VkResult result = vkGetQueryPoolResults(app->vk_device, app->vk_timestamp_pool, frame * BRL_POST_QUERIES, count,
+                                          sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+  app->vk_timestamps_pending[frame] = VK_FALSE;
+  if (result != VK_SUCCESS)
+    return;
+
+  for (uint32_t i = 0; i + 1 < count; i++)
+    app->post_timings[i] = (timestamps[i + 1] - timestamps[i]) * app->vk_timestamp_period / 1e6;
+}
+
+void brl_print_post_timings(brl_app *app)
+{
+  printf("POST: scene %.3f ms", app->post_timings[0]);
+  for (uint32_t i = 0; i < app->vk_post_steps_count; i++)
+    printf(", %s %.3f ms", app->vk_post_steps[i].name, app->post_timings[1 + i]);
+  printf(", %s %.3f ms\n", app->vk_post_storage ? "output" : "blit", app->post_timings[1 + app->vk_post_steps_count]);
+}
+
+/**
+ * Textures. Pixels go through a host visible staging buffer into an
+ * optimal tiled image, uncompressed textures get their mip chain from
+ * a series of vkCmdBlitImage on the GPU. KTX2 files are uploaded as
+ * they are stored, so BC and ASTC data never gets decoded on the CPU
+ * and is only accepted when the device samples the format natively.
+ *
+ * Textures are identified by their index in brl_app.textures, index 0
+ * is a white texel used by untextured sprites.
+ **/
+VkResult brl_create_texture_objects(brl_app *app)
+{
+  VkDescriptorSetLayoutBinding binding = {
+      .binding = 0,
+      .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+      .descriptorCount = 1,
+      .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+  };
+  VkDescriptorSetLayoutCreateInfo set_layout_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+      .bindingCount = 1,
+      .pBindings = &binding,
+  };
+  VkResult result = brl_object_created(BRL_OBJECT_DESCRIPTOR_SET_LAYOUT, vkCreateDescriptorSetLayout(app->vk_device, &set_layout_info, BRL_ALLOCATOR, &app->vk_texture_set_layout));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create texture descriptor set layout.", result);
+
+  VkDescriptorPoolSize pool_size = {
+      .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+      .descriptorCount = BRL_MAX_TEXTURES,
+  };
+  VkDescriptorPoolCreateInfo pool_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+      .maxSets = BRL_MAX_TEXTURES,
+      .poolSizeCount = 1,
+      .pPoolSizes = &pool_size,
+  };
+  result = brl_object_created(BRL_OBJECT_DESCRIPTOR_POOL, vkCreateDescriptorPool(app->vk_device, &pool_info, BRL_ALLOCATOR, &app->vk_texture_pool));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create texture descriptor pool.", result);
+
+  VkSamplerCreateInfo sampler_info = {
+      .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+      .magFilter = VK_FILTER_LINEAR,
+      .minFilter = VK_FILTER_LINEAR,
+      .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+      .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+      .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+      .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+      .minLod = 0.0f,
+      .maxLod = VK_LOD_CLAMP_NONE,
+  };
+  result = brl_object_created(BRL_OBJECT_SAMPLER, vkCreateSampler(app->vk_device, &sampler_info, BRL_ALLOCATOR, &app->vk_sampler));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create texture sampler.", result);
+
+  printf("-> Created texture descriptors (BC %s, ASTC %s)\n",
+         app->vk_texture_bc ? "yes" : "no", app->vk_texture_astc ? "yes" : "no");
+  return VK_SUCCESS;
+}
+
+/**
+ * Only releases the GPU side, the sources stay so brl_restore_textures
+ * can upload everything again on a new device.
+ **/
+void brl_free_textures(brl_app *app)
+{
+  for (uint32_t i = 0; i < app->textures_count; i++)
+  {
+    brl_texture *texture = &app->textures[i];
+    BRL_DESTROY(BRL_OBJECT_IMAGE_VIEW, vkDestroyImageView, app->vk_device, texture->view);
+    BRL_DESTROY(BRL_OBJECT_IMAGE, vkDestroyImage, app->vk_device, texture->image);
+    BRL_DESTROY(BRL_OBJECT_MEMORY, vkFreeMemory, app->vk_device, texture->memory);
+    texture->view = VK_NULL_HANDLE;
+    texture->image = VK_NULL_HANDLE;
+    texture->memory = VK_NULL_HANDLE;
+    texture->set = VK_NULL_HANDLE;
+  }
+
+  BRL_DESTROY(BRL_OBJECT_SAMPLER, vkDestroySampler, app->vk_device, app->vk_sampler);
+  BRL_DESTROY(BRL_OBJECT_DESCRIPTOR_POOL, vkDestroyDescriptorPool, app->vk_device, app->vk_texture_pool);
+  BRL_DESTROY(BRL_OBJECT_DESCRIPTOR_SET_LAYOUT, vkDestroyDescriptorSetLayout, app->vk_device, app->vk_texture_set_layout);
+  app->vk_sampler = VK_NULL_HANDLE;
+  app->vk_texture_pool = VK_NULL_HANDLE;
+  app->vk_texture_set_layout = VK_NULL_HANDLE;
+}
+
+/**
+ * Whether textures of this format can be loaded, compressed formats
+ * also need their device feature. Applications shipping several
+ * encodings of the same texture use it to pick the file to load.
+ **/
+VkBool32 brl_texture_format_supported(brl_app *app, VkFormat format)
+{
+  if (brl_format_is_bc(format) && !app->vk_texture_bc)
+    return VK_FALSE;
+  if (brl_format_is_astc(format) && !app->vk_texture_astc)
+    return VK_FALSE;
+
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(app->vk_physical_device, format, &properties);
+  return (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+}
+
+uint32_t brl_mip_levels(uint32_t width, uint32_t height)
+{
+  uint32_t levels = 1;
+  for (uint32_t size = width > height ? width : height; size > 1; size >>= 1)
+    levels++;
+  return levels;
+}
+
+void brl_texture_barrier(VkCommandBuffer command_buffer, VkImage image, uint32_t base_level, uint32_t level_count,
+                         VkImageLayout old_layout, VkImageLayout new_layout,
+                         VkPipelineStageFlags src_stage, VkAccessFlags src_access,
+                         VkPipelineStageFlags dst_stage, VkAccessFlags dst_access)
+{
+  VkImageMemoryBarrier barrier = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .srcAccessMask = src_access,
+      .dstAccessMask = dst_access,
+      .oldLayout = old_layout,
+      .newLayout = new_layout,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = image,
+      .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .subresourceRange.baseMipLevel = base_level,
+      .subresourceRange.levelCount = level_count,
+      .subresourceRange.baseArrayLayer = 0,
+      .subresourceRange.layerCount = 1,
+  };
+
+  vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+/**
+ * Records one level after the other: level i - 1 becomes a transfer
+ * source, is blitted down into level i, then is done and goes to its
+ * sampled layout. The last level is left for the caller.
+ **/
+void brl_record_mip_chain(VkCommandBuffer command_buffer, brl_texture *texture)
+{
+  int32_t width = texture->width;
+  int32_t height = texture->height;
+  for (uint32_t i = 1; i < texture->levels; i++)
+  {
+    brl_texture_barrier(command_buffer, texture->image, i - 1, 1,
+                        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+    int32_t next_width = width > 1 ? width / 2 : 1;
+    int32_t next_height = height > 1 ? height / 2 : 1;
+    VkImageBlit blit = {
+        .srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 0, 1},
+        .srcOffsets = {{0, 0, 0}, {width, height, 1}},
+        .dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1},
+        .dstOffsets = {{0, 0, 0}, {next_width, next_height, 1}},
+    };
+    vkCmdBlitImage(command_buffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+    brl_texture_barrier(command_buffer, texture->image, i - 1, 1,
+                        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+    width = next_width;
+    height = next_height;
+  }
+}
+
+/**
+ * Uploads the given levels and, when generate_mips is set, builds the
+ * rest of the chain from level 0. The transfer runs on the graphics
+ * queue and is waited on with its own fence, so frames in flight are
+ * not stalled by a vkQueueWaitIdle.
+ **/
+VkResult brl_upload_texture_levels(brl_app *app, brl_texture *texture, const brl_ktx2_level *levels, uint32_t level_count, int generate_mips)
+{
+  BRL_ZONE("texture upload");
+  if (!brl_texture_format_supported(app, texture->format))
+    return brl_error("Texture format not supported by the device.", VK_ERROR_FORMAT_NOT_SUPPORTED);
+
+  texture->levels = level_count;
+  if (generate_mips)
+  {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(app->vk_physical_device, texture->format, &properties);
+    VkFormatFeatureFlags blit = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    if ((properties.optimalTilingFeatures & blit) == blit && !brl_format_is_compressed(texture->format))
+      texture->levels = brl_mip_levels(texture->width, texture->height);
+    else
+      printf("BOREAL_WARNING: Format %d cannot be blitted, texture uploaded without mips.\n", texture->format);
+  }
+
+  VkDeviceSize staging_size = 0;
+  for (uint32_t i = 0; i < level_count; i++)
+    staging_size += levels[i].size;
+
+  VkBuffer staging = VK_NULL_HANDLE;
+  VkDeviceMemory staging_memory = VK_NULL_HANDLE;
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+  VkFence fence = VK_NULL_HANDLE;
+
+  VkResult result = brl_create_host_buffer(app, staging_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 0, &staging, &staging_memory);
+  if (result != VK_SUCCESS)
+  {
+    brl_error("Failed to create staging buffer.", result);
+    goto done;
+  }
+
+  char *mapped;
+  result = vkMapMemory(app->vk_device, staging_memory, 0, VK_WHOLE_SIZE, 0, (void **)&mapped);
+  if (result != VK_SUCCESS)
+  {
+    brl_error("Failed to map staging memory.", result);
+    goto done;
+  }
+
+  VkBufferImageCopy regions[BRL_KTX2_MAX_LEVELS];
+  VkDeviceSize offset = 0;
+  for (uint32_t i = 0; i < level_count; i++)
+  {
+    memcpy(mapped + offset, levels[i].data, levels[i].size);
+    regions[i] = (VkBufferImageCopy){
+        .bufferOffset = offset,
+        .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1},
+        .imageExtent = {
+            texture->width >> i ? texture->width >> i : 1,
+            texture->height >> i ? texture->height >> i : 1,
+            1,
+        },
+    };
+    offset += levels[i].size;
+  }
+  vkUnmapMemory(app->vk_device, staging_memory);
+
+  VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  if (texture->levels > level_count)
+    usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  VkExtent2D extent = {texture->width, texture->height};
+  result = brl_create_image_levels(app, app->vk_physical_device, extent, texture->levels, VK_SAMPLE_COUNT_1_BIT,
+                                   texture->format, usage, &texture->image, &texture->memory);
+  if (result != VK_SUCCESS)
+    goto done;
+
+  VkCommandBufferAllocateInfo command_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .commandPool = app->vk_command_pool,
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = 1,
+  };
+  result = vkAllocateCommandBuffers(app->vk_device, &command_info, &command_buffer);
+  if (result != VK_SUCCESS)
+  {
+    brl_error("Failed to allocate upload command buffer.", result);
+    goto done;
+  }
+
+  VkCommandBufferBeginInfo begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+  };
+  vkBeginCommandBuffer(command_buffer, &begin_info);
+
+  brl_texture_barrier(command_buffer, texture->image, 0, texture->levels,
+                      VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+  vkCmdCopyBufferToImage(command_buffer, staging, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, level_count, regions);
+
+  // Stored levels are final as they are, the generated ones are
+  // written by the blits and the last of them ends up alone.
+  uint32_t base = 0;
+  if (texture->levels > level_count)
+  {
+    brl_record_mip_chain(command_buffer, texture);
+    base = texture->levels - 1;
+  }
+  brl_texture_barrier(command_buffer, texture->image, base, texture->levels - base,
+                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+  result = vkEndCommandBuffer(command_buffer);
+  if (result != VK_SUCCESS)
+  {
+    brl_error("Failed to record texture upload.", result);
+    goto done;
+  }
+
+  VkFenceCreateInfo fence_info = {
+      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+  };
+  result = brl_object_created(BRL_OBJECT_FENCE, vkCreateFence(app->vk_device, &fence_info, BRL_ALLOCATOR, &fence));
+  if (result != VK_SUCCESS)
+    goto done;
+
+  VkSubmitInfo submit_info = {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .commandBufferCount = 1,
+      .pCommandBuffers = &command_buffer,
+  };
+  result = vkQueueSubmit(app->vk_queue, 1, &submit_info, fence);
+  if (result == VK_SUCCESS)
+    result = vkWaitForFences(app->vk_device, 1, &fence, VK_TRUE, UINT64_MAX);
+  if (result != VK_SUCCESS)
+  {
+    brl_error("Failed to upload texture.", result);
+    goto done;
+  }
+
+  VkImageViewCreateInfo view_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      .image = texture->image,
+      .viewType = VK_IMAGE_VIEW_TYPE_2D,
+      .format = texture->format,
+      .subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, texture->levels, 0, 1},
+  };
+  result = brl_object_created(BRL_OBJECT_IMAGE_VIEW, vkCreateImageView(app->vk_device, &view_info, BRL_ALLOCATOR, &texture->view));
+  if (result != VK_SUCCESS)
+  {
+    brl_error("Failed to create texture view.", result);
+    goto done;
+  }
+
+  VkDescriptorSetAllocateInfo set_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+      .descriptorPool = app->vk_texture_pool,
+      .descriptorSetCount = 1,
+      .pSetLayouts = &app->vk_texture_set_layout,
+  };
+  result = vkAllocateDescriptorSets(app->vk_device, &set_info, &texture->set);
+  if (result != VK_SUCCESS)
+  {
+    brl_error("Failed to allocate texture descriptor set.", result);
+    goto done;
+  }
+
+  VkDescriptorImageInfo image_info = {
+      .sampler = app->vk_sampler,
+      .imageView = texture->view,
+      .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+  };
+  VkWriteDescriptorSet write = {
+      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .dstSet = texture->set,
+      .dstBinding = 0,
+      .descriptorCount = 1,
+      .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+      .pImageInfo = &image_info,
+  };
+  vkUpdateDescriptorSets(app->vk_device, 1, &write, 0, NULL);
+
+done:
+  if (result != VK_SUCCESS)
+  {
+    BRL_DESTROY(BRL_OBJECT_IMAGE_VIEW, vkDestroyImageView, app->vk_device, texture->view);
+    BRL_DESTROY(BRL_OBJECT_IMAGE, vkDestroyImage, app->vk_device, texture->image);
+    BRL_DESTROY(BRL_OBJECT_MEMORY, vkFreeMemory, app->vk_device, texture->memory);
+    texture->view = VK_NULL_HANDLE;
+    texture->image = VK_NULL_HANDLE;
+    texture->memory = VK_NULL_HANDLE;
+  }
+
+  BRL_DESTROY(BRL_OBJECT_FENCE, vkDestroyFence, app->vk_device, fence);
+  if (command_buffer)
+    vkFreeCommandBuffers(app->vk_device, app->vk_command_pool, 1, &command_buffer);
+  BRL_DESTROY(BRL_OBJECT_BUFFER, vkDestroyBuffer, app->vk_device, staging);
+  BRL_DESTROY(BRL_OBJECT_MEMORY, vkFreeMemory, app->vk_device, staging_memory);
+  return result;
+}
+
+/**
+ * Uploads a texture from its source, either the kept RGBA8 pixels or
+ * the KTX2 file at its path.
+ **/
+VkResult brl_upload_texture(brl_app *app, brl_texture *texture)
+{
+  if (texture->pixels)
+  {
+    brl_ktx2_level level = {texture->pixels, (uint64_t)texture->width * texture->height * 4};
+    return brl_upload_texture_levels(app, texture, &level, 1, 1);
+  }
+
+  brl_file file = brl_read(texture->path);
+  if (file.data == NULL)
+    return brl_error("Failed to read texture file.", VK_ERROR_INITIALIZATION_FAILED);
+
+  brl_ktx2 ktx;
+  const char *problem = brl_ktx2_parse((const uint8_t *)file.data, file.size, &ktx);
+  if (problem)
+  {
+    printf("BOREAL_ERROR: %s: %s.\n", texture->path, problem);
+    brl_file_close(file);
+    return VK_ERROR_FORMAT_NOT_SUPPORTED;
+  }
+
+  texture->format = ktx.format;
+  texture->width = ktx.width;
+  texture->height = ktx.height;
+  VkResult result = brl_upload_texture_levels(app, texture, ktx.levels, ktx.level_count, ktx.generate_mips);
+  brl_file_close(file);
+  return result;
+}
+
+VkResult brl_add_texture(brl_app *app, brl_texture source, uint32_t *id)
+{
+  if (app->textures_count == BRL_MAX_TEXTURES)
+    return brl_error("Too many textures.", VK_ERROR_TOO_MANY_OBJECTS);
+
+  brl_texture *texture = &app->textures[app->textures_count];
+  *texture = source;
+  VkResult result = brl_upload_texture(app, texture);
+  if (result != VK_SUCCESS)
+  {
+    // The source was handed over, it is not kept on failure.
+    free(texture->path);
+    free(texture->pixels);
+    memset(texture, 0, sizeof(brl_texture));
+    return result;
+  }
+
+  printf("-> Created texture %d (%dx%d, %d levels)\n", app->textures_count, texture->width, texture->height, texture->levels);
+  *id = app->textures_count++;
+  return VK_SUCCESS;
+}
+
+/**
+ * Texture from tightly packed sRGB RGBA8 pixels, the mip chain is
+ * generated on the GPU. The pixels are copied and can be freed.
+ **/
+VkResult brl_create_texture(brl_app *app, uint32_t width, uint32_t height, const void *pixels, uint32_t *texture)
+{
+  size_t size = (size_t)width * height * 4;
+  brl_texture source = {
+      .format = VK_FORMAT_R8G8B8A8_SRGB,
+      .width = width,
+      .height = height,
+      .pixels = malloc(size),
+  };
+  memcpy(source.pixels, pixels, size);
+  return brl_add_texture(app, source, texture);
+}
+
+/**
+ * Texture from a KTX2 file, stored mips are used as they are and a
+ * file without mips gets them generated when its format allows it.
+ **/
+VkResult brl_load_texture(brl_app *app, const char *path, uint32_t *texture)
+{
+  brl_texture source = {
+      .path = strdup(path),
+  };
+  return brl_add_texture(app, source, texture);
+}
+
+/**
+ * Creates the white texture on a fresh app, or uploads every texture
+ * again after the device was rebuilt. A texture that cannot be loaded
+ * on the new device falls back to the white one instead of failing.
+ **/
+VkResult brl_restore_textures(brl_app *app)
+{
+  if (app->textures_count == 0)
+  {
+    uint32_t white_pixel = 0xffffffff, white;
+    return brl_create_texture(app, 1, 1, &white_pixel, &white);
+  }
+
+  for (uint32_t i = 0; i < app->textures_count; i++)
+  {
+    brl_texture *texture = &app->textures[i];
+    VkResult result = brl_upload_texture(app, texture);
+    if (result != VK_SUCCESS && i == 0)
+      return result;
+    if (result != VK_SUCCESS)
+    {
+      printf("BOREAL_WARNING: Texture %d not restored, drawing it white.\n", i);
+      texture->set = app->textures[0].set;
+    }
+  }
+
+  return VK_SUCCESS;
+}
+
+/**
+ * 2D batcher. brl_draw_quad and brl_draw_tri write their vertices
+ * straight into a persistently mapped buffer owned by the frame in
+ * flight, nothing is copied afterwards. When the frame is recorded
+ * the batch is sorted by layer, blend mode and texture, and every run
+ * sharing a key is a single vkCmdDrawIndexed.
+ *
+ * Layers are drawn in increasing order. Inside a layer primitives are
+ * grouped by blend mode then texture, so overlapping sprites of the
+ * same layer only keep their submission order when they share both.
+ **/
+typedef struct brl_sprite_params
+{
+  float scale[2];
+} brl_sprite_params;
+
+VkResult brl_create_sprite_pipelines(brl_app *app)
+{
+  VkPushConstantRange push_constant_range = {
+      .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+      .offset = 0,
+      .size = sizeof(brl_sprite_params),
+  };
+  VkPipelineLayoutCreateInfo layout_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      .setLayoutCount = 1,
+      .pSetLayouts = &app->vk_texture_set_layout,
+      .pushConstantRangeCount = 1,
+      .pPushConstantRanges = &push_constant_range,
+  };
+  VkResult result = brl_object_created(BRL_OBJECT_PIPELINE_LAYOUT, vkCreatePipelineLayout(app->vk_device, &layout_info, BRL_ALLOCATOR, &app->vk_sprite_layout));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create sprite pipeline layout.", result);
+
+  brl_file vertex_file = brl_read(BRL_SPRITE_VERTEX_SHADER_PATH);
+  brl_file fragment_file = brl_read(BRL_SPRITE_FRAGMENT_SHADER_PATH);
+  VkShaderModule vertex = VK_NULL_HANDLE;
+  VkShaderModule fragment = VK_NULL_HANDLE;
+  result = brl_create_shader_module(app, vertex_file, &vertex);
+  if (result == VK_SUCCESS)
+    result = brl_create_shader_module(app, fragment_file, &fragment);
+  brl_file_close(vertex_file);
+  brl_file_close(fragment_file);
+  if (result != VK_SUCCESS)
+  {
+    BRL_DESTROY(BRL_OBJECT_SHADER_MODULE, vkDestroyShaderModule, app->vk_device, vertex);
+    return result;
+  }
+
+  VkVertexInputBindingDescription binding = {
+      .binding = 0,
+      .stride = sizeof(brl_vertex),
+      .inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+  };
+  VkVertexInputAttributeDescription attributes[] = {
+      {.location = 0, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(brl_vertex, x)},
+      {.location = 1, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(brl_vertex, u)},
+      {.location = 2, .binding = 0, .format = VK_FORMAT_R8G8B8A8_UNORM, .offset = offsetof(brl_vertex, color)},
+  };
+  VkPipelineVertexInputStateCreateInfo vertex_input = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+      .vertexBindingDescriptionCount = 1,
+      .pVertexBindingDescriptions = &binding,
+      .vertexAttributeDescriptionCount = 3,
+      .pVertexAttributeDescriptions = attributes,
+  };
+
+  brl_pipeline_desc desc = {
+      .vertex = vertex,
+      .fragment = fragment,
+      .vertex_input = &vertex_input,
+      .cull_mode = VK_CULL_MODE_NONE,
+      .depth_test = VK_FALSE,
+      .blend = {
+          .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+          .blendEnable = VK_TRUE,
+          .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+          .dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+          .colorBlendOp = VK_BLEND_OP_ADD,
+          .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+          .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+          .alphaBlendOp = VK_BLEND_OP_ADD,
+      },
+      .layout = app->vk_sprite_layout,
+  };
+
+  for (uint32_t i = 0; i < BRL_BLEND_COUNT && result == VK_SUCCESS; i++)
+  {
+    if (i == BRL_BLEND_ADDITIVE)
+      desc.blend.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    result = brl_build_gfx_pipeline(app, &desc, &app->vk_sprite_pipelines[i]);
+  }
+
+  BRL_DESTROY(BRL_OBJECT_SHADER_MODULE, vkDestroyShaderModule, app->vk_device, vertex);
+  BRL_DESTROY(BRL_OBJECT_SHADER_MODULE, vkDestroyShaderModule, app->vk_device, fragment);
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create sprite pipeline.", result);
+
+  printf("-> Created VkPipeline (Sprites, %d blend modes)\n", BRL_BLEND_COUNT);
+  return VK_SUCCESS;
+}
+
+/**
+ * One host visible buffer holding, for each frame in flight, room for
+ * brl_app.max_quads quads followed by their indices. It stays mapped
+ * for the lifetime of the device, device local memory is preferred so
+ * the GPU reads the vertices without a copy on resizable BAR and
+ * unified memory systems.
+ **/
+VkResult brl_create_sprite_buffers(brl_app *app, VkPhysicalDevice physical_device)
+{
+  app->vk_max_quads = app->max_quads ? app->max_quads : BRL_BATCH_DEFAULT_QUADS;
+  VkDeviceSize vertex_size = (VkDeviceSize)app->vk_max_quads * 4 * sizeof(brl_vertex);
+  VkDeviceSize index_size = (VkDeviceSize)app->vk_max_quads * 6 * sizeof(uint32_t);
+  app->vk_batch_frame_size = vertex_size + index_size;
+
+  VkDeviceSize size = app->vk_batch_frame_size * app->vk_frames_in_flight;
+  VkResult result = brl_create_host_buffer(app, size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &app->vk_batch_buffer, &app->vk_batch_memory);
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create sprite buffer.", result);
+
+  result = vkMapMemory(app->vk_device, app->vk_batch_memory, 0, VK_WHOLE_SIZE, 0, (void **)&app->vk_batch_mapped);
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to map sprite buffer memory.", result);
+
+  brl_batch_init(&app->batch, app->vk_max_quads);
+  app->vk_batch_runs = malloc(sizeof(brl_batch_run) * app->vk_max_quads);
+  app->batch_open = 0;
+
+  printf("-> Created sprite buffers (%d quads per frame, %.1f MiB)\n", app->vk_max_quads,
+         size / (1024.0 * 1024.0));
+  return VK_SUCCESS;
+}
+
+void brl_free_sprites(brl_app *app)
+{
+  for (uint32_t i = 0; i < BRL_BLEND_COUNT; i++)
+  {
+    BRL_DESTROY(BRL_OBJECT_PIPELINE, vkDestroyPipeline, app->vk_device, app->vk_sprite_pipelines[i]);
+    app->vk_sprite_pipelines[i] = VK_NULL_HANDLE;
+  }
+  BRL_DESTROY(BRL_OBJECT_PIPELINE_LAYOUT, vkDestroyPipelineLayout, app->vk_device, app->vk_sprite_layout);
+  app->vk_sprite_layout = VK_NULL_HANDLE;
+
+  if (app->vk_batch_mapped)
+    vkUnmapMemory(app->vk_device, app->vk_batch_memory);
+  BRL_DESTROY(BRL_OBJECT_BUFFER, vkDestroyBuffer, app->vk_device, app->vk_batch_buffer);
+  BRL_DESTROY(BRL_OBJECT_MEMORY, vkFreeMemory, app->vk_device, app->vk_batch_memory);
+  app->vk_batch_mapped = NULL;
+  app->vk_batch_buffer = VK_NULL_HANDLE;
+  app->vk_batch_memory = VK_NULL_HANDLE;
+
+  brl_batch_free(&app->batch);
+  free(app->vk_batch_runs);
+  app->vk_batch_runs = NULL;
+  app->batch_open = 0;
+}
+
+/**
+ * Batch of the frame about to be recorded. The first call of a frame
+ * waits for the frame in flight that last used the same part of the
+ * buffer, brl_draw_frame waits on the same fence right after so this
+ * adds no stall.
+ **/
+brl_batch *brl_sprite_batch(brl_app *app)
+{
+  if (!app->batch_open)
+  {
+    uint32_t frame = app->current_frame;
+    vkWaitForFences(app->vk_device, 1, &app->fence_in_flight[frame], VK_TRUE, UINT64_MAX);
+    brl_batch_begin(&app->batch, (brl_vertex *)(app->vk_batch_mapped + frame * app->vk_batch_frame_size), app->vk_max_quads * 4);
+    app->batch_open = 1;
+  }
+
+  return &app->batch;
+}
+
+/**
+ * Rectangle in pixels, the origin is the top left corner of the
+ * window. It goes through the transform set with brl_draw_transform.
+ **/
+void brl_draw_quad(brl_app *app, float x, float y, float w, float h, uint32_t color)
+{
+  brl_batch_quad(brl_sprite_batch(app), x, y, w, h, color);
+}
+
+void brl_draw_tri(brl_app *app, float x0, float y0, float x1, float y1, float x2, float y2, uint32_t color)
+{
+  brl_batch_tri(brl_sprite_batch(app), x0, y0, x1, y1, x2, y2, color);
+}
+
+/**
+ * Affine transform {a, c, tx, b, d, ty} applied to the following
+ * primitives of the frame, it is reset to identity every frame.
+ **/
+void brl_draw_transform(brl_app *app, const float transform[6])
+{
+  memcpy(brl_sprite_batch(app)->transform, transform, sizeof(float) * 6);
+}
+
+void brl_draw_layer(brl_app *app, uint32_t layer)
+{
+  brl_sprite_batch(app)->layer = layer < (1 << BRL_BATCH_LAYER_BITS) ? layer : (1 << BRL_BATCH_LAYER_BITS) - 1;
+}
+
+void brl_draw_blend(brl_app *app, brl_blend_mode blend)
+{
+  brl_sprite_batch(app)->pipeline = blend < BRL_BLEND_COUNT ? blend : BRL_BLEND_ALPHA;
+}
+
+/**
+ * Texture sampled by the following primitives, 0 is plain white and
+ * unknown textures fall back to it.
+ **/
+void brl_draw_texture(brl_app *app, uint32_t texture)
+{
+  brl_sprite_batch(app)->texture = texture < app->textures_count ? texture : 0;
+}
+
+/**
+ * Sorts the batch of the current frame, writes its indices behind
+ * the vertices and records one indexed draw per run. Must be called
+ * inside the scene rendering, after the scene pipeline.
+ **/
+void brl_record_sprites(brl_app *app, VkCommandBuffer command_buffer)
+{
+  BRL_ZONE("sprites");
+  brl_batch *batch = &app->batch;
+  if (!app->batch_open || batch->primitive_count == 0)
+    return;
+
+  if (batch->dropped && !app->batch_dropped)
+    printf("BOREAL_WARNING: Sprite batch full, %d primitives dropped, raise brl_app.max_quads.\n", batch->dropped);
+  app->batch_dropped += batch->dropped;
+
+  VkDeviceSize offset = app->current_frame * app->vk_batch_frame_size;
+  VkDeviceSize index_offset = offset + (VkDeviceSize)app->vk_max_quads * 4 * sizeof(brl_vertex);
+
+  brl_batch_sort(batch);
+  uint32_t run_count = brl_batch_build(batch, (uint32_t *)(app->vk_batch_mapped + index_offset), app->vk_batch_runs, app->vk_max_quads);
+
+  vkCmdBindVertexBuffers(command_buffer, 0, 1, &app->vk_batch_buffer, &offset);
+  vkCmdBindIndexBuffer(command_buffer, app->vk_batch_buffer, index_offset, VK_INDEX_TYPE_UINT32);
+
+  brl_sprite_params params = {
+      .scale = {2.0f / app->vk_swp_extent.width, 2.0f / app->vk_swp_extent.height},
+  };
+  vkCmdPushConstants(command_buffer, app->vk_sprite_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(params), &params);
+
+  uint32_t bound = UINT32_MAX;
+  uint32_t bound_texture = UINT32_MAX;
+  for (uint32_t i = 0; i < run_count; i++)
+  {
+    brl_batch_run run = app->vk_batch_runs[i];
+    uint32_t pipeline = brl_batch_key_pipeline(run.key);
+    if (pipeline != bound)
+    {
+      vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, app->vk_sprite_pipelines[pipeline]);
+      bound = pipeline;
+    }
+
+    uint32_t texture = brl_batch_key_texture(run.key);
+    if (texture != bound_texture)
+    {
+      vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, app->vk_sprite_layout, 0, 1,
+                              &app->textures[texture].set, 0, NULL);
+      bound_texture = texture;
+    }
+    vkCmdDrawIndexed(command_buffer, run.index_count, 1, run.first_index, 0, 0);
+  }
+}
+
+/**
+ * Dynamic rendering counterpart of vkCmdBeginRenderPass: the layout
+ * transitions the render pass used to do are explicit barriers here,
+ * and the attachments are the image views themselves, so nothing has
+ * to be rebuilt besides the views when the swapchain changes.
+ **/
+void brl_begin_rendering(brl_app *app, VkCommandBuffer command_buffer, uint32_t image_index)
+{
+  VkBool32 multisampled = app->vk_msaa_samples != VK_SAMPLE_COUNT_1_BIT;
+
+  // The HDR target is shared by all frames in flight, the previous
+  // frame's post chain must be done reading it.
+  brl_image_barrier(command_buffer, brl_scene_image(app, image_index), VK_IMAGE_ASPECT_COLOR_BIT,
+                    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | (app->vk_post ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : 0), 0,
+                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+
+  // The depth and multisampled targets are shared by all frames in
+  // flight, so the previous frame's writes must be finished first.
+  if (multisampled)
+  {
+    brl_image_barrier(command_buffer, app->vk_color_image, VK_IMAGE_ASPECT_COLOR_BIT,
+                      VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+  }
+  brl_image_barrier(command_buffer, app->vk_depth_image, VK_IMAGE_ASPECT_DEPTH_BIT,
+                    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                    VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+
+  VkRenderingAttachmentInfoKHR color_attachment = {
+      .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+      .imageView = brl_scene_view(app, image_index),
+      .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+      .resolveMode = VK_RESOLVE_MODE_NONE,
+      .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+      .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+      .clearValue.color = {{0.0f, 0.0f, 0.0f, 1.0f}},
+  };
+
+  VkRenderingAttachmentInfoKHR depth_attachment = {
+      .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO_KHR,
+      .imageView = app->vk_depth_image_view,
+      .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+      .resolveMode = VK_RESOLVE_MODE_NONE,
+      .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+      .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+      .clearValue.depthStencil = {1.0f, 0},
+  };
+
+  if (multisampled)
+  {
+    color_attachment.imageView = app->vk_color_image_view;
+    color_attachment.resolveMode = VK_RESOLVE_MODE_AVERAGE_BIT;
+    color_attachment.resolveImageView = brl_scene_view(app, image_index);
+    color_attachment.resolveImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  }
+
+  VkRenderingInfoKHR rendering_info = {
+      .sType = VK_STRUCTURE_TYPE_RENDERING_INFO_KHR,
+      .renderArea.offset = {0, 0},
+      .renderArea.extent = app->vk_swp_extent,
+      .layerCount = 1,
+      .colorAttachmentCount = 1,
+      .pColorAttachments = &color_attachment,
+      .pDepthAttachment = &depth_attachment,
+  };
+
+  app->vk_cmd_begin_rendering(command_buffer, &rendering_info);
+}
+
+void brl_end_rendering(brl_app *app, VkCommandBuffer command_buffer, uint32_t image_index)
+{
+  app->vk_cmd_end_rendering(command_buffer);
+
+  if (app->vk_post)
+  {
+    brl_image_barrier(command_buffer, brl_scene_image(app, image_index), VK_IMAGE_ASPECT_COLOR_BIT,
+                      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL,
+                      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    return;
+  }
+
+  // With separate families the layout transition doubles as the
+  // ownership release.
+  if (!brl_is_queue_family_shared(app->vk_queue_families))
+  {
+    brl_release_swp_image(app, command_buffer, image_index);
+    return;
+  }
+
+  brl_image_barrier(command_buffer, app->vk_swp_images[image_index], VK_IMAGE_ASPECT_COLOR_BIT,
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, brl_present_layout(app),
+                    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+}
+
+void brl_begin_render_pass(brl_app *app, VkCommandBuffer command_buffer, uint32_t image_index)
+{
+  VkRenderPassBeginInfo render_pass_info = {
+      .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+      .renderPass = app->vk_render_pass,
+      .framebuffer = app->vk_frame_buffers[image_index],
+      .renderArea.offset = {0, 0},
+      .renderArea.extent = app->vk_swp_extent,
+  };
+
+  VkClearValue clear_values[2] = {
+      {.color = {{0.0f, 0.0f, 0.0f, 1.0f}}},
+      {.depthStencil = {1.0f, 0}},
+  };
+  render_pass_info.clearValueCount = 2;
+  render_pass_info.pClearValues = clear_values;
+
+  vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+}
+
+/**
+ * Region of the main image shown by an extra window, kept inside the
+ * image when the main swapchain is smaller than what was asked for.
+ **/
+VkRect2D brl_window_source(brl_app *app, brl_window *window)
+{
+  VkExtent2D extent = app->vk_swp_extent;
+  VkRect2D source = window->source;
+  if (source.extent.width == 0 || source.extent.height == 0)
+    return (VkRect2D){.offset = {0, 0}, .extent = extent};
+
+  source.offset.x = brl_clamp(source.offset.x, 0, extent.width - 1);
+  source.offset.y = brl_clamp(source.offset.y, 0, extent.height - 1);
+  source.extent.width = brl_clamp(source.extent.width, 1, extent.width - source.offset.x);
+  source.extent.height = brl_clamp(source.extent.height, 1, extent.height - source.offset.y);
+  return source;
+}
+
+/**
+ * Copies the finished main image into every extra window acquired for
+ * this frame. Every image ends in the present layout, the windows'
+ * images are entirely overwritten so their previous content is
+ * discarded.
+ **/
+void brl_record_window_blits(brl_app *app, VkCommandBuffer command_buffer, uint32_t image_index)
+{
+  int acquired = 0;
+  for (uint32_t i = 0; i < app->windows_count; i++)
+    acquired |= app->windows[i].acquired;
+  if (!acquired)
+    return;
+
+  VkImage image = app->vk_swp_images[image_index];
+  brl_image_barrier(command_buffer, image, VK_IMAGE_ASPECT_COLOR_BIT,
+                    VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                    VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_WRITE_BIT,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+  for (uint32_t i = 0; i < app->windows_count; i++)
+  {
+    brl_window *window = &app->windows[i];
+    if (!window->acquired)
+      continue;
+
+    VkImage target = window->vk_swp_images[window->image_index];
+    brl_image_barrier(command_buffer, target, VK_IMAGE_ASPECT_COLOR_BIT,
+                      VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+
+    VkRect2D source = brl_window_source(app, window);
+    VkImageBlit blit = {
+        .srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+        .srcOffsets = {{source.offset.x, source.offset.y, 0},
+                       {source.offset.x + source.extent.width, source.offset.y + source.extent.height, 1}},
+        .dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+        .dstOffsets = {{0, 0, 0}, {window->vk_swp_extent.width, window->vk_swp_extent.height, 1}},
+    };
+    vkCmdBlitImage(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   target, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, window->vk_filter);
+
+    brl_image_barrier(command_buffer, target, VK_IMAGE_ASPECT_COLOR_BIT,
+                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                      VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+  }
+
+  brl_image_barrier(command_buffer, image, VK_IMAGE_ASPECT_COLOR_BIT,
+                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+}
+
+/**
+ * Readbacks copy the frame's final image into a ring of host buffers
+ * at the end of its command buffer, and nothing ever waits on them: a
+ * request resolves when brl_draw_frame waits on the fence of the frame
+ * it was recorded in, and dumps to disk run on the capture worker.
+ *
+ * They need brl_app.capture, which makes the swapchain images
+ * copyable, an 8 bit RGBA or BGRA format, and a family that both
+ * renders and presents, since the copy comes after the frame's last
+ * pass.
+ **/
+int brl_readback_channel_order(VkFormat format)
+{
+  switch (format)
+  {
+  case VK_FORMAT_R8G8B8A8_UNORM:
+  case VK_FORMAT_R8G8B8A8_SRGB:
+    return 0;
+  case VK_FORMAT_B8G8R8A8_UNORM:
+  case VK_FORMAT_B8G8R8A8_SRGB:
+    return 1;
+  default:
+    return -1;
+  }
+}
+
+void brl_pick_capture(brl_app *app)
+{
+  app->vk_capture = app->capture != 0;
+  if (app->vk_capture && brl_readback_channel_order(app->vk_swp_image_format) == -1)
+  {
+    printf("Readbacks need an 8 bit RGBA or BGRA swap chain format, capture disabled.\n");
+    app->vk_capture = VK_FALSE;
+  }
+  if (app->vk_capture && !brl_is_queue_family_shared(app->vk_queue_families))
+  {
+    printf("Readbacks need a queue family with graphics and present, capture disabled.\n");
+    app->vk_capture = VK_FALSE;
+  }
+  if (app->vk_capture)
+    printf("SET: vk_capture (%d readback slots)\n", BRL_MAX_READBACKS);
+}
+
+/**
+ * Grows the slot's buffer to the current image size. Only called on
+ * requested slots, which no frame in flight uses.
+ **/
+VkResult brl_reserve_readback(brl_app *app, brl_readback *readback, VkDeviceSize size)
+{
+  if (readback->capacity >= size)
+    return VK_SUCCESS;
+
+  if (readback->mapped)
+    vkUnmapMemory(app->vk_device, readback->memory);
+  BRL_DESTROY(BRL_OBJECT_BUFFER, vkDestroyBuffer, app->vk_device, readback->buffer);
+  BRL_DESTROY(BRL_OBJECT_MEMORY, vkFreeMemory, app->vk_device, readback->memory);
+  readback->buffer = VK_NULL_HANDLE;
+  readback->memory = VK_NULL_HANDLE;
+  readback->mapped = NULL;
+  readback->capacity = 0;
+
+  // Cached memory, the CPU reads every byte of it.
+  VkResult result = brl_create_host_buffer(app, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                                           &readback->buffer, &readback->memory);
+  if (result == VK_SUCCESS)
+    result = vkMapMemory(app->vk_device, readback->memory, 0, VK_WHOLE_SIZE, 0, &readback->mapped);
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create readback buffer.", result);
+
+  readback->capacity = size;
+  return VK_SUCCESS;
+}
+
+/**
+ * Writes one readback, on the capture worker. PNGs are always RGBA and
+ * opaque, like what the compositor shows.
+ **/
+int brl_write_readback(brl_readback *readback)
+{
+  size_t size = (size_t)readback->width * readback->height * 4;
+  if (readback->save_format == BRL_CAPTURE_RAW)
+  {
+    FILE *file = fopen(readback->save_path, "wb");
+    if (file == NULL)
+      return -1;
+    int written = fwrite(readback->mapped, 1, size, file) == size;
+    return fclose(file) == 0 && written ? 0 : -1;
+  }
+
+  uint8_t *pixels = malloc(size);
+  if (pixels == NULL)
+    return -1;
+
+  const uint8_t *src = readback->mapped;
+  int bgra = brl_readback_channel_order(readback->format) == 1;
+  for (size_t i = 0; i < size; i += 4)
+  {
+    pixels[i] = src[i + (bgra ? 2 : 0)];
+    pixels[i + 1] = src[i + 1];
+    pixels[i + 2] = src[i + (bgra ? 0 : 2)];
+    pixels[i + 3] = 255;
+  }
+
+  int result = brl_png_write(readback->save_path, pixels, readback->width, readback->height);
+  free(pixels);
+  return result;
+}
+
+/**
+ * Oldest queued readback first, so captured frames reach the disk in
+ * order. Called with the capture lock held.
+ **/
+brl_readback *brl_next_saving_readback(brl_app *app)
+{
+  brl_readback *next = NULL;
+  for (uint32_t i = 0; i < BRL_MAX_READBACKS; i++)
+  {
+    brl_readback *readback = &app->readbacks[i];
+    if (atomic_load(&readback->state) == BRL_READBACK_SAVING && (next == NULL || readback->sequence < next->sequence))
+      next = readback;
+  }
+  return next;
+}
+
+/**
+ * Writes queued readbacks until asked to stop, and only stops once the
+ * queue is empty so the last frames of a capture are not lost.
+ **/
+void *brl_capture_worker_main(void *data)
+{
+  BRL_PROFILE_THREAD("capture");
+  brl_app *app = data;
+
+  pthread_mutex_lock(&app->capture_lock);
+  for (;;)
+  {
+    brl_readback *readback = brl_next_saving_readback(app);
+    if (readback == NULL)
+    {
+      if (app->capture_worker_stop)
+        break;
+      pthread_cond_wait(&app->capture_wake, &app->capture_lock);
+      continue;
+    }
+
+    atomic_store(&readback->state, BRL_READBACK_WRITING);
+    pthread_mutex_unlock(&app->capture_lock);
+
+    {
+      BRL_ZONE("write readback");
+      if (brl_write_readback(readback) != 0)
+        printf("BOREAL_WARNING: Failed to write %s.\n", readback->save_path);
+    }
+
+    pthread_mutex_lock(&app->capture_lock);
+    app->readbacks_saved++;
+    atomic_store(&readback->state, BRL_READBACK_FREE);
+  }
+  pthread_mutex_unlock(&app->capture_lock);
+  return NULL;
+}
+
+void brl_queue_readback_save(brl_app *app, brl_readback *readback)
+{
+  pthread_mutex_lock(&app->capture_lock);
+  atomic_store(&readback->state, BRL_READBACK_SAVING);
+  pthread_cond_signal(&app->capture_wake);
+  pthread_mutex_unlock(&app->capture_lock);
+}
+
+/**
+ * The copy into the slot is complete, the slot becomes readable, is
+ * handed to the capture worker or goes back to the ring.
+ **/
+void brl_resolve_readback(brl_app *app, brl_readback *readback)
+{
+  if (readback->release)
+    atomic_store(&readback->state, BRL_READBACK_FREE);
+  else if (readback->save)
+    brl_queue_readback_save(app, readback);
+  else
+    atomic_store(&readback->state, BRL_READBACK_READY);
+}
+
+/**
+ * Called once the fence of frame signaled, everything recorded in that
+ * frame is done.
+ **/
+void brl_resolve_readbacks(brl_app *app, uint32_t frame)
+{
+  for (uint32_t i = 0; i < BRL_MAX_READBACKS && app->vk_capture; i++)
+  {
+    brl_readback *readback = &app->readbacks[i];
+    if (atomic_load(&readback->state) == BRL_READBACK_IN_FLIGHT && readback->frame == frame)
+      brl_resolve_readback(app, readback);
+  }
+}
+
+/**
+ * Copies the frame's image into every requested slot, after anything
+ * else touched it. The image goes back to the layout it was in.
+ **/
+void brl_record_readbacks(brl_app *app, VkCommandBuffer command_buffer, uint32_t image_index)
+{
+  int requested = 0;
+  for (uint32_t i = 0; i < BRL_MAX_READBACKS && app->vk_capture; i++)
+    requested |= atomic_load(&app->readbacks[i].state) == BRL_READBACK_REQUESTED;
+  if (!requested)
+    return;
+
+  VkImage image = app->vk_swp_images[image_index];
+  VkExtent2D extent = app->vk_swp_extent;
+  brl_image_barrier(command_buffer, image, VK_IMAGE_ASPECT_COLOR_BIT,
+                    brl_present_layout(app), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                    VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_WRITE_BIT,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+  for (uint32_t i = 0; i < BRL_MAX_READBACKS; i++)
+  {
+    brl_readback *readback = &app->readbacks[i];
+    if (atomic_load(&readback->state) != BRL_READBACK_REQUESTED)
+      continue;
+
+    // Its future then reports VK_ERROR_UNKNOWN.
+    if (brl_reserve_readback(app, readback, (VkDeviceSize)extent.width * extent.height * 4) != VK_SUCCESS)
+    {
+      atomic_store(&readback->state, BRL_READBACK_FREE);
+      continue;
+    }
+
+    VkBufferImageCopy region = {
+        .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+        .imageExtent = {extent.width, extent.height, 1},
+    };
+    vkCmdCopyImageToBuffer(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback->buffer, 1, &region);
+
+    readback->frame = app->current_frame;
+    readback->width = extent.width;
+    readback->height = extent.height;
+    readback->format = app->vk_swp_image_format;
+    atomic_store(&readback->state, BRL_READBACK_IN_FLIGHT);
+  }
+
+  VkMemoryBarrier host_barrier = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+  };
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &host_barrier, 0, NULL, 0, NULL);
+
+  brl_image_barrier(command_buffer, image, VK_IMAGE_ASPECT_COLOR_BIT,
+                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, brl_present_layout(app),
+                    VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+}
+
+/**
+ * Asks for the next frame drawn to be copied back. Never waits: when
+ * every slot is still taken the frame is simply not captured and
+ * VK_NOT_READY is returned, a consumer slower than the frame rate
+ * drops frames rather than slowing the loop down.
+ **/
+VkResult brl_request_readback(brl_app *app, brl_readback_future *future)
+{
+  if (!app->vk_capture)
+    return brl_error("Readbacks need brl_app.capture.", VK_ERROR_FEATURE_NOT_PRESENT);
+
+  for (uint32_t i = 0; i < BRL_MAX_READBACKS; i++)
+  {
+    brl_readback *readback = &app->readbacks[i];
+    if (atomic_load(&readback->state) != BRL_READBACK_FREE)
+      continue;
+
+    readback->sequence = ++app->readback_sequence;
+    readback->release = 0;
+    readback->save = 0;
+    readback->lost = 0;
+    atomic_store(&readback->state, BRL_READBACK_REQUESTED);
+    *future = (brl_readback_future){i, readback->sequence};
+    return VK_SUCCESS;
+  }
+
+  app->readbacks_dropped++;
+  return VK_NOT_READY;
+}
+
+/**
+ * The slot of a future. VK_ERROR_DEVICE_LOST when its frame was still
+ * in flight when the device was lost, VK_ERROR_UNKNOWN when the future
+ * was released, saved, its copy could not be recorded, or it never
+ * existed.
+ **/
+VkResult brl_find_readback(brl_app *app, brl_readback_future future, brl_readback **found)
+{
+  if (future.slot >= BRL_MAX_READBACKS)
+    return VK_ERROR_UNKNOWN;
+
+  brl_readback *readback = &app->readbacks[future.slot];
+  if (readback->sequence != future.sequence)
+    return VK_ERROR_UNKNOWN;
+  if (readback->lost)
+    return VK_ERROR_DEVICE_LOST;
+
+  int state = atomic_load(&readback->state);
+  if (readback->release || readback->save ||
+      state == BRL_READBACK_FREE || state == BRL_READBACK_SAVING || state == BRL_READBACK_WRITING)
+    return VK_ERROR_UNKNOWN;
+
+  *found = readback;
+  return VK_SUCCESS;
+}
+
+/**
+ * VK_SUCCESS with the pixels once the frame is done on the GPU,
+ * VK_NOT_READY before. Checks the frame's fence without waiting, so a
+ * readback also resolves when no more frames are drawn. Has to be
+ * called from the thread that draws.
+ *
+ * VK_ERROR_DEVICE_LOST means the frame went down with a device that
+ * brl_draw_frame already recovered, VK_ERROR_UNKNOWN that the future is
+ * not valid (see brl_find_readback). Neither calls for another recovery.
+ **/
+VkResult brl_readback_poll(brl_app *app, brl_readback_future future, brl_frame_pixels *pixels)
+{
+  brl_readback *readback = NULL;
+  VkResult result = brl_find_readback(app, future, &readback);
+  if (result != VK_SUCCESS)
+    return result;
+
+  if (atomic_load(&readback->state) == BRL_READBACK_IN_FLIGHT &&
+      vkGetFenceStatus(app->vk_device, app->fence_in_flight[readback->frame]) == VK_SUCCESS)
+    brl_resolve_readback(app, readback);
+  if (atomic_load(&readback->state) != BRL_READBACK_READY)
+    return VK_NOT_READY;
+
+  *pixels = (brl_frame_pixels){readback->mapped, readback->width, readback->height, readback->format};
+  return VK_SUCCESS;
+}
+
+/**
+ * Writes the frame to path on the capture worker as soon as it is
+ * read back, then gives the slot back to the ring. The future is
+ * consumed, it cannot be polled anymore. Fails with the codes of
+ * brl_readback_poll for futures that are no longer valid.
+ **/
+VkResult brl_readback_save(brl_app *app, brl_readback_future future, const char *path, brl_capture_format format)
+{
+  brl_readback *readback = NULL;
+  VkResult result = brl_find_readback(app, future, &readback);
+  if (result != VK_SUCCESS)
+    return brl_error("Readback lost or already finished.", result);
+
+  if (!app->capture_worker_running)
+  {
+    app->capture_worker_stop = 0;
+    if (pthread_create(&app->vk_capture_worker, NULL, brl_capture_worker_main, app) != 0)
+      return brl_error("Failed to create capture worker.", VK_ERROR_INITIALIZATION_FAILED);
+    app->capture_worker_running = 1;
+    printf("-> Started capture worker\n");
+  }
+
+  snprintf(readback->save_path, sizeof(readback->save_path), "%s", path);
+  readback->save_format = format;
+  readback->save = 1;
+  if (atomic_load(&readback->state) == BRL_READBACK_READY)
+    brl_queue_readback_save(app, readback);
+  return VK_SUCCESS;
+}
+
+/**
+ * Gives the slot back, the pixels of the future are then gone. A
+ * readback still in flight is released when its frame completes.
+ **/
+void brl_readback_release(brl_app *app, brl_readback_future future)
+{
+  brl_readback *readback = NULL;
+  if (brl_find_readback(app, future, &readback) != VK_SUCCESS)
+    return;
+
+  readback->release = 1;
+  int state = atomic_load(&readback->state);
+  if (state == BRL_READBACK_REQUESTED || state == BRL_READBACK_READY)
+    atomic_store(&readback->state, BRL_READBACK_FREE);
+}
+
+/**
+ * Lets the worker write whatever completed, then stops it. Frames
+ * whose fence never signaled, with a lost device, are dropped and
+ * their futures report VK_ERROR_DEVICE_LOST.
+ **/
+void brl_stop_capture_worker(brl_app *app)
+{
+  for (uint32_t i = 0; i < BRL_MAX_READBACKS; i++)
+  {
+    brl_readback *readback = &app->readbacks[i];
+    if (atomic_load(&readback->state) != BRL_READBACK_IN_FLIGHT)
+      continue;
+
+    if (vkGetFenceStatus(app->vk_device, app->fence_in_flight[readback->frame]) == VK_SUCCESS)
+    {
+      brl_resolve_readback(app, readback);
+      continue;
+    }
+
+    readback->lost = 1;
+    atomic_store(&readback->state, BRL_READBACK_FREE);
+  }
+
+  if (!app->capture_worker_running)
+    return;
+
+  pthread_mutex_lock(&app->capture_lock);
+  app->capture_worker_stop = 1;
+  pthread_cond_signal(&app->capture_wake);
+  pthread_mutex_unlock(&app->capture_lock);
+  pthread_join(app->vk_capture_worker, NULL);
+  app->capture_worker_running = 0;
+}
+
+void brl_free_readbacks(brl_app *app)
+{
+  brl_stop_capture_worker(app);
+  for (uint32_t i = 0; i < BRL_MAX_READBACKS; i++)
+  {
+    brl_readback *readback = &app->readbacks[i];
+    if (readback->mapped)
+      vkUnmapMemory(app->vk_device, readback->memory);
+    BRL_DESTROY(BRL_OBJECT_BUFFER, vkDestroyBuffer, app->vk_device, readback->buffer);
+    BRL_DESTROY(BRL_OBJECT_MEMORY, vkFreeMemory, app->vk_device, readback->memory);
+    readback->buffer = VK_NULL_HANDLE;
+    readback->memory = VK_NULL_HANDLE;
+    readback->mapped = NULL;
+    readback->capacity = 0;
+    atomic_store(&readback->state, BRL_READBACK_FREE);
+  }
+}
+
+void brl_readback_report(brl_app *app)
+{
+  if (app->vk_capture)
+    printf("-> Readbacks: %llu frames saved, %llu requests dropped with every slot taken\n",
+           (unsigned long long)app->readbacks_saved, (unsigned long long)app->readbacks_dropped);
+}
+
+VkResult brl_record_command_buffer(brl_app *app, VkCommandBuffer command_buffer, uint32_t image_index)
+{
+  BRL_ZONE("record");
+  VkCommandBufferBeginInfo begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+  };
+
+  VkResult result = vkBeginCommandBuffer(command_buffer, &begin_info);
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to begin recording command buffer", result);
+
+  brl_post_begin_frame(app, command_buffer);
+#ifdef BRL_PROFILE
+  brl_gpu_profile_begin_frame(app, command_buffer);
+#endif
+  BRL_GPU_ZONE_BEGIN(app, command_buffer, BRL_GPU_ZONE_SCENE);
+
+  if (app->vk_dynamic_rendering)
+    brl_begin_rendering(app, command_buffer, image_index);
+  else
+    brl_begin_render_pass(app, command_buffer, image_index);
+
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, app->vk_pipeline);
+
+  VkViewport viewport = {
+      .x = 0.0f,
+      .y = 0.0f,
+      .width = app->vk_swp_extent.width,
+      .height = app->vk_swp_extent.height,
+      .minDepth = 0.0f,
+      .maxDepth = 1.0f,
+  };
+  vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+  VkRect2D scissor = {
+      .offset = {0, 0},
+      .extent = app->vk_swp_extent,
+  };
+  vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+  vkCmdDraw(command_buffer, 3, 1, 0, 0);
+
+  BRL_GPU_ZONE_BEGIN(app, command_buffer, BRL_GPU_ZONE_SPRITES);
+  brl_record_sprites(app, command_buffer);
+  BRL_GPU_ZONE_END(app, command_buffer, BRL_GPU_ZONE_SPRITES);
+
+  if (app->vk_dynamic_rendering)
+  {
+    brl_end_rendering(app, command_buffer, image_index);
+  }
+  else
+  {
+    vkCmdEndRenderPass(command_buffer);
+    if (app->vk_post)
+      brl_image_barrier(command_buffer, brl_scene_image(app, image_index), VK_IMAGE_ASPECT_COLOR_BIT,
+                        VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+                        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    else if (!brl_is_queue_family_shared(app->vk_queue_families))
+      brl_release_swp_image(app, command_buffer, image_index);
+  }
+
+  BRL_GPU_ZONE_END(app, command_buffer, BRL_GPU_ZONE_SCENE);
+
+  if (app->vk_post)
+  {
+    BRL_GPU_ZONE_BEGIN(app, command_buffer, BRL_GPU_ZONE_POST);
+    brl_record_post_chain(app, command_buffer, image_index);
+    BRL_GPU_ZONE_END(app, command_buffer, BRL_GPU_ZONE_POST);
+  }
+
+  brl_record_window_blits(app, command_buffer, image_index);
+  brl_record_readbacks(app, command_buffer, image_index);
+  BRL_GPU_ZONE_END(app, command_buffer, BRL_GPU_ZONE_FRAME);
+
+  VkResult end_result = vkEndCommandBuffer(command_buffer);
+  if (end_result != VK_SUCCESS)
+    return brl_error("Failed to record command buffer", end_result);
+
+  return VK_SUCCESS;
+}
+
+/**
+ * With separate graphics and present families, each swapchain image
+ * gets a command buffer on the present queue holding the acquire half
+ * of the ownership transfer. It never changes, so it is recorded once
+ * here and submitted between the graphics submit and the present.
+ **/
+VkResult brl_create_present_acquires(brl_app *app)
+{
+  if (brl_is_queue_family_shared(app->vk_queue_families))
+    return VK_SUCCESS;
+
+  VkSemaphoreCreateInfo semaphore_create_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+  };
+
+  app->sema_present_ready = calloc(app->vk_swp_images_count, sizeof(VkSemaphore));
+  app->vk_present_command_buffers = calloc(app->vk_swp_images_count, sizeof(VkCommandBuffer));
+
+  VkCommandBufferAllocateInfo alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .commandPool = app->vk_present_command_pool,
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = app->vk_swp_images_count,
+  };
+  VkResult result = vkAllocateCommandBuffers(app->vk_device, &alloc_info, app->vk_present_command_buffers);
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to allocate present command buffers", result);
+
+  VkCommandBufferBeginInfo begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+  };
+
+  for (uint32_t i = 0; i < app->vk_swp_images_count; i++)
+  {
+    result = brl_object_created(BRL_OBJECT_SEMAPHORE, vkCreateSemaphore(app->vk_device, &semaphore_create_info, BRL_ALLOCATOR, &app->sema_present_ready[i]));
+    if (result != VK_SUCCESS)
+      return brl_error("Failed to create semaphores", result);
+
+    VkCommandBuffer command_buffer = app->vk_present_command_buffers[i];
+    vkBeginCommandBuffer(command_buffer, &begin_info);
+    brl_image_ownership_barrier(command_buffer, app->vk_swp_images[i], VK_IMAGE_ASPECT_COLOR_BIT,
+                                app->vk_queue_families.graphics_family, app->vk_queue_families.present_family,
+                                brl_swp_final_layout(app),
+                                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+                                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+    result = vkEndCommandBuffer(command_buffer);
+    if (result != VK_SUCCESS)
+      return brl_error("Failed to record present command buffer", result);
+  }
+
+  printf("-> Recorded queue family ownership acquires (x%d)\n", app->vk_swp_images_count);
+  return VK_SUCCESS;
+}
+
+/**
+ * Render finished semaphores are waited on by the presentation
+ * engine, so they are owned by the swapchain image rather than by
+ * the frame in flight, and are rebuilt with the swapchain.
+ **/
+VkResult brl_create_swp_sync_objects(brl_app *app)
+{
+  VkSemaphoreCreateInfo semaphore_create_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+  };
+
+  app->sema_render_finished = calloc(app->vk_swp_images_count, sizeof(VkSemaphore));
+  for (uint32_t i = 0; i < app->vk_swp_images_count; i++)
+  {
+    VkResult result = brl_object_created(BRL_OBJECT_SEMAPHORE, vkCreateSemaphore(app->vk_device, &semaphore_create_info, BRL_ALLOCATOR, &app->sema_render_finished[i]));
+    if (result != VK_SUCCESS)
+      return brl_error("Failed to create semaphores", result);
+  }
+
+  return brl_create_present_acquires(app);
+}
+
+VkResult brl_create_sync_objects(brl_app *app)
+{
+  VkSemaphoreCreateInfo semaphore_create_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+  };
+
+  VkFenceCreateInfo fence_create_info = {
+      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+      .flags = VK_FENCE_CREATE_SIGNALED_BIT,
+  };
+
+  VkResult result = VK_SUCCESS;
+  for (uint32_t i = 0; i < app->vk_frames_in_flight && result == VK_SUCCESS; i++)
+  {
+    result = brl_object_created(BRL_OBJECT_SEMAPHORE, vkCreateSemaphore(app->vk_device, &semaphore_create_info, BRL_ALLOCATOR, &app->sema_image_available[i]));
+    if (result == VK_SUCCESS)
+      result = brl_object_created(BRL_OBJECT_FENCE, vkCreateFence(app->vk_device, &fence_create_info, BRL_ALLOCATOR, &app->fence_in_flight[i]));
+  }
+
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create semaphores / fences", result);
+
+  return brl_create_swp_sync_objects(app);
+}
+
+double brl_time_seconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * Called right before input is sampled. With present wait available
+ * this blocks until the frame presented (frames in flight - 1)
+ * presents ago is on screen, so the frame we are about to simulate
+ * only ever queues behind that many frames. The measured delay
+ * between the input sampling of a frame and its present completing
+ * is kept in brl_app.present_latency (in seconds).
+ **/
+void brl_wait_for_present(brl_app *app)
+{
+  BRL_ZONE("present wait");
+  if (!app->vk_present_wait)
+    return;
+
+  uint64_t queued = app->vk_frames_in_flight - 1;
+  if (app->present_id <= queued)
+    return;
+
+  uint64_t wait_id = app->present_id - queued;
+  if (app->vk_wait_for_present(app->vk_device, app->vk_swp, wait_id, BRL_PRESENT_WAIT_TIMEOUT) == VK_SUCCESS)
+    app->present_latency = brl_time_seconds() - app->input_times[wait_id % BRL_PRESENT_HISTORY];
+}
+
+/**
+ * Input sampling time of the next present, used to compute the
+ * motion-to-photon latency once that present completes.
+ **/
+void brl_mark_input(brl_app *app)
+{
+  app->input_times[(app->present_id + 1) % BRL_PRESENT_HISTORY] = brl_time_seconds();
+}
+
+/**
+ * Nanoseconds since the deadline, negative while it is ahead.
+ **/
+long brl_deadline_behind(const struct timespec *next, const struct timespec *now)
+{
+  return (now->tv_sec - next->tv_sec) * 1000000000L + (now->tv_nsec - next->tv_nsec);
+}
+
+/**
+ * Moves a deadline one frame further, or one frame after now when it
+ * is more than a frame late: we never try to catch up.
+ **/
+void brl_advance_deadline(struct timespec *next, const struct timespec *now, int rate)
+{
+  long frame_ns = 1000000000L / rate;
+  if (brl_deadline_behind(next, now) > frame_ns)
+    *next = *now;
+
+  next->tv_nsec += frame_ns;
+  while (next->tv_nsec >= 1000000000L)
+  {
+    next->tv_nsec -= 1000000000L;
+    next->tv_sec++;
+  }
+}
+
+/**
+ * Frame limiter, sleeps until the next deadline of a loop running at
+ * the given rate. Deadlines are absolute so sleeping
+ * inaccuracies do not accumulate, but we never try to catch up
+ * after a frame that took longer than the budget.
+ **/
+void brl_sleep_until_next(struct timespec *next, int rate)
+{
+  long frame_ns = 1000000000L / rate;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  if (brl_deadline_behind(next, &now) <= frame_ns)
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, next, NULL);
+  brl_advance_deadline(next, &now, rate);
+}
+
+void brl_limit_frame_rate(brl_app *app)
+{
+  BRL_ZONE("frame limiter");
+  if (app->max_fps > 0)
+    brl_sleep_until_next(&app->next_frame_time, app->max_fps);
+}
+
+/**
+ * Presents the main swapchain and every extra window acquired this
+ * frame in one call. Extra windows recover from their own out of date
+ * swapchains, only the main swapchain's result is returned.
+ **/
+VkResult brl_queue_present(brl_app *app, uint32_t image_index)
+{
+  BRL_ZONE("present");
+  VkSwapchainKHR swapchains[1 + BRL_MAX_WINDOWS] = {app->vk_swp};
+  uint32_t image_indices[1 + BRL_MAX_WINDOWS] = {image_index};
+  VkSemaphore wait_semaphores[1 + BRL_MAX_WINDOWS] = {app->sema_render_finished[image_index]};
+  brl_window *windows[1 + BRL_MAX_WINDOWS] = {NULL};
+  uint32_t swapchains_count = 1;
+  for (uint32_t i = 0; i < app->windows_count; i++)
+  {
+    brl_window *window = &app->windows[i];
+    if (!window->acquired)
+      continue;
+    swapchains[swapchains_count] = window->vk_swp;
+    image_indices[swapchains_count] = window->image_index;
+    wait_semaphores[swapchains_count] = window->sema_render_finished[window->image_index];
+    windows[swapchains_count] = window;
+    swapchains_count++;
+  }
+
+  // Present ids are only tracked on the main swapchain, 0 means none.
+  uint64_t present_id = app->present_id + 1;
+  uint64_t present_ids[1 + BRL_MAX_WINDOWS] = {present_id};
+  VkPresentIdKHR present_id_info = {
+      .sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+      .swapchainCount = swapchains_count,
+      .pPresentIds = present_ids,
   };
 
-  VkPipelineRasterizationStateCreateInfo rasterizer = {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-      .depthClampEnable = VK_FALSE,
-      .rasterizerDiscardEnable = VK_FALSE,
-      .polygonMode = VK_POLYGON_MODE_FILL,
-      .lineWidth = 1.0f,
-      .cullMode = VK_CULL_MODE_BACK_BIT,
-      .frontFace = VK_FRONT_FACE_CLOCKWISE,
-      .depthBiasEnable = VK_FALSE,
+  VkResult results[1 + BRL_MAX_WINDOWS] = {VK_SUCCESS};
+  VkPresentInfoKHR present_info = {
+      .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+      .pNext = app->vk_present_wait ? &present_id_info : NULL,
+      .swapchainCount = swapchains_count,
+      .pSwapchains = swapchains,
+      .pImageIndices = image_indices,
+      .waitSemaphoreCount = swapchains_count,
+      .pWaitSemaphores = wait_semaphores,
+      .pResults = results,
   };
 
-  VkPipelineMultisampleStateCreateInfo multi_sampling = {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-      .sampleShadingEnable = VK_FALSE,
-      .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+  if (!brl_is_queue_family_shared(app->vk_queue_families))
+  {
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkSubmitInfo acquire_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = &app->sema_render_finished[image_index],
+        .pWaitDstStageMask = &wait_stage,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &app->vk_present_command_buffers[image_index],
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &app->sema_present_ready[image_index],
+    };
+
+    VkResult acquire_result = vkQueueSubmit(app->vk_present_queue, 1, &acquire_info, VK_NULL_HANDLE);
+    if (acquire_result != VK_SUCCESS)
+      return acquire_result;
+
+    wait_semaphores[0] = app->sema_present_ready[image_index];
+  }
+
+  VkResult result = vkQueuePresentKHR(app->vk_present_queue, &present_info);
+  app->present_id = present_id;
+
+  for (uint32_t i = 1; i < swapchains_count; i++)
+  {
+    windows[i]->acquired = 0;
+    if (results[i] == VK_SUCCESS)
+      windows[i]->presented++;
+    else if (results[i] == VK_SUBOPTIMAL_KHR || results[i] == VK_ERROR_OUT_OF_DATE_KHR)
+      windows[i]->vk_out_of_date = 1;
+  }
+
+  if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR)
+    result = results[0];
+  return result;
+}
+
+/**
+ * Rebuilds the swapchain and everything sized after it, the old
+ * swapchain is handed to the new one so the presentation engine can
+ * reuse its resources. The pipeline uses dynamic viewport and scissor
+ * so it survives, as does the render pass since the surface format
+ * does not change.
+ **/
+VkResult brl_recreate_swp(brl_app *app, VkPhysicalDevice physical_device)
+{
+  BRL_ZONE("recreate swapchain");
+
+  // A minimized window has a 0x0 surface, the swapchain stays out of
+  // date and the next frame tries again.
+  if (!app->offscreen)
+  {
+    VkSurfaceCapabilitiesKHR capabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, app->vk_window_surface, &capabilities);
+    if (capabilities.currentExtent.width == 0 || capabilities.currentExtent.height == 0)
+      return VK_SUCCESS;
+  }
+
+  vkDeviceWaitIdle(app->vk_device);
+
+  brl_free_swp_targets(app);
+  free(app->vk_swp_images);
+  app->vk_swp_images = NULL;
+  app->vk_swp_images_count = 0;
+
+  VkSwapchainKHR old_swapchain = app->vk_swp;
+  app->vk_swp = VK_NULL_HANDLE;
+  VkResult result = brl_create_swp(app, physical_device, old_swapchain);
+  BRL_DESTROY(BRL_OBJECT_SWAPCHAIN, vkDestroySwapchainKHR, app->vk_device, old_swapchain);
+  if (result != VK_SUCCESS)
+    return result;
+
+  // Present ids are per swapchain, waiting on the new one for an id
+  // given to the old one would only ever time out.
+  app->present_id = 0;
+
+  BRL_CHECK(brl_create_image_views(app));
+  BRL_CHECK(brl_create_scene_targets(app, physical_device));
+  BRL_CHECK(brl_create_post_targets(app, physical_device));
+  if (!app->vk_dynamic_rendering)
+    BRL_CHECK(brl_create_frame_buffer(app));
+  return brl_create_swp_sync_objects(app);
+}
+
+VkResult brl_create_device_objects(brl_app *app);
+void brl_startup_report(brl_app *app);
+
+/**
+ * A lost device cannot be used any more, but the instance and surface
+ * are still valid. Every device level object is destroyed and created
+ * again, on a freshly picked physical device since the loss may come
+ * from the GPU being reset or removed.
+ **/
+VkResult brl_recover_device_lost(brl_app *app)
+{
+  app->device_lost_count++;
+  printf("BOREAL_WARNING: Device lost, rebuilding device objects (%d)\n", app->device_lost_count);
+
+  vkDeviceWaitIdle(app->vk_device);
+  brl_free_device_objects(app);
+
+  app->startup_time = brl_time_seconds();
+  atomic_store(&app->startup_stage_count, 0);
+  VkResult result = brl_create_device_objects(app);
+  brl_startup_report(app);
+  return result;
+}
+
+/**
+ * Rebuilds an extra window's swapchain, unless it is minimized.
+ **/
+VkResult brl_recreate_window_swp(brl_app *app, brl_window *window)
+{
+  BRL_ZONE("recreate window swapchain");
+  VkSurfaceCapabilitiesKHR capabilities;
+  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(app->vk_physical_device, window->vk_surface, &capabilities);
+  if (capabilities.currentExtent.width == 0 || capabilities.currentExtent.height == 0)
+    return VK_SUCCESS;
+
+  vkDeviceWaitIdle(app->vk_device);
+  return brl_create_window_swp(app, window, app->vk_physical_device);
+}
+
+/**
+ * Acquires the images of the extra windows taking part in this frame.
+ * Nothing here waits: a window whose own frame rate deadline is still
+ * ahead, or whose display has no image free yet, sits this frame out
+ * and the others are not held back by it.
+ **/
+VkResult brl_acquire_windows(brl_app *app, uint32_t frame)
+{
+  BRL_ZONE("acquire windows");
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  for (uint32_t i = 0; i < app->windows_count; i++)
+  {
+    brl_window *window = &app->windows[i];
+    window->acquired = 0;
+    if (window->vk_out_of_date)
+      BRL_CHECK(brl_recreate_window_swp(app, window));
+    if (window->vk_out_of_date)
+      continue;
+
+    if (window->max_fps > 0 && brl_deadline_behind(&window->next_frame_time, &now) < 0)
+    {
+      window->skipped++;
+      continue;
+    }
+
+    VkResult result = vkAcquireNextImageKHR(app->vk_device, window->vk_swp, 0, window->sema_image_available[frame], VK_NULL_HANDLE, &window->image_index);
+    if (result == VK_NOT_READY || result == VK_TIMEOUT)
+    {
+      window->skipped++;
+      continue;
+    }
+    if (result == VK_ERROR_OUT_OF_DATE_KHR)
+    {
+      window->vk_out_of_date = 1;
+      continue;
+    }
+    if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+      return result;
+
+    // A suboptimal image can still be presented, the swapchain is
+    // recreated on the next frame.
+    window->vk_out_of_date = result == VK_SUBOPTIMAL_KHR;
+    window->acquired = 1;
+    if (window->max_fps > 0)
+      brl_advance_deadline(&window->next_frame_time, &now, window->max_fps);
+  }
+
+  return VK_SUCCESS;
+}
+
+/**
+ * Acquires a swapchain image, records the frame and submits it, then
+ * hands the image to the presentation engine. Each frame in flight
+ * has its own command buffer, fence and acquire semaphore.
+ *
+ * Out of date swapchains are rebuilt and a lost device goes through
+ * brl_recover_device_lost. Any other failure is returned and kept in
+ * brl_app.vk_result, which stops the main loop.
+ **/
+VkResult brl_draw_frame(brl_app *app)
+{
+  if (app->compute_only)
+    return brl_error("A compute-only app has nothing to draw.", VK_ERROR_FEATURE_NOT_PRESENT);
+
+  BRL_ZONE("draw frame");
+  uint32_t frame = app->current_frame;
+  VkResult result;
+  {
+    BRL_ZONE("wait fence");
+    result = vkWaitForFences(app->vk_device, 1, &app->fence_in_flight[frame], VK_TRUE, UINT64_MAX);
+  }
+  if (result != VK_SUCCESS)
+    goto failed;
+
+  brl_read_post_timings(app, frame);
+  brl_resolve_readbacks(app, frame);
+#ifdef BRL_PROFILE
+  brl_read_gpu_zones(app, frame);
+#endif
+
+  uint32_t image_index = frame;
+  if (!app->offscreen)
+  {
+    BRL_ZONE("acquire");
+    result = vkAcquireNextImageKHR(app->vk_device, app->vk_swp, UINT64_MAX, app->sema_image_available[frame], VK_NULL_HANDLE, &image_index);
+  }
+  if (result == VK_ERROR_OUT_OF_DATE_KHR)
+  {
+    result = brl_recreate_swp(app, app->vk_physical_device);
+    goto failed;
+  }
+  if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+    goto failed;
+
+  result = brl_acquire_windows(app, frame);
+  if (result != VK_SUCCESS)
+    goto failed;
+
+  // Only reset the fence once we know work will be submitted with it.
+  vkResetFences(app->vk_device, 1, &app->fence_in_flight[frame]);
+
+  VkCommandBuffer command_buffer = app->vk_command_buffers[frame];
+  vkResetCommandBuffer(command_buffer, 0);
+  result = brl_record_command_buffer(app, command_buffer, image_index);
+  if (result != VK_SUCCESS)
+    goto failed;
+
+  // The extra windows go in the same submit, they only wait for
+  // their image before the blits.
+  VkSemaphore wait_semaphores[1 + BRL_MAX_WINDOWS] = {app->sema_image_available[frame]};
+  VkPipelineStageFlags wait_stages[1 + BRL_MAX_WINDOWS] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+  VkSemaphore signal_semaphores[1 + BRL_MAX_WINDOWS] = {app->sema_render_finished[image_index]};
+  uint32_t semaphores_count = 1;
+  for (uint32_t i = 0; i < app->windows_count; i++)
+  {
+    brl_window *window = &app->windows[i];
+    if (!window->acquired)
+      continue;
+    wait_semaphores[semaphores_count] = window->sema_image_available[frame];
+    wait_stages[semaphores_count] = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    signal_semaphores[semaphores_count] = window->sema_render_finished[window->image_index];
+    semaphores_count++;
+  }
+
+  VkSubmitInfo submit_info = {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .commandBufferCount = 1,
+      .pCommandBuffers = &command_buffer,
+      .signalSemaphoreCount = semaphores_count,
+      .pSignalSemaphores = signal_semaphores,
+      .waitSemaphoreCount = semaphores_count,
+      .pWaitSemaphores = wait_semaphores,
+      .pWaitDstStageMask = wait_stages,
+  };
+
+  // Nothing acquires or presents offscreen images.
+  if (app->offscreen)
+  {
+    submit_info.signalSemaphoreCount = 0;
+    submit_info.waitSemaphoreCount = 0;
+  }
+
+#ifdef BRL_PROFILE
+  app->profile_submit_time[frame] = brl_profile_now();
+#endif
+  {
+    BRL_ZONE("submit");
+    result = vkQueueSubmit(app->vk_queue, 1, &submit_info, app->fence_in_flight[frame]);
+  }
+  if (result != VK_SUCCESS)
+    goto failed;
+
+  app->current_frame = (frame + 1) % app->vk_frames_in_flight;
+  app->last_image = image_index;
+
+  if (!app->offscreen)
+    result = brl_queue_present(app, image_index);
+  if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+    result = brl_recreate_swp(app, app->vk_physical_device);
+
+failed:
+  // Whatever was batched belongs to this frame, even when it was not
+  // submitted.
+  app->batch_open = 0;
+
+  if (result == VK_ERROR_DEVICE_LOST)
+    result = brl_recover_device_lost(app);
+
+  if (result != VK_SUCCESS)
+    app->vk_result = brl_error("Failed to draw frame.", result);
+
+  return result;
+}
+
+/**
+ * Copies the last frame drawn offscreen into pixels, width * height
+ * RGBA8 values from the top row down. The copy waits on its own fence,
+ * which only waits for the frames submitted so far.
+ **/
+VkResult brl_read_frame(brl_app *app, void *pixels)
+{
+  BRL_ZONE("read frame");
+  if (!app->offscreen || app->compute_only)
+    return brl_error("Frames can only be read back when rendering offscreen.", VK_ERROR_FEATURE_NOT_PRESENT);
+
+  VkExtent2D extent = app->vk_swp_extent;
+  VkDeviceSize size = (VkDeviceSize)extent.width * extent.height * 4;
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+  VkFence fence = VK_NULL_HANDLE;
+
+  VkResult result = brl_create_host_buffer(app, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT, &buffer, &memory);
+  if (result != VK_SUCCESS)
+  {
+    brl_error("Failed to create readback buffer.", result);
+    goto done;
+  }
+
+  VkCommandBufferAllocateInfo command_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .commandPool = app->vk_command_pool,
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = 1,
+  };
+  result = vkAllocateCommandBuffers(app->vk_device, &command_info, &command_buffer);
+  if (result != VK_SUCCESS)
+  {
+    brl_error("Failed to allocate readback command buffer.", result);
+    goto done;
+  }
+
+  VkCommandBufferBeginInfo begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+  };
+  vkBeginCommandBuffer(command_buffer, &begin_info);
+
+  // The frame left the image in TRANSFER_SRC, whichever pass wrote it
+  // last must be done before the copy reads it.
+  brl_image_barrier(command_buffer, app->vk_swp_images[app->last_image], VK_IMAGE_ASPECT_COLOR_BIT,
+                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                    VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+                    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+
+  VkBufferImageCopy region = {
+      .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+      .imageExtent = {extent.width, extent.height, 1},
+  };
+  vkCmdCopyImageToBuffer(command_buffer, app->vk_swp_images[app->last_image], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &region);
+
+  VkMemoryBarrier host_barrier = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+  };
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &host_barrier, 0, NULL, 0, NULL);
+
+  result = vkEndCommandBuffer(command_buffer);
+  if (result != VK_SUCCESS)
+  {
+    brl_error("Failed to record readback.", result);
+    goto done;
+  }
+
+  VkFenceCreateInfo fence_info = {
+      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+  };
+  result = brl_object_created(BRL_OBJECT_FENCE, vkCreateFence(app->vk_device, &fence_info, BRL_ALLOCATOR, &fence));
+  if (result != VK_SUCCESS)
+    goto done;
+
+  VkSubmitInfo submit_info = {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .commandBufferCount = 1,
+      .pCommandBuffers = &command_buffer,
+  };
+  result = vkQueueSubmit(app->vk_queue, 1, &submit_info, fence);
+  if (result == VK_SUCCESS)
+    result = vkWaitForFences(app->vk_device, 1, &fence, VK_TRUE, UINT64_MAX);
+  if (result != VK_SUCCESS)
+  {
+    brl_error("Failed to read the frame back.", result);
+    goto done;
+  }
+
+  void *mapped;
+  result = vkMapMemory(app->vk_device, memory, 0, size, 0, &mapped);
+  if (result != VK_SUCCESS)
+  {
+    brl_error("Failed to map readback memory.", result);
+    goto done;
+  }
+  memcpy(pixels, mapped, size);
+  vkUnmapMemory(app->vk_device, memory);
+
+done:
+  BRL_DESTROY(BRL_OBJECT_FENCE, vkDestroyFence, app->vk_device, fence);
+  if (command_buffer)
+    vkFreeCommandBuffers(app->vk_device, app->vk_command_pool, 1, &command_buffer);
+  BRL_DESTROY(BRL_OBJECT_BUFFER, vkDestroyBuffer, app->vk_device, buffer);
+  BRL_DESTROY(BRL_OBJECT_MEMORY, vkFreeMemory, app->vk_device, memory);
+  return result;
+}
+
+/**
+ * Compute-only apps (brl_app.compute_only) get no surface, swapchain
+ * or graphics pipeline, only storage buffers and kernels. Dispatches
+ * are recorded into one command buffer and run, in order, on the next
+ * brl_compute_wait, which also makes their writes visible through the
+ * mapped buffers.
+ **/
+VkResult brl_create_dispatch_objects(brl_app *app)
+{
+  VkDescriptorPoolSize pool_size = {
+      .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      .descriptorCount = BRL_MAX_DISPATCHES * BRL_MAX_KERNEL_BUFFERS,
+  };
+  VkDescriptorPoolCreateInfo pool_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+      .maxSets = BRL_MAX_DISPATCHES,
+      .poolSizeCount = 1,
+      .pPoolSizes = &pool_size,
+  };
+  VkResult result = brl_object_created(BRL_OBJECT_DESCRIPTOR_POOL, vkCreateDescriptorPool(app->vk_device, &pool_info, BRL_ALLOCATOR, &app->vk_compute_pool));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create compute descriptor pool.", result);
+
+  VkFenceCreateInfo fence_info = {
+      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+  };
+  result = brl_object_created(BRL_OBJECT_FENCE, vkCreateFence(app->vk_device, &fence_info, BRL_ALLOCATOR, &app->fence_in_flight[0]));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create compute fence.", result);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(app->vk_physical_device, &properties);
+
+  uint32_t queue_family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(app->vk_physical_device, &queue_family_count, NULL);
+  VkQueueFamilyProperties *queue_families = malloc(sizeof(VkQueueFamilyProperties) * queue_family_count);
+  vkGetPhysicalDeviceQueueFamilyProperties(app->vk_physical_device, &queue_family_count, queue_families);
+  uint32_t timestamp_bits = queue_families[brl_submit_family(app)].timestampValidBits;
+  free(queue_families);
+
+  app->compute_dispatches = 0;
+  app->compute_time = 0.0;
+  if (timestamp_bits == 0 || properties.limits.timestampPeriod == 0.0f)
+  {
+    printf("Timestamps not supported on the compute queue, no dispatch timings.\n");
+    return VK_SUCCESS;
+  }
+
+  VkQueryPoolCreateInfo query_pool_info = {
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = 2,
+  };
+  result = brl_object_created(BRL_OBJECT_QUERY_POOL, vkCreateQueryPool(app->vk_device, &query_pool_info, BRL_ALLOCATOR, &app->vk_compute_timestamps));
+  if (result != VK_SUCCESS)
+    return brl_error("Failed to create compute timestamp query pool.", result);
+
+  app->vk_compute_period = properties.limits.timestampPeriod;
+  printf("-> Created compute dispatch objects\n");
+  return VK_SUCCESS;
+}
+
+void brl_free_storage_buffer(brl_app *app, brl_storage_buffer *storage)
+{
+  if (storage->mapped)
+    vkUnmapMemory(app->vk_device, storage->memory);
+  BRL_DESTROY(BRL_OBJECT_BUFFER, vkDestroyBuffer, app->vk_device, storage->buffer);
+  BRL_DESTROY(BRL_OBJECT_MEMORY, vkFreeMemory, app->vk_device, storage->memory);
+  *storage = (brl_storage_buffer){0};
+}
+
+void brl_free_kernel(brl_app *app, brl_kernel *kernel)
+{
+  BRL_DESTROY(BRL_OBJECT_PIPELINE, vkDestroyPipeline, app->vk_device, kernel->pipeline);
+  BRL_DESTROY(BRL_OBJECT_PIPELINE_LAYOUT, vkDestroyPipelineLayout, app->vk_device, kernel->layout);
+  BRL_DESTROY(BRL_OBJECT_DESCRIPTOR_SET_LAYOUT, vkDestroyDescriptorSetLayout, app->vk_device, kernel->set_layout);
+  *kernel = (brl_kernel){0};
+}
+
+/**
+ * Unlike textures, storage buffers and kernels are not restored after
+ * a device loss, their content lives on the device only.
+ **/
+void brl_free_compute(brl_app *app)
+{
+  for (uint32_t i = 0; i < app->storage_buffers_count; i++)
+    brl_free_storage_buffer(app, &app->storage_buffers[i]);
+  for (uint32_t i = 0; i < app->kernels_count; i++)
+    brl_free_kernel(app, &app->kernels[i]);
+  app->storage_buffers_count = 0;
+  app->kernels_count = 0;
+
+  BRL_DESTROY(BRL_OBJECT_DESCRIPTOR_POOL, vkDestroyDescriptorPool, app->vk_device, app->vk_compute_pool);
+  BRL_DESTROY(BRL_OBJECT_QUERY_POOL, vkDestroyQueryPool, app->vk_device, app->vk_compute_timestamps);
+  app->vk_compute_pool = VK_NULL_HANDLE;
+  app->vk_compute_timestamps = VK_NULL_HANDLE;
+  app->compute_dispatches = 0;
+}
+
+/**
+ * Creates a storage buffer of size bytes, filled with data when it is
+ * not NULL and with zeros otherwise.
+ **/
+VkResult brl_create_storage_buffer(brl_app *app, VkDeviceSize size, const void *data, uint32_t *buffer)
+{
+  if (app->storage_buffers_count >= BRL_MAX_STORAGE_BUFFERS)
+    return brl_error("Too many storage buffers.", VK_ERROR_TOO_MANY_OBJECTS);
+
+  brl_storage_buffer *storage = &app->storage_buffers[app->storage_buffers_count];
+  VkResult result = brl_create_host_buffer(app, size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &storage->buffer, &storage->memory);
+  if (result == VK_SUCCESS)
+    result = vkMapMemory(app->vk_device, storage->memory, 0, VK_WHOLE_SIZE, 0, &storage->mapped);
+  if (result != VK_SUCCESS)
+  {
+    brl_free_storage_buffer(app, storage);
+    return brl_error("Failed to create storage buffer.", result);
+  }
+
+  storage->size = size;
+  if (data)
+    memcpy(storage->mapped, data, size);
+  else
+    memset(storage->mapped, 0, size);
+
+  *buffer = app->storage_buffers_count++;
+  return VK_SUCCESS;
+}
+
+/**
+ * Mapped content of a storage buffer. What the kernels wrote is only
+ * there once brl_compute_wait returned, and the host must not write
+ * to a buffer that recorded dispatches still use.
+ **/
+void *brl_storage_buffer_data(brl_app *app, uint32_t buffer)
+{
+  return buffer < app->storage_buffers_count ? app->storage_buffers[buffer].mapped : NULL;
+}
+
+/**
+ * Builds a compute pipeline out of a SPIR-V file. The shader takes
+ * buffers_count storage buffers at bindings 0 and up of set 0, and
+ * push_size bytes of push constants.
+ **/
+VkResult brl_create_kernel(brl_app *app, const char *path, uint32_t buffers_count, uint32_t push_size, uint32_t *kernel)
+{
+  if (app->kernels_count >= BRL_MAX_KERNELS)
+    return brl_error("Too many kernels.", VK_ERROR_TOO_MANY_OBJECTS);
+  if (buffers_count > BRL_MAX_KERNEL_BUFFERS || push_size > BRL_MAX_KERNEL_PUSH_SIZE)
+    return brl_error("Kernel takes too many buffers or push constants.", VK_ERROR_INITIALIZATION_FAILED);
+
+  brl_kernel *compute = &app->kernels[app->kernels_count];
+  *compute = (brl_kernel){.buffers_count = buffers_count, .push_size = push_size};
+  brl_file file = brl_read((char *)path);
+  VkShaderModule module = VK_NULL_HANDLE;
+
+  VkDescriptorSetLayoutBinding bindings[BRL_MAX_KERNEL_BUFFERS];
+  for (uint32_t i = 0; i < buffers_count; i++)
+  {
+    bindings[i] = (VkDescriptorSetLayoutBinding){
+        .binding = i,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .descriptorCount = 1,
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    };
+  }
+
+  VkDescriptorSetLayoutCreateInfo set_layout_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+      .bindingCount = buffers_count,
+      .pBindings = bindings,
+  };
+  VkResult result = brl_object_created(BRL_OBJECT_DESCRIPTOR_SET_LAYOUT, vkCreateDescriptorSetLayout(app->vk_device, &set_layout_info, BRL_ALLOCATOR, &compute->set_layout));
+  if (result != VK_SUCCESS)
+  {
+    brl_error("Failed to create kernel descriptor set layout.", result);
+    goto done;
+  }
+
+  VkPushConstantRange push_constant_range = {
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      .offset = 0,
+      .size = push_size,
+  };
+  VkPipelineLayoutCreateInfo layout_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      .setLayoutCount = 1,
+      .pSetLayouts = &compute->set_layout,
+      .pushConstantRangeCount = push_size ? 1 : 0,
+      .pPushConstantRanges = &push_constant_range,
+  };
+  result = brl_object_created(BRL_OBJECT_PIPELINE_LAYOUT, vkCreatePipelineLayout(app->vk_device, &layout_info, BRL_ALLOCATOR, &compute->layout));
+  if (result != VK_SUCCESS)
+  {
+    brl_error("Failed to create kernel pipeline layout.", result);
+    goto done;
+  }
+
+  result = brl_create_shader_module(app, file, &module);
+  if (result != VK_SUCCESS)
+    goto done;
+
+  VkComputePipelineCreateInfo create_info = {
+      .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+      .stage = {
+          .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+          .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+          .module = module,
+          .pName = "main",
+      },
+      .layout = compute->layout,
   };
+  result = brl_object_created(BRL_OBJECT_PIPELINE, vkCreateComputePipelines(app->vk_device, VK_NULL_HANDLE, 1, &create_info, BRL_ALLOCATOR, &compute->pipeline));
+  if (result != VK_SUCCESS)
+    brl_error("Failed to create kernel pipeline.", result);
+
+done:
+  BRL_DESTROY(BRL_OBJECT_SHADER_MODULE, vkDestroyShaderModule, app->vk_device, module);
+  brl_file_close(file);
+  if (result != VK_SUCCESS)
+  {
+    brl_free_kernel(app, compute);
+    return result;
+  }
+
+  printf("-> Created VkPipeline (kernel %s)\n", path);
+  *kernel = app->kernels_count++;
+  return VK_SUCCESS;
+}
+
+/**
+ * Records a dispatch of the kernel, with buffers bound in order and
+ * push_constants the size the kernel was created with. Nothing runs
+ * before brl_compute_wait, which is called here when the command
+ * buffer is full. Every dispatch sees what the previous ones wrote.
+ **/
+VkResult brl_dispatch(brl_app *app, uint32_t kernel, const uint32_t *buffers, const void *push_constants, uint32_t groups_x, uint32_t groups_y, uint32_t groups_z)
+{
+  if (kernel >= app->kernels_count)
+    return brl_error("Unknown kernel.", VK_ERROR_INITIALIZATION_FAILED);
 
-  VkPipelineColorBlendAttachmentState color_blend_attachment = {
-      .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
-      .blendEnable = VK_FALSE,
-  };
+  brl_kernel *compute = &app->kernels[kernel];
+  for (uint32_t i = 0; i < compute->buffers_count; i++)
+  {
+    if (buffers[i] >= app->storage_buffers_count)
+      return brl_error("Unknown storage buffer.", VK_ERROR_INITIALIZATION_FAILED);
+  }
 
-  VkPipelineColorBlendStateCreateInfo color_blending = {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-      .logicOpEnable = VK_FALSE,
-      .attachmentCount = 1,
-      .pAttachments = &color_blend_attachment,
-  };
+  if (app->compute_dispatches == BRL_MAX_DISPATCHES)
+    BRL_CHECK(brl_compute_wait(app));
 
-  VkPipelineLayoutCreateInfo pipeline_layout_info = {
-      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-  };
+  VkCommandBuffer command_buffer = app->vk_command_buffers[0];
+  if (app->compute_dispatches == 0)
+  {
+    // The last wait left both the pool and the command buffer unused.
+    vkResetDescriptorPool(app->vk_device, app->vk_compute_pool, 0);
+    vkResetCommandBuffer(command_buffer, 0);
 
-  VkPipelineLayout pipeline_layout = malloc(sizeof(VkPipelineLayout));
-  VkResult pipeline_result = vkCreatePipelineLayout(app->vk_device, &pipeline_layout_info, NULL, &pipeline_layout);
-  if (pipeline_result != VK_SUCCESS)
-    brl_exit_error("Failed to create pipeline layout.");
+    VkCommandBufferBeginInfo begin_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    VkResult result = vkBeginCommandBuffer(command_buffer, &begin_info);
+    if (result != VK_SUCCESS)
+      return brl_error("Failed to begin compute command buffer.", result);
 
-  printf("-> Created pipeline layout\n");
-  app->vk_pipeline_layout = pipeline_layout;
+    if (app->vk_compute_timestamps != VK_NULL_HANDLE)
+    {
+      vkCmdResetQueryPool(command_buffer, app->vk_compute_timestamps, 0, 2);
+      vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, app->vk_compute_timestamps, 0);
+    }
+  }
+  else
+  {
+    brl_compute_barrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+  }
 
-  VkGraphicsPipelineCreateInfo create_info = {
-      .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-      .stageCount = 2,
-      .pStages = shader_stages,
-      .pVertexInputState = &vertex_input_info,
-      .pInputAssemblyState = &input_assembly,
-      .pViewportState = &viewport_state,
-      .pRasterizationState = &rasterizer,
-      .pMultisampleState = &multi_sampling,
-      .pDepthStencilState = NULL,
-      .pColorBlendState = &color_blending,
-      .pDynamicState = &dynamic_state,
-      .layout = app->vk_pipeline_layout,
-      .renderPass = app->vk_render_pass,
-      .subpass = 0,
-      .basePipelineHandle = VK_NULL_HANDLE,
-      .basePipelineIndex = -1,
+  VkDescriptorSetAllocateInfo set_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+      .descriptorPool = app->vk_compute_pool,
+      .descriptorSetCount = 1,
+      .pSetLayouts = &compute->set_layout,
   };
-
-  VkPipeline pipeline = malloc(sizeof(VkPipeline));
-  VkResult result = vkCreateGraphicsPipelines(app->vk_device, VK_NULL_HANDLE, 1, &create_info, NULL, &pipeline);
+  VkDescriptorSet set = VK_NULL_HANDLE;
+  VkResult result = vkAllocateDescriptorSets(app->vk_device, &set_info, &set);
   if (result != VK_SUCCESS)
-    brl_exit_error("Failed to create the render pipeline.");
+    return brl_error("Failed to allocate kernel descriptor set.", result);
 
-  printf("-> Created VkPipeline (Graphics pipeline)\n");
+  VkDescriptorBufferInfo buffer_infos[BRL_MAX_KERNEL_BUFFERS];
+  VkWriteDescriptorSet writes[BRL_MAX_KERNEL_BUFFERS];
+  for (uint32_t i = 0; i < compute->buffers_count; i++)
+  {
+    buffer_infos[i] = (VkDescriptorBufferInfo){app->storage_buffers[buffers[i]].buffer, 0, VK_WHOLE_SIZE};
+    writes[i] = (VkWriteDescriptorSet){
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = set,
+        .dstBinding = i,
+        .descriptorCount = 1,
+        .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        .pBufferInfo = &buffer_infos[i],
+    };
+  }
+  vkUpdateDescriptorSets(app->vk_device, compute->buffers_count, writes, 0, NULL);
 
-  app->vk_pipeline = pipeline;
-  vkDestroyShaderModule(app->vk_device, vshader, NULL);
-  vkDestroyShaderModule(app->vk_device, fshader, NULL);
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute->pipeline);
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, compute->layout, 0, 1, &set, 0, NULL);
+  if (compute->push_size)
+    vkCmdPushConstants(command_buffer, compute->layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, compute->push_size, push_constants);
+  vkCmdDispatch(command_buffer, groups_x, groups_y, groups_z);
+
+  app->compute_dispatches++;
+  return VK_SUCCESS;
 }
 
-void brl_create_render_pass(brl_app *app)
+/**
+ * Submits the recorded dispatches and waits for them. With timestamps
+ * on the compute queue, brl_app.compute_time then holds how long they
+ * ran on the device, in seconds, without the submit overhead.
+ **/
+VkResult brl_compute_wait(brl_app *app)
 {
-  VkAttachmentDescription color_attachment = {
-      .format = app->vk_swp_image_format,
-      .samples = VK_SAMPLE_COUNT_1_BIT,
-      .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-      .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-      .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-      .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-      .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-  };
+  BRL_ZONE("compute wait");
+  if (app->compute_dispatches == 0)
+    return VK_SUCCESS;
+
+  VkCommandBuffer command_buffer = app->vk_command_buffers[0];
+  brl_compute_barrier(command_buffer, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+  if (app->vk_compute_timestamps != VK_NULL_HANDLE)
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, app->vk_compute_timestamps, 1);
+  app->compute_dispatches = 0;
+
+  VkResult result = vkEndCommandBuffer(command_buffer);
+  if (result == VK_SUCCESS)
+  {
+    VkSubmitInfo submit_info = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &command_buffer,
+    };
+    vkResetFences(app->vk_device, 1, &app->fence_in_flight[0]);
+    result = vkQueueSubmit(app->vk_queue, 1, &submit_info, app->fence_in_flight[0]);
+  }
+  if (result == VK_SUCCESS)
+    result = vkWaitForFences(app->vk_device, 1, &app->fence_in_flight[0], VK_TRUE, UINT64_MAX);
+  if (result != VK_SUCCESS)
+  {
+    // Compute objects are not rebuilt after a device loss, the run stops.
+    app->vk_result = brl_error("Failed to run compute dispatches.", result);
+    return result;
+  }
 
-  VkAttachmentReference color_attachment_ref = {
-      .attachment = 0,
-      .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-  };
+  uint64_t timestamps[2];
+  if (app->vk_compute_timestamps != VK_NULL_HANDLE &&
+      vkGetQueryPoolResults(app->vk_device, app->vk_compute_timestamps, 0, 2, sizeof(timestamps), timestamps,
+                            sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+    app->compute_time = (timestamps[1] - timestamps[0]) * app->vk_compute_period / 1e9;
 
-  VkSubpassDescription subpass = {
-      .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-      .colorAttachmentCount = 1,
-      .pColorAttachments = &color_attachment_ref,
-  };
+  return VK_SUCCESS;
+}
 
-  VkRenderPassCreateInfo create_info = {
-      .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-      .attachmentCount = 1,
-      .pAttachments = &color_attachment,
-      .subpassCount = 1,
-      .pSubpasses = &subpass,
-  };
+/**
+ * Asks the main loop to stop after the current frame, the only way
+ * out of an offscreen run since there is no window to close.
+ **/
+void brl_close(brl_app *app)
+{
+  atomic_store(&app->closing, 1);
+}
 
-  VkRenderPass render_pass = malloc(sizeof(VkRenderPass));
-  VkResult result = vkCreateRenderPass(app->vk_device, &create_info, NULL, &render_pass);
-  if (result != VK_SUCCESS)
-    brl_exit_error("Failed to create render pass.");
+/**
+ * Closing any of the windows, extra ones included, closes the app.
+ **/
+int brl_should_close(brl_app *app)
+{
+  if (atomic_load(&app->closing))
+    return 1;
+  for (uint32_t i = 0; i < app->windows_count; i++)
+  {
+    if (app->windows[i].window && glfwWindowShouldClose(app->windows[i].window))
+      return 1;
+  }
+  return app->window ? glfwWindowShouldClose(app->window) : 0;
+}
 
-  printf("-> Created VkRenderPass\n");
-  app->vk_render_pass = render_pass;
+void brl_poll_events(brl_app *app)
+{
+  if (app->window)
+    glfwPollEvents();
+}
+
+/**
+ * Runs the user simulation and publishes its result, then makes the
+ * latest published state the one the next frame renders.
+ * Both halves run on the same thread in the default mode, the render
+ * thread mode splits them across the two threads.
+ **/
+void brl_update_frame_state(brl_app *app)
+{
+  if (app->update)
+  {
+    BRL_ZONE("update");
+    app->update(app, brl_snapshot_write(&app->frame_snapshot));
+    brl_snapshot_publish(&app->frame_snapshot);
+  }
 }
 
-void brl_create_frame_buffer(brl_app *app)
+void brl_render_frame(brl_app *app)
 {
-  VkFramebuffer *frame_buffers = malloc(sizeof(frame_buffers) * app->vk_swp_images_count);
-  for (size_t i = 0; i < app->vk_swp_images_count; i++)
+  BRL_ZONE("frame");
+  brl_limit_frame_rate(app);
+  brl_wait_for_present(app);
+  brl_mark_input(app);
+  app->frame_state = brl_snapshot_read(&app->frame_snapshot);
+  if (app->loop)
   {
-    VkImageView attachments[] = {app->vk_swp_image_views[i]};
-    VkFramebufferCreateInfo create_info = {
-        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
-        .renderPass = app->vk_render_pass,
-        .attachmentCount = 1,
-        .pAttachments = attachments,
-        .width = app->vk_swp_extent.width,
-        .height = app->vk_swp_extent.height,
-        .layers = 1,
-    };
+    BRL_ZONE("loop");
+    app->loop(app);
+  }
 
-    VkResult result = vkCreateFramebuffer(app->vk_device, &create_info, NULL, &frame_buffers[i]);
-    if (result != VK_SUCCESS)
-      brl_exit_error("Couldn't create framebuffers.");
+  if (!app->first_frame_done)
+  {
+    app->first_frame_done = 1;
+    printf("STARTUP: first frame submitted after %.2f ms\n", (brl_time_seconds() - app->startup_time) * 1000.0);
   }
-  printf("-> Created VkFrameBuffer (Frame buffers)\n");
-  app->vk_frame_buffers = frame_buffers;
 }
 
-void brl_create_command_pool(brl_app *app, VkPhysicalDevice physical_device)
+void *brl_render_thread_main(void *data)
 {
-  brl_queue_family_indices indices = brl_find_queue_families(app, physical_device);
+  BRL_PROFILE_THREAD("render");
+  brl_app *app = data;
+  while (atomic_load(&app->running) && app->vk_result == VK_SUCCESS)
+    brl_render_frame(app);
 
-  VkCommandPoolCreateInfo create_info = {
-      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-      .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
-      .queueFamilyIndex = indices.graphics_family,
-  };
+  atomic_store(&app->running, 0);
 
-  VkCommandPool command_pool = malloc(sizeof(VkCommandPool));
-  VkResult result = vkCreateCommandPool(app->vk_device, &create_info, NULL, &command_pool);
-  if (result != VK_SUCCESS)
-    brl_exit_error("Failed to create command pool.");
+  return NULL;
+}
 
-  printf("-> Created VkCommandPool\n");
-  app->vk_command_pool = command_pool;
+/**
+ * With brl_app.render_thread set, the main thread only polls events
+ * and runs the update callback at brl_app.update_rate, while a render
+ * thread records, submits and presents. A slow frame or a blocking
+ * acquire/present then never delays input handling. The two threads
+ * only share the frame state snapshot.
+ **/
+VkResult brl_run_threaded(brl_app *app)
+{
+  int update_rate = app->update_rate ? app->update_rate : BRL_DEFAULT_UPDATE_RATE;
+
+  // The render thread needs a state to draw from its first frame.
+  brl_poll_events(app);
+  brl_update_frame_state(app);
+
+  atomic_store(&app->running, 1);
+  if (pthread_create(&app->vk_render_thread, NULL, brl_render_thread_main, app) != 0)
+    return brl_error("Failed to create render thread.", VK_ERROR_INITIALIZATION_FAILED);
+
+  printf("-> Started render thread\n");
+
+  while (!brl_should_close(app) && atomic_load(&app->running))
+  {
+    brl_sleep_until_next(&app->next_update_time, update_rate);
+    brl_poll_events(app);
+    brl_update_frame_state(app);
+#ifdef BRL_PROFILE
+    brl_profile_flush();
+#endif
+  }
+
+  atomic_store(&app->running, 0);
+  pthread_join(app->vk_render_thread, NULL);
+  return app->vk_result;
 }
 
-void brl_create_command_buffer(brl_app *app)
+VkResult brl_run(brl_app *app)
 {
-  VkCommandBufferAllocateInfo alloc_info = {
-      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-      .commandPool = app->vk_command_pool,
-      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-      .commandBufferCount = 1,
+  while (!brl_should_close(app) && app->vk_result == VK_SUCCESS)
+  {
+    {
+      BRL_ZONE("frame");
+      brl_limit_frame_rate(app);
+      brl_wait_for_present(app);
+      brl_mark_input(app);
+      brl_poll_events(app);
+      brl_update_frame_state(app);
+      app->frame_state = brl_snapshot_read(&app->frame_snapshot);
+      if (app->loop)
+      {
+        BRL_ZONE("loop");
+        app->loop(app);
+      }
+    }
+#ifdef BRL_PROFILE
+    brl_profile_flush();
+#endif
+  }
+
+  return app->vk_result;
+}
+
+/**
+ * Records how long a startup step took. Stages can be recorded from
+ * the worker threads, the slot is claimed atomically.
+ **/
+void brl_startup_mark(brl_app *app, const char *name, double start, int worker)
+{
+  unsigned int index = atomic_fetch_add(&app->startup_stage_count, 1);
+  if (index >= BRL_MAX_STARTUP_STAGES)
+    return;
+
+  app->startup_stages[index] = (brl_startup_stage){
+      .name = name,
+      .start = start - app->startup_time,
+      .duration = brl_time_seconds() - start,
+      .worker = worker,
   };
 
-  VkCommandBuffer command_buffer = malloc(sizeof(VkCommandBuffer));
-  VkResult result = vkAllocateCommandBuffers(app->vk_device, &alloc_info, &command_buffer);
-  if (result != VK_SUCCESS)
-    brl_exit_error("Failed to allocate command buffer");
+#ifdef BRL_PROFILE
+  // Both clocks are CLOCK_MONOTONIC, the stage doubles as a zone.
+  brl_profile_zone zone = {name, (uint64_t)(start * 1e9)};
+  brl_profile_zone_end(&zone);
+#endif
+}
+
+#define BRL_STAGE(app, name, call)                            \
+  do                                                          \
+  {                                                           \
+    double brl_stage_start = brl_time_seconds();              \
+    VkResult brl_stage_result = call;                         \
+    brl_startup_mark(app, name, brl_stage_start, 0);          \
+    if (brl_stage_result != VK_SUCCESS)                       \
+      return brl_stage_result;                                \
+  } while (0)
+
+void brl_startup_report(brl_app *app)
+{
+  unsigned int count = atomic_load(&app->startup_stage_count);
+  if (count > BRL_MAX_STARTUP_STAGES)
+    count = BRL_MAX_STARTUP_STAGES;
 
-  printf("-> Allocated VkCommandBuffer\n");
-  app->vk_command_buffer = command_buffer;
+  printf("\nSTARTUP: %d stages\n", count);
+  for (unsigned int i = 0; i < count; i++)
+  {
+    brl_startup_stage stage = app->startup_stages[i];
+    printf("  %-24s %s  +%8.2f ms  %8.2f ms\n", stage.name, stage.worker ? "worker" : "main  ",
+           stage.start * 1000.0, stage.duration * 1000.0);
+  }
+  printf("STARTUP: ready after %.2f ms\n\n", (brl_time_seconds() - app->startup_time) * 1000.0);
 }
 
-void brl_record_command_buffer(brl_app *app, VkCommandBuffer command_buffer, uint32_t image_index)
+/**
+ * Reading the SPIR-V from disk does not need Vulkan at all, it runs
+ * while the instance and the device are being created.
+ **/
+void *brl_load_shaders(void *data)
 {
-  VkCommandBufferBeginInfo begin_info = {
-      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-  };
+  BRL_PROFILE_THREAD("shader loader");
+  brl_app *app = data;
+  double start = brl_time_seconds();
+  app->shader_files[0] = brl_read(BRL_VERTEX_SHADER_PATH);
+  app->shader_files[1] = brl_read(BRL_FRAGMENT_SHADER_PATH);
+  brl_startup_mark(app, "load shaders", start, 1);
+  return NULL;
+}
 
-  VkResult result = vkBeginCommandBuffer(command_buffer, &begin_info);
-  if (result != VK_SUCCESS)
-    brl_exit_error("Failed to begin recording command buffer");
+void brl_start_shader_loader(brl_app *app)
+{
+  app->shaders_loading = pthread_create(&app->vk_shader_loader, NULL, brl_load_shaders, app) == 0;
+  if (!app->shaders_loading)
+    brl_load_shaders(app);
+}
 
-  VkRenderPassBeginInfo render_pass_info = {
-      .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-      .renderPass = app->vk_render_pass,
-      .framebuffer = app->vk_frame_buffers[image_index],
-      .renderArea.offset = {0, 0},
-      .renderArea.extent = app->vk_swp_extent,
-  };
+/**
+ * Joins the loader if it is still running, then hands the files over
+ * to the caller. They are read again when the loader did not run,
+ * which is the case when rebuilding after a device loss.
+ **/
+void brl_take_shaders(brl_app *app, brl_file *vertex, brl_file *fragment)
+{
+  if (app->shaders_loading)
+  {
+    pthread_join(app->vk_shader_loader, NULL);
+    app->shaders_loading = 0;
+  }
+  else if (app->shader_files[0].data == NULL && app->shader_files[1].data == NULL)
+  {
+    brl_load_shaders(app);
+  }
 
-  VkClearValue clear_color = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-  render_pass_info.clearValueCount = 1;
-  render_pass_info.pClearValues = &clear_color;
+  *vertex = app->shader_files[0];
+  *fragment = app->shader_files[1];
+  app->shader_files[0] = (brl_file){0};
+  app->shader_files[1] = (brl_file){0};
+}
 
-  vkCmdBeginRenderPass(command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
-  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, app->vk_pipeline);
+void *brl_pipeline_worker_main(void *data)
+{
+  BRL_PROFILE_THREAD("pipeline worker");
+  brl_app *app = data;
+  brl_file vertex, fragment;
+  brl_take_shaders(app, &vertex, &fragment);
 
-  VkViewport viewport = {
-      .x = 0.0f,
-      .y = 0.0f,
-      .width = app->vk_swp_extent.width,
-      .height = app->vk_swp_extent.height,
-      .minDepth = 0.0f,
-      .maxDepth = 1.0f,
-  };
-  vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+  double start = brl_time_seconds();
+  app->pipeline_result = brl_create_gfx_pipeline(app, vertex, fragment);
+  brl_startup_mark(app, "graphics pipeline", start, 1);
 
-  VkRect2D scissor = {
-      .offset = {0, 0},
-      .extent = app->vk_swp_extent,
-  };
-  vkCmdSetScissor(command_buffer, 0, 1, &scissor);
-  vkCmdDraw(command_buffer, 3, 1, 0, 0);
-  vkCmdEndRenderPass(command_buffer);
-  VkResult end_result = vkEndCommandBuffer(command_buffer);
-  if (end_result != VK_SUCCESS)
-    brl_exit_error("Failed to record command buffer");
+  if (app->pipeline_result == VK_SUCCESS && app->vk_post)
+  {
+    start = brl_time_seconds();
+    app->pipeline_result = brl_create_post_pipelines(app);
+    brl_startup_mark(app, "post pipelines", start, 1);
+  }
+
+  if (app->pipeline_result == VK_SUCCESS)
+  {
+    start = brl_time_seconds();
+    app->pipeline_result = brl_create_sprite_pipelines(app);
+    brl_startup_mark(app, "sprite pipelines", start, 1);
+  }
+
+  brl_file_close(vertex);
+  brl_file_close(fragment);
+  return NULL;
 }
 
-void brl_create_sync_objects(brl_app *app)
+/**
+ * Everything sized after the swapchain, plus the per-frame command
+ * and sync objects. Runs on the main thread while the pipeline is
+ * compiled on a worker.
+ **/
+VkResult brl_create_swp_objects(brl_app *app, VkPhysicalDevice physical_device)
 {
-  VkSemaphoreCreateInfo semaphore_create_info = {
-      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
-  };
+  // Offscreen images are created per frame in flight.
+  brl_pick_frames_in_flight(app);
+  BRL_STAGE(app, "swapchain", brl_create_swp(app, physical_device, VK_NULL_HANDLE));
+  BRL_STAGE(app, "swapchain image views", brl_create_image_views(app));
+  BRL_STAGE(app, "scene targets", brl_create_scene_targets(app, physical_device));
+  BRL_STAGE(app, "post targets", brl_create_post_targets(app, physical_device));
+  if (!app->vk_dynamic_rendering)
+    BRL_STAGE(app, "frame buffers", brl_create_frame_buffer(app));
+  BRL_STAGE(app, "command pool", brl_create_command_pool(app, physical_device));
+  BRL_STAGE(app, "command buffers", brl_create_command_buffer(app));
+  BRL_STAGE(app, "sync objects", brl_create_sync_objects(app));
+  BRL_STAGE(app, "extra windows", brl_create_window_objects(app, physical_device));
+  BRL_STAGE(app, "sprite buffers", brl_create_sprite_buffers(app, physical_device));
+  return VK_SUCCESS;
+}
 
-  VkFenceCreateInfo fence_create_info = {
-      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-      .flags = VK_FENCE_CREATE_SIGNALED_BIT,
-  };
+/**
+ * Everything from the logical device down, this is the part that is
+ * created again after a device loss.
+ *
+ * Once the surface format and the render pass are known the pipeline
+ * no longer depends on anything else, so it is compiled on a worker
+ * thread while the swapchain and the per-frame objects are created.
+ **/
+VkResult brl_create_device_objects(brl_app *app)
+{
+  VkPhysicalDevice physical_device;
+  BRL_STAGE(app, "pick physical device", brl_pick_physical_device(app, &physical_device));
+  BRL_STAGE(app, "logical device", brl_create_logical_device(app, physical_device));
+  brl_set_device_queue(app, physical_device);
+  brl_set_present_queue(app, physical_device);
+  BRL_CHECK(brl_pick_msaa_samples(app, physical_device));
+  brl_pick_swp_format(app, physical_device);
+  brl_pick_capture(app);
+  if (!app->vk_dynamic_rendering)
+    BRL_STAGE(app, "render pass", brl_create_render_pass(app));
+  BRL_STAGE(app, "texture descriptors", brl_create_texture_objects(app));
+  BRL_STAGE(app, "post layouts", brl_create_post_layouts(app));
+#ifdef BRL_PROFILE
+  BRL_STAGE(app, "gpu profiler", brl_create_gpu_profiler(app));
+#endif
+
+  int pipeline_threaded = pthread_create(&app->vk_pipeline_worker, NULL, brl_pipeline_worker_main, app) == 0;
+  if (!pipeline_threaded)
+    brl_pipeline_worker_main(app);
 
-  VkSemaphore sema_image_available = malloc(sizeof(VkSemaphore));
-  VkSemaphore sema_render_finished = malloc(sizeof(VkSemaphore));
-  VkFence fence = malloc(sizeof(VkFence));
-  int fail = 0;
-  if (vkCreateSemaphore(app->vk_device, &semaphore_create_info, NULL, &sema_image_available) != VK_SUCCESS)
-    fail = 1;
+  VkResult result = brl_create_swp_objects(app, physical_device);
 
-  if (vkCreateSemaphore(app->vk_device, &semaphore_create_info, NULL, &sema_render_finished) != VK_SUCCESS)
-    fail = 1;
+  if (pipeline_threaded)
+    pthread_join(app->vk_pipeline_worker, NULL);
+  if (result == VK_SUCCESS)
+    result = app->pipeline_result;
+  if (result != VK_SUCCESS)
+    return result;
 
-  if (vkCreateFence(app->vk_device, &fence_create_info, NULL, &fence) != VK_SUCCESS)
-    fail = 1;
+  BRL_STAGE(app, "textures", brl_restore_textures(app));
 
-  if (fail)
-    brl_exit_error("Failed to create semaphores / fences");
+  app->present_id = 0;
+  app->current_frame = 0;
+  app->vk_result = VK_SUCCESS;
+  return VK_SUCCESS;
+}
 
-  app->sema_image_available = sema_image_available;
-  app->sema_render_finished = sema_render_finished;
-  app->fence_in_flight = fence;
+/**
+ * Compute-only counterpart of brl_create_device_objects: the device,
+ * a queue of the compute family and what brl_dispatch records into.
+ * Kernels and storage buffers are created by the app, usually from
+ * its init callback.
+ **/
+VkResult brl_create_compute_objects(brl_app *app)
+{
+  VkPhysicalDevice physical_device;
+  BRL_STAGE(app, "pick physical device", brl_pick_physical_device(app, &physical_device));
+  BRL_STAGE(app, "logical device", brl_create_logical_device(app, physical_device));
+  brl_set_device_queue(app, physical_device);
+
+  // Dispatches are waited on, there is never more than one batch.
+  app->vk_frames_in_flight = 1;
+  app->current_frame = 0;
+  BRL_STAGE(app, "command pool", brl_create_command_pool(app, physical_device));
+  BRL_STAGE(app, "command buffers", brl_create_command_buffer(app));
+  BRL_STAGE(app, "dispatch objects", brl_create_dispatch_objects(app));
+
+  app->vk_result = VK_SUCCESS;
+  return VK_SUCCESS;
 }
 
-void brl_recreate_swp(brl_app *app, VkPhysicalDevice physical_device)
+VkResult brl_init_app(brl_app *app)
 {
-  vkDeviceWaitIdle(app->vk_device);
-  brl_create_swp(app, physical_device);
-  brl_create_image_views(app);
-  brl_create_frame_buffer(app);
+  if (!app->compute_only)
+    brl_start_shader_loader(app);
+
+  VkResult result = VK_SUCCESS;
+  double start = brl_time_seconds();
+  result = brl_create_instance(app);
+  brl_startup_mark(app, "instance", start, 0);
+
+  if (result == VK_SUCCESS && !app->offscreen)
+  {
+    start = brl_time_seconds();
+    result = brl_create_window_surface(app);
+    brl_startup_mark(app, "window surface", start, 0);
+  }
+
+  if (result == VK_SUCCESS && app->windows_count)
+  {
+    start = brl_time_seconds();
+    result = brl_create_window_surfaces(app);
+    brl_startup_mark(app, "extra window surfaces", start, 0);
+  }
+
+  if (result == VK_SUCCESS)
+    result = app->compute_only ? brl_create_compute_objects(app) : brl_create_device_objects(app);
+
+  // Only left over when creation failed before the pipeline worker.
+  if (app->shaders_loading)
+  {
+    pthread_join(app->vk_shader_loader, NULL);
+    app->shaders_loading = 0;
+  }
+  brl_file_close(app->shader_files[0]);
+  brl_file_close(app->shader_files[1]);
+  app->shader_files[0] = (brl_file){0};
+  app->shader_files[1] = (brl_file){0};
+
+  return result;
 }
 
-void brl_create_app(brl_app app)
+VkResult brl_create_app(brl_app app)
 {
   printf("Welcome to Boreal!\n\n");
-  glfwInit();
-  glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-  glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
-  app.window = glfwCreateWindow(app.width, app.height, "BOREAL APP", NULL, NULL);
+#ifdef BRL_PROFILE
+  brl_profile_open();
+  BRL_PROFILE_THREAD("main");
+#endif
+  app.startup_time = brl_time_seconds();
+  atomic_init(&app.startup_stage_count, 0);
+
+  atomic_init(&app.closing, 0);
+  pthread_mutex_init(&app.capture_lock, NULL);
+  pthread_cond_init(&app.capture_wake, NULL);
+
+  // Compute-only runs without a window, like offscreen rendering.
+  app.offscreen = app.offscreen || app.compute_only;
+  if (app.offscreen && app.windows_count)
+    printf("BOREAL_WARNING: Extra windows are ignored offscreen.\n");
+  else if (app.windows_count > BRL_MAX_WINDOWS)
+    printf("BOREAL_WARNING: Only %d extra windows are supported.\n", BRL_MAX_WINDOWS);
+  app.windows_count = app.offscreen ? 0 : app.windows_count;
+  app.windows_count = app.windows_count < BRL_MAX_WINDOWS ? app.windows_count : BRL_MAX_WINDOWS;
+
+  double start = brl_time_seconds();
+  if (!app.offscreen)
+  {
+    glfwInit();
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    app.window = glfwCreateWindow(app.width, app.height, "BOREAL APP", NULL, NULL);
+    brl_open_windows(&app);
+    brl_startup_mark(&app, "window", start, 0);
+  }
 
-#ifndef BRL_NDEBUG
+  // Enumerating every instance extension is slow and only useful
+  // when debugging the driver setup, so it is opt-in.
+#ifdef BRL_LIST_EXTENSIONS
   brl_list_available_extensions();
 #endif
 
-  brl_create_instance(&app);
-  brl_create_window_surface(&app);
-  VkPhysicalDevice physical_device = brl_pick_physical_device(&app);
-  brl_create_logical_device(&app, physical_device);
-  brl_set_device_queue(&app, physical_device);
-  brl_set_present_queue(&app, physical_device);
-  brl_create_swp(&app, physical_device);
-  brl_create_image_views(&app);
-  brl_create_render_pass(&app);
-  brl_create_gfx_pipeline(&app);
-  brl_create_frame_buffer(&app);
-  brl_create_command_pool(&app, physical_device);
-  brl_create_command_buffer(&app);
-  brl_create_sync_objects(&app);
-
-  if (app.init)
-    app.init(&app);
-
-  while (!glfwWindowShouldClose(app.window))
+  VkResult result = brl_init_app(&app);
+  brl_startup_report(&app);
+  if (result == VK_SUCCESS)
   {
-    glfwPollEvents();
-    if (app.loop)
-      app.loop(&app);
+    brl_snapshot_init(&app.frame_snapshot, app.frame_state_size);
+
+    if (app.init)
+      app.init(&app);
+
+    if (app.render_thread)
+      result = brl_run_threaded(&app);
+    else
+      result = brl_run(&app);
+
+    vkDeviceWaitIdle(app.vk_device);
+    brl_stop_capture_worker(&app);
+    brl_snapshot_free(&app.frame_snapshot);
+    brl_memory_report(&app);
+    brl_window_report(&app);
+    brl_readback_report(&app);
+  }
+  else
+  {
+    brl_error("Failed to initialize Boreal.", result);
   }
 
   brl_free_app(app);
-  glfwDestroyWindow(app.window);
-  glfwTerminate();
+  brl_report_leaks();
+  if (!app.offscreen)
+  {
+    brl_close_windows(&app);
+    glfwDestroyWindow(app.window);
+    glfwTerminate();
+  }
 
   if (app.clean)
     app.clean(&app);
+
+  pthread_cond_destroy(&app.capture_wake);
+  pthread_mutex_destroy(&app.capture_lock);
+#ifdef BRL_PROFILE
+  brl_profile_close();
+#endif
+  return result;
 }
+
 #endif
-#endif
\ No newline at end of file
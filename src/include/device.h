@@ -0,0 +1,200 @@
+#ifndef BRL_DEVICE
+#define BRL_DEVICE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <vulkan/vulkan.h>
+
+#define BRL_MAX_QUEUE_FAMILIES 16
+#define BRL_DEVICE_ENV "BRL_DEVICE"
+
+/**
+ * Everything the selection policy looks at, copied out of Vulkan so
+ * the scoring never calls the driver. Tests and tools can fill this
+ * with synthetic tables and run brl_score_device/brl_select_device on
+ * them directly.
+ **/
+typedef struct brl_device_info
+{
+  VkPhysicalDeviceProperties properties;
+  VkPhysicalDeviceMemoryProperties memory;
+  VkPhysicalDeviceFeatures features;
+  uint8_t uuid[VK_UUID_SIZE];
+  int has_uuid;
+  uint32_t queue_family_count;
+  VkQueueFamilyProperties queue_families[BRL_MAX_QUEUE_FAMILIES];
+  VkBool32 present_support[BRL_MAX_QUEUE_FAMILIES];
+  int extensions_supported;
+  int surface_supported;
+  // Only a compute queue is needed, graphics and present are not.
+  int compute_only;
+} brl_device_info;
+
+VkDeviceSize brl_device_local_memory(const brl_device_info *info);
+int64_t brl_score_device(const brl_device_info *info);
+int brl_parse_uuid(const char *text, uint8_t uuid[VK_UUID_SIZE]);
+int brl_select_device(const brl_device_info *infos, uint32_t count, const char *selector);
+
+#endif
+
+#if defined(BRL_IMPLEMENTATION) && !defined(BRL_DEVICE_IMPLEMENTATION)
+#define BRL_DEVICE_IMPLEMENTATION
+
+VkDeviceSize brl_device_local_memory(const brl_device_info *info)
+{
+  VkDeviceSize largest = 0;
+  for (uint32_t i = 0; i < info->memory.memoryHeapCount; i++)
+  {
+    VkMemoryHeap heap = info->memory.memoryHeaps[i];
+    if ((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && heap.size > largest)
+      largest = heap.size;
+  }
+
+  return largest;
+}
+
+/**
+ * Returns -1 when the device cannot run Boreal at all, otherwise a
+ * score where the device type always dominates, then the amount of
+ * device local memory, then features, limits and queue layout.
+ **/
+int64_t brl_score_device(const brl_device_info *info)
+{
+  if (!info->extensions_supported || !info->surface_supported)
+    return -1;
+
+  int has_graphics = 0, has_present = 0, has_combined = 0;
+  int has_compute = 0, has_async_compute = 0, has_transfer = 0;
+  for (uint32_t i = 0; i < info->queue_family_count; i++)
+  {
+    VkQueueFlags flags = info->queue_families[i].queueFlags;
+    int graphics = (flags & VK_QUEUE_GRAPHICS_BIT) != 0;
+    has_graphics |= graphics;
+    has_present |= info->present_support[i];
+    has_combined |= graphics && info->present_support[i];
+    has_compute |= (flags & VK_QUEUE_COMPUTE_BIT) != 0;
+    has_async_compute |= (flags & VK_QUEUE_COMPUTE_BIT) && !graphics;
+    has_transfer |= (flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT));
+  }
+
+  if (info->compute_only ? !has_compute : (!has_graphics || !has_present))
+    return -1;
+
+  int64_t score = 0;
+  switch (info->properties.deviceType)
+  {
+  case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+    score += 4000000000LL;
+    break;
+  case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+    score += 3000000000LL;
+    break;
+  case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+    score += 2000000000LL;
+    break;
+  case VK_PHYSICAL_DEVICE_TYPE_OTHER:
+    score += 1000000000LL;
+    break;
+  default:
+    // Software rasterizers only win when nothing else is there.
+    break;
+  }
+
+  // In MiB, a 1 TiB heap still stays below one device type step.
+  score += (int64_t)(brl_device_local_memory(info) >> 20) * 100;
+
+  VkPhysicalDeviceFeatures features = info->features;
+  score += features.samplerAnisotropy ? 10000 : 0;
+  score += features.sampleRateShading ? 5000 : 0;
+  score += features.geometryShader ? 2000 : 0;
+
+  VkPhysicalDeviceLimits limits = info->properties.limits;
+  score += limits.maxImageDimension2D;
+  score += (limits.framebufferColorSampleCounts & VK_SAMPLE_COUNT_8_BIT) ? 5000 : 0;
+
+  score += has_combined ? 20000 : 0;
+  score += has_async_compute ? 5000 : 0;
+  score += has_transfer ? 5000 : 0;
+  return score;
+}
+
+/**
+ * Parses a 32 digit hexadecimal UUID, dashes are ignored so both the
+ * raw and the canonical 8-4-4-4-12 forms are accepted.
+ **/
+int brl_parse_uuid(const char *text, uint8_t uuid[VK_UUID_SIZE])
+{
+  int digits = 0;
+  for (const char *c = text; *c; c++)
+  {
+    if (*c == '-')
+      continue;
+    if (!isxdigit((unsigned char)*c) || digits >= VK_UUID_SIZE * 2)
+      return 0;
+
+    int value = isdigit((unsigned char)*c) ? *c - '0' : tolower((unsigned char)*c) - 'a' + 10;
+    if (digits % 2 == 0)
+      uuid[digits / 2] = value << 4;
+    else
+      uuid[digits / 2] |= value;
+    digits++;
+  }
+
+  return digits == VK_UUID_SIZE * 2;
+}
+
+/**
+ * Picks a device out of the table. The selector is either a device
+ * index or a device UUID, as given through the BRL_DEVICE environment
+ * variable. A selector that does not match a usable device is
+ * reported and the best scored device is used instead.
+ *
+ * Returns -1 when no device is usable.
+ **/
+int brl_select_device(const brl_device_info *infos, uint32_t count, const char *selector)
+{
+  if (selector != NULL && *selector != '\0')
+  {
+    int selected = -1;
+    uint8_t uuid[VK_UUID_SIZE];
+    char *end = NULL;
+    long index = strtol(selector, &end, 10);
+
+    if (*end == '\0' && index >= 0 && index < count)
+    {
+      selected = index;
+    }
+    else if (brl_parse_uuid(selector, uuid))
+    {
+      for (uint32_t i = 0; i < count; i++)
+      {
+        if (infos[i].has_uuid && memcmp(infos[i].uuid, uuid, VK_UUID_SIZE) == 0)
+          selected = i;
+      }
+    }
+
+    if (selected != -1 && brl_score_device(&infos[selected]) >= 0)
+      return selected;
+
+    printf("BOREAL_WARNING: %s=%s does not match a usable device, picking by score.\n", BRL_DEVICE_ENV, selector);
+  }
+
+  int best = -1;
+  int64_t best_score = -1;
+  for (uint32_t i = 0; i < count; i++)
+  {
+    int64_t score = brl_score_device(&infos[i]);
+    if (score > best_score)
+    {
+      best = i;
+      best_score = score;
+    }
+  }
+
+  return best;
+}
+
+#endif
@@ -10,18 +10,30 @@ typedef struct brl_file
   size_t size;
 } brl_file;
 
+brl_file brl_read(char *file_path);
+void brl_file_close(brl_file file);
+
+#endif
+
+#if defined(BRL_IMPLEMENTATION) && !defined(BRL_FILE_IMPLEMENTATION)
+#define BRL_FILE_IMPLEMENTATION
+
 /**
- * You must free the data pointer after reading the file.
+ * You must free the data pointer after reading the file. The data
+ * pointer is NULL when the file could not be opened.
  **/
 brl_file brl_read(char *file_path)
 {
   FILE *file = fopen(file_path, "rb");
+  if (file == NULL)
+    return (brl_file){0};
+
   fseek(file, 0L, SEEK_END);
   size_t size = ftell(file);
   fseek(file, 0, SEEK_SET);
 
   char *data = (char *)malloc(sizeof(char) * size + 1);
-  fread(data, size, size, file);
+  size = fread(data, 1, size, file);
   fclose(file);
 
   return (brl_file){
@@ -35,4 +47,4 @@ void brl_file_close(brl_file file)
   free(file.data);
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,273 @@
+#ifndef BRL_IMAGE
+#define BRL_IMAGE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+/**
+ * Just enough PNG for frame dumps and golden images: 8 bit RGBA is
+ * written, 8 bit RGB and RGBA non-interlaced files are read. zlib does
+ * the deflate part.
+ **/
+
+typedef struct brl_image_diff
+{
+  uint32_t mismatched;
+  uint32_t max_difference;
+} brl_image_diff;
+
+int brl_png_write(const char *path, const void *pixels, uint32_t width, uint32_t height);
+uint8_t *brl_png_read(const char *path, uint32_t *width, uint32_t *height);
+brl_image_diff brl_image_compare(const uint8_t *a, const uint8_t *b, uint32_t width, uint32_t height, uint32_t tolerance, uint8_t *diff);
+
+#endif
+
+#if defined(BRL_IMPLEMENTATION) && !defined(BRL_IMAGE_IMPLEMENTATION)
+#define BRL_IMAGE_IMPLEMENTATION
+
+static const uint8_t brl_png_signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+static inline uint32_t brl_png_u32(const uint8_t *data)
+{
+  return (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 | (uint32_t)data[2] << 8 | (uint32_t)data[3];
+}
+
+static inline void brl_png_put_u32(uint8_t *data, uint32_t value)
+{
+  data[0] = value >> 24;
+  data[1] = value >> 16;
+  data[2] = value >> 8;
+  data[3] = value;
+}
+
+static int brl_png_write_chunk(FILE *file, const char *type, const uint8_t *data, uint32_t size)
+{
+  uint8_t header[8];
+  brl_png_put_u32(header, size);
+  memcpy(header + 4, type, 4);
+
+  uint8_t footer[4];
+  uLong crc = crc32(0, (const Bytef *)type, 4);
+  if (size)
+    crc = crc32(crc, data, size);
+  brl_png_put_u32(footer, crc);
+
+  return fwrite(header, 1, 8, file) == 8 && (size == 0 || fwrite(data, 1, size, file) == size) &&
+         fwrite(footer, 1, 4, file) == 4;
+}
+
+/**
+ * Writes width * height RGBA8 pixels, top row first. Every row uses
+ * the Sub filter, which is cheap and compresses flat areas well.
+ * Returns 0 on success.
+ **/
+int brl_png_write(const char *path, const void *pixels, uint32_t width, uint32_t height)
+{
+  size_t stride = (size_t)width * 4;
+  size_t raw_size = (stride + 1) * height;
+  uint8_t *raw = malloc(raw_size);
+  uLongf packed_size = compressBound(raw_size);
+  uint8_t *packed = malloc(packed_size);
+  if (raw == NULL || packed == NULL)
+  {
+    free(raw);
+    free(packed);
+    return -1;
+  }
+
+  const uint8_t *src = pixels;
+  for (uint32_t y = 0; y < height; y++)
+  {
+    uint8_t *row = raw + y * (stride + 1);
+    const uint8_t *line = src + y * stride;
+    row[0] = 1;
+    for (size_t x = 0; x < stride; x++)
+      row[1 + x] = line[x] - (x >= 4 ? line[x - 4] : 0);
+  }
+
+  int result = compress2(packed, &packed_size, raw, raw_size, 6) == Z_OK ? 0 : -1;
+  free(raw);
+
+  FILE *file = result == 0 ? fopen(path, "wb") : NULL;
+  if (file == NULL)
+  {
+    free(packed);
+    return -1;
+  }
+
+  // Width, height, bit depth 8, color type 6 (RGBA), deflate, adaptive
+  // filtering, no interlace.
+  uint8_t ihdr[13] = {0, 0, 0, 0, 0, 0, 0, 0, 8, 6, 0, 0, 0};
+  brl_png_put_u32(ihdr, width);
+  brl_png_put_u32(ihdr + 4, height);
+
+  int written = fwrite(brl_png_signature, 1, 8, file) == 8 &&
+                brl_png_write_chunk(file, "IHDR", ihdr, sizeof(ihdr)) &&
+                brl_png_write_chunk(file, "IDAT", packed, packed_size) &&
+                brl_png_write_chunk(file, "IEND", NULL, 0);
+  free(packed);
+  return fclose(file) == 0 && written ? 0 : -1;
+}
+
+static inline uint8_t brl_png_paeth(int a, int b, int c)
+{
+  int p = a + b - c;
+  int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  if (pa <= pb && pa <= pc)
+    return a;
+  return pb <= pc ? b : c;
+}
+
+/**
+ * Reads a PNG into newly allocated RGBA8 pixels, NULL when the file is
+ * missing or in a layout this reader does not handle.
+ **/
+uint8_t *brl_png_read(const char *path, uint32_t *width, uint32_t *height)
+{
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return NULL;
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  uint8_t *data = size > 0 ? malloc(size) : NULL;
+  int read = data && fread(data, 1, size, file) == (size_t)size;
+  fclose(file);
+  if (!read || size < 8 + 25 || memcmp(data, brl_png_signature, 8) != 0)
+  {
+    free(data);
+    return NULL;
+  }
+
+  uint32_t w = 0, h = 0, channels = 0;
+  uint8_t *packed = malloc(size);
+  size_t packed_size = 0;
+  int valid = 0;
+
+  for (long offset = 8; offset + 12 <= size;)
+  {
+    uint32_t length = brl_png_u32(data + offset);
+    const uint8_t *type = data + offset + 4;
+    const uint8_t *chunk = data + offset + 8;
+    if (length > (uint64_t)size - offset - 12)
+      break;
+
+    if (memcmp(type, "IHDR", 4) == 0 && length == 13)
+    {
+      w = brl_png_u32(chunk);
+      h = brl_png_u32(chunk + 4);
+      channels = chunk[9] == 6 ? 4 : chunk[9] == 2 ? 3 : 0;
+      if (chunk[8] != 8 || chunk[12] != 0)
+        channels = 0;
+    }
+    else if (memcmp(type, "IDAT", 4) == 0)
+    {
+      memcpy(packed + packed_size, chunk, length);
+      packed_size += length;
+    }
+    else if (memcmp(type, "IEND", 4) == 0)
+    {
+      valid = channels != 0 && w != 0 && h != 0;
+      break;
+    }
+    offset += 12 + length;
+  }
+  free(data);
+
+  size_t stride = (size_t)w * channels;
+  uLongf raw_size = (stride + 1) * h;
+  uint8_t *raw = valid ? malloc(raw_size) : NULL;
+  uint8_t *pixels = valid ? malloc((size_t)w * h * 4) : NULL;
+  if (!valid || raw == NULL || pixels == NULL ||
+      uncompress(raw, &raw_size, packed, packed_size) != Z_OK || raw_size != (stride + 1) * h)
+  {
+    free(packed);
+    free(raw);
+    free(pixels);
+    return NULL;
+  }
+  free(packed);
+
+  // Filters work on bytes, a is the byte one pixel to the left, b the
+  // one above and c above the left one.
+  for (uint32_t y = 0; y < h; y++)
+  {
+    uint8_t filter = raw[y * (stride + 1)];
+    uint8_t *row = raw + y * (stride + 1) + 1;
+    uint8_t *previous = y ? row - (stride + 1) : NULL;
+    for (size_t x = 0; x < stride; x++)
+    {
+      int a = x >= channels ? row[x - channels] : 0;
+      int b = previous ? previous[x] : 0;
+      int c = previous && x >= channels ? previous[x - channels] : 0;
+      switch (filter)
+      {
+      case 1:
+        row[x] += a;
+        break;
+      case 2:
+        row[x] += b;
+        break;
+      case 3:
+        row[x] += (a + b) / 2;
+        break;
+      case 4:
+        row[x] += brl_png_paeth(a, b, c);
+        break;
+      }
+    }
+
+    for (uint32_t x = 0; x < w; x++)
+    {
+      uint8_t *out = pixels + ((size_t)y * w + x) * 4;
+      memcpy(out, row + x * channels, channels);
+      if (channels == 3)
+        out[3] = 255;
+    }
+  }
+
+  free(raw);
+  *width = w;
+  *height = h;
+  return pixels;
+}
+
+/**
+ * Compares two RGBA8 images of the same size. A pixel mismatches when
+ * any channel is more than tolerance apart. When diff is not NULL it
+ * receives an image with mismatching pixels in red over a dimmed copy
+ * of a.
+ **/
+brl_image_diff brl_image_compare(const uint8_t *a, const uint8_t *b, uint32_t width, uint32_t height, uint32_t tolerance, uint8_t *diff)
+{
+  brl_image_diff result = {0};
+  for (size_t i = 0; i < (size_t)width * height; i++)
+  {
+    uint32_t difference = 0;
+    for (int c = 0; c < 4; c++)
+    {
+      uint32_t d = abs((int)a[i * 4 + c] - (int)b[i * 4 + c]);
+      difference = d > difference ? d : difference;
+    }
+
+    result.max_difference = difference > result.max_difference ? difference : result.max_difference;
+    if (difference > tolerance)
+      result.mismatched++;
+
+    if (diff)
+    {
+      uint8_t gray = (a[i * 4] + a[i * 4 + 1] + a[i * 4 + 2]) / 12;
+      diff[i * 4] = difference > tolerance ? 255 : gray;
+      diff[i * 4 + 1] = difference > tolerance ? 0 : gray;
+      diff[i * 4 + 2] = difference > tolerance ? 0 : gray;
+      diff[i * 4 + 3] = 255;
+    }
+  }
+  return result;
+}
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef BRL_KTX2
+#define BRL_KTX2
+
+#include <stdint.h>
+#include <string.h>
+#include <vulkan/vulkan.h>
+
+#define BRL_KTX2_MAX_LEVELS 16
+#define BRL_KTX2_HEADER_SIZE 80
+#define BRL_KTX2_LEVEL_SIZE 24
+
+/**
+ * A parsed KTX2 file. Levels point into the file data, nothing is
+ * copied or decoded: the level data goes to the staging buffer as is.
+ *
+ * A level_count of 0 in the file means the mip chain is expected to
+ * be generated at load time, generate_mips is then set and only level
+ * 0 is present.
+ **/
+typedef struct brl_ktx2_level
+{
+  const uint8_t *data;
+  uint64_t size;
+} brl_ktx2_level;
+
+typedef struct brl_ktx2
+{
+  VkFormat format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t level_count;
+  int generate_mips;
+  brl_ktx2_level levels[BRL_KTX2_MAX_LEVELS];
+} brl_ktx2;
+
+int brl_format_is_bc(VkFormat format);
+int brl_format_is_astc(VkFormat format);
+int brl_format_is_compressed(VkFormat format);
+const char *brl_ktx2_parse(const uint8_t *data, uint64_t size, brl_ktx2 *ktx);
+
+#endif
+
+#if defined(BRL_IMPLEMENTATION) && !defined(BRL_KTX2_IMPLEMENTATION)
+#define BRL_KTX2_IMPLEMENTATION
+
+static const uint8_t brl_ktx2_identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+static inline uint32_t brl_ktx2_u32(const uint8_t *data)
+{
+  return (uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static inline uint64_t brl_ktx2_u64(const uint8_t *data)
+{
+  return (uint64_t)brl_ktx2_u32(data) | (uint64_t)brl_ktx2_u32(data + 4) << 32;
+}
+
+/**
+ * Block compressed formats Boreal knows the feature bit of, anything
+ * else is treated as a plain color format.
+ **/
+int brl_format_is_bc(VkFormat format)
+{
+  return format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK;
+}
+
+int brl_format_is_astc(VkFormat format)
+{
+  return format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK;
+}
+
+int brl_format_is_compressed(VkFormat format)
+{
+  return brl_format_is_bc(format) || brl_format_is_astc(format);
+}
+
+/**
+ * Only the parts of KTX2 a 2D texture needs: a single layer, a single
+ * face, no supercompression (Basis and zstd would need a CPU decode).
+ * Returns a message describing the first problem found, NULL when the
+ * file is usable.
+ **/
+const char *brl_ktx2_parse(const uint8_t *data, uint64_t size, brl_ktx2 *ktx)
+{
+  if (size < BRL_KTX2_HEADER_SIZE || memcmp(data, brl_ktx2_identifier, sizeof(brl_ktx2_identifier)) != 0)
+    return "not a KTX2 file";
+
+  memset(ktx, 0, sizeof(brl_ktx2));
+  ktx->format = brl_ktx2_u32(data + 12);
+  ktx->width = brl_ktx2_u32(data + 20);
+  ktx->height = brl_ktx2_u32(data + 24);
+  uint32_t depth = brl_ktx2_u32(data + 28);
+  uint32_t layers = brl_ktx2_u32(data + 32);
+  uint32_t faces = brl_ktx2_u32(data + 36);
+  uint32_t levels = brl_ktx2_u32(data + 40);
+  uint32_t supercompression = brl_ktx2_u32(data + 44);
+
+  if (ktx->format == VK_FORMAT_UNDEFINED)
+    return "format is undefined (Basis Universal is not supported)";
+  if (supercompression != 0)
+    return "supercompressed data is not supported";
+  if (ktx->width == 0 || ktx->height == 0 || depth > 1 || layers > 1 || faces != 1)
+    return "only single layer 2D textures are supported";
+  if (levels > BRL_KTX2_MAX_LEVELS)
+    return "too many mip levels";
+
+  ktx->generate_mips = levels == 0;
+  ktx->level_count = levels ? levels : 1;
+  if (size < BRL_KTX2_HEADER_SIZE + (uint64_t)ktx->level_count * BRL_KTX2_LEVEL_SIZE)
+    return "truncated level index";
+
+  for (uint32_t i = 0; i < ktx->level_count; i++)
+  {
+    const uint8_t *entry = data + BRL_KTX2_HEADER_SIZE + i * BRL_KTX2_LEVEL_SIZE;
+    uint64_t offset = brl_ktx2_u64(entry);
+    uint64_t length = brl_ktx2_u64(entry + 8);
+    if (length == 0 || offset > size || length > size - offset)
+      return "level data out of bounds";
+
+    ktx->levels[i].data = data + offset;
+    ktx->levels[i].size = length;
+  }
+
+  return NULL;
+}
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef BRL_PROFILE_H
+#define BRL_PROFILE_H
+
+/**
+ * Scoped CPU zones exported as a Chrome trace (chrome://tracing,
+ * Perfetto). Everything is compiled out unless BRL_PROFILE is
+ * defined: the zone macros expand to nothing and no clock is read.
+ *
+ * Each thread writes its zones into its own ring buffer, with a single
+ * producer and a single consumer neither side takes a lock. The thread
+ * calling brl_profile_flush is the consumer and writes the drained
+ * zones to the trace file. A full ring drops zones rather than
+ * blocking the producer, the count is reported at close.
+ **/
+
+#ifdef BRL_PROFILE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#define BRL_PROFILE_RING_SIZE 8192
+#define BRL_PROFILE_MAX_THREADS 16
+#define BRL_PROFILE_PATH_ENV "BRL_PROFILE_PATH"
+#define BRL_PROFILE_DEFAULT_PATH "boreal_trace.json"
+
+typedef struct brl_profile_event
+{
+  const char *name;
+  uint64_t start;
+  uint64_t end;
+} brl_profile_event;
+
+typedef struct brl_profile_ring
+{
+  brl_profile_event events[BRL_PROFILE_RING_SIZE];
+  atomic_uint head;
+  atomic_uint tail;
+  atomic_uint dropped;
+  const char *name;
+  uint32_t id;
+  int named;
+} brl_profile_ring;
+
+typedef struct brl_profiler
+{
+  _Atomic(brl_profile_ring *) rings[BRL_PROFILE_MAX_THREADS];
+  atomic_uint ring_count;
+  FILE *file;
+  int events_written;
+  uint64_t origin;
+} brl_profiler;
+
+extern brl_profiler brl_profile;
+extern _Thread_local brl_profile_ring *brl_profile_thread_ring;
+
+static inline uint64_t brl_profile_now()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+brl_profile_ring *brl_profile_add_ring(const char *name);
+void brl_profile_thread(const char *name);
+void brl_profile_record(brl_profile_ring *ring, const char *name, uint64_t start, uint64_t end);
+void brl_profile_open();
+void brl_profile_write(const char *event);
+void brl_profile_flush();
+void brl_profile_close();
+
+typedef struct brl_profile_zone
+{
+  const char *name;
+  uint64_t start;
+} brl_profile_zone;
+
+static inline void brl_profile_zone_end(brl_profile_zone *zone)
+{
+  if (brl_profile_thread_ring == NULL)
+    brl_profile_thread_ring = brl_profile_add_ring(NULL);
+  brl_profile_record(brl_profile_thread_ring, zone->name, zone->start, brl_profile_now());
+}
+
+#define BRL_PROFILE_CONCAT_(a, b) a##b
+#define BRL_PROFILE_CONCAT(a, b) BRL_PROFILE_CONCAT_(a, b)
+
+// Ends with the enclosing scope, through the cleanup attribute of
+// GCC and Clang.
+#define BRL_ZONE(name)                                   \
+  brl_profile_zone BRL_PROFILE_CONCAT(brl_zone_, __LINE__) \
+      __attribute__((cleanup(brl_profile_zone_end))) = {name, brl_profile_now()}
+#define BRL_ZONE_FUNCTION() BRL_ZONE(__func__)
+#define BRL_PROFILE_THREAD(name) brl_profile_thread(name)
+
+#else
+
+#define BRL_ZONE(name) ((void)0)
+#define BRL_ZONE_FUNCTION() ((void)0)
+#define BRL_PROFILE_THREAD(name) ((void)0)
+
+#endif
+
+#endif
+
+#if defined(BRL_PROFILE) && defined(BRL_IMPLEMENTATION) && !defined(BRL_PROFILE_IMPLEMENTATION)
+#define BRL_PROFILE_IMPLEMENTATION
+
+brl_profiler brl_profile;
+_Thread_local brl_profile_ring *brl_profile_thread_ring;
+
+/**
+ * Claims a ring slot, rings live until the process exits since the
+ * consumer may still be reading them when their thread is gone.
+ **/
+brl_profile_ring *brl_profile_add_ring(const char *name)
+{
+  unsigned int id = atomic_fetch_add(&brl_profile.ring_count, 1);
+  if (id >= BRL_PROFILE_MAX_THREADS)
+    return NULL;
+
+  brl_profile_ring *ring = calloc(1, sizeof(brl_profile_ring));
+  ring->name = name;
+  ring->id = id;
+  atomic_store_explicit(&brl_profile.rings[id], ring, memory_order_release);
+  return ring;
+}
+
+/**
+ * Names the calling thread in the trace, must come before its first
+ * zone to take effect.
+ **/
+void brl_profile_thread(const char *name)
+{
+  if (brl_profile_thread_ring == NULL)
+    brl_profile_thread_ring = brl_profile_add_ring(name);
+}
+
+void brl_profile_record(brl_profile_ring *ring, const char *name, uint64_t start, uint64_t end)
+{
+  if (ring == NULL)
+    return;
+
+  unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  if (head - tail >= BRL_PROFILE_RING_SIZE)
+  {
+    atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+    return;
+  }
+
+  ring->events[head & (BRL_PROFILE_RING_SIZE - 1)] = (brl_profile_event){name, start, end};
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void brl_profile_open()
+{
+  const char *path = getenv(BRL_PROFILE_PATH_ENV);
+  path = path && *path ? path : BRL_PROFILE_DEFAULT_PATH;
+  brl_profile.file = fopen(path, "w");
+  if (brl_profile.file == NULL)
+  {
+    printf("BOREAL_WARNING: Cannot open profile output %s.\n", path);
+    return;
+  }
+
+  brl_profile.origin = brl_profile_now();
+  brl_profile.events_written = 0;
+  fprintf(brl_profile.file, "[\n");
+  printf("SET: profiling to %s\n", path);
+}
+
+void brl_profile_write(const char *event)
+{
+  fprintf(brl_profile.file, "%s%s", brl_profile.events_written++ ? ",\n" : "", event);
+}
+
+/**
+ * Drains every ring into the trace. Timestamps are in microseconds
+ * from brl_profile_open, as Chrome expects.
+ **/
+void brl_profile_flush()
+{
+  if (brl_profile.file == NULL)
+    return;
+
+  unsigned int count = atomic_load(&brl_profile.ring_count);
+  count = count < BRL_PROFILE_MAX_THREADS ? count : BRL_PROFILE_MAX_THREADS;
+  char event[256];
+
+  for (unsigned int i = 0; i < count; i++)
+  {
+    brl_profile_ring *ring = atomic_load_explicit(&brl_profile.rings[i], memory_order_acquire);
+    if (ring == NULL)
+      continue;
+
+    if (!ring->named)
+    {
+      snprintf(event, sizeof(event), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+               ring->id, ring->name ? ring->name : "thread");
+      brl_profile_write(event);
+      ring->named = 1;
+    }
+
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    for (; tail != head; tail++)
+    {
+      brl_profile_event e = ring->events[tail & (BRL_PROFILE_RING_SIZE - 1)];
+      double start = e.start > brl_profile.origin ? (e.start - brl_profile.origin) / 1000.0 : 0.0;
+      double duration = e.end > e.start ? (e.end - e.start) / 1000.0 : 0.0;
+      snprintf(event, sizeof(event), "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+               e.name, ring->id, start, duration);
+      brl_profile_write(event);
+    }
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+  }
+}
+
+void brl_profile_close()
+{
+  if (brl_profile.file == NULL)
+    return;
+
+  brl_profile_flush();
+  fprintf(brl_profile.file, "\n]\n");
+  fclose(brl_profile.file);
+  brl_profile.file = NULL;
+
+  unsigned int count = atomic_load(&brl_profile.ring_count);
+  for (unsigned int i = 0; i < count && i < BRL_PROFILE_MAX_THREADS; i++)
+  {
+    brl_profile_ring *ring = atomic_load(&brl_profile.rings[i]);
+    if (ring && atomic_load(&ring->dropped))
+      printf("BOREAL_WARNING: Profiler dropped %u zones of %s.\n", atomic_load(&ring->dropped), ring->name ? ring->name : "thread");
+  }
+  if (count > BRL_PROFILE_MAX_THREADS)
+    printf("BOREAL_WARNING: Profiler only traced %d of %u threads.\n", BRL_PROFILE_MAX_THREADS, count);
+}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef BRL_SNAPSHOT
+#define BRL_SNAPSHOT
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#define BRL_SNAPSHOT_SLOTS 3
+#define BRL_SNAPSHOT_INDEX_MASK 0x3
+#define BRL_SNAPSHOT_FRESH 0x4
+
+/**
+ * Lock-free triple buffer used to hand the frame state from the
+ * simulation thread to the render thread.
+ *
+ * The writer always owns one slot and the reader another, the third
+ * one sits in the middle. Publishing swaps the writer slot with the
+ * middle one and flags it as fresh, reading swaps the middle slot
+ * with the reader one only when it is fresh. Neither side ever waits,
+ * the reader simply keeps the last published state.
+ **/
+typedef struct brl_snapshot
+{
+  char *data;
+  size_t size;
+  atomic_uint middle;
+  unsigned int write_index;
+  unsigned int read_index;
+} brl_snapshot;
+
+void brl_snapshot_init(brl_snapshot *snapshot, size_t size);
+void brl_snapshot_free(brl_snapshot *snapshot);
+void *brl_snapshot_write(brl_snapshot *snapshot);
+void brl_snapshot_publish(brl_snapshot *snapshot);
+const void *brl_snapshot_read(brl_snapshot *snapshot);
+
+#endif
+
+#if defined(BRL_IMPLEMENTATION) && !defined(BRL_SNAPSHOT_IMPLEMENTATION)
+#define BRL_SNAPSHOT_IMPLEMENTATION
+
+void brl_snapshot_init(brl_snapshot *snapshot, size_t size)
+{
+  snapshot->data = calloc(BRL_SNAPSHOT_SLOTS, size ? size : 1);
+  snapshot->size = size;
+  snapshot->write_index = 0;
+  snapshot->read_index = 1;
+  atomic_init(&snapshot->middle, 2);
+}
+
+void brl_snapshot_free(brl_snapshot *snapshot)
+{
+  free(snapshot->data);
+  snapshot->data = NULL;
+}
+
+/**
+ * Slot the writer can fill, it stays valid until the next publish.
+ **/
+void *brl_snapshot_write(brl_snapshot *snapshot)
+{
+  return snapshot->data + snapshot->write_index * snapshot->size;
+}
+
+void brl_snapshot_publish(brl_snapshot *snapshot)
+{
+  unsigned int previous = atomic_exchange_explicit(&snapshot->middle, snapshot->write_index | BRL_SNAPSHOT_FRESH, memory_order_acq_rel);
+  snapshot->write_index = previous & BRL_SNAPSHOT_INDEX_MASK;
+}
+
+/**
+ * Latest published state, it stays valid until the next read.
+ **/
+const void *brl_snapshot_read(brl_snapshot *snapshot)
+{
+  if (atomic_load_explicit(&snapshot->middle, memory_order_relaxed) & BRL_SNAPSHOT_FRESH)
+  {
+    unsigned int previous = atomic_exchange_explicit(&snapshot->middle, snapshot->read_index, memory_order_acq_rel);
+    snapshot->read_index = previous & BRL_SNAPSHOT_INDEX_MASK;
+  }
+
+  return snapshot->data + snapshot->read_index * snapshot->size;
+}
+
+#endif
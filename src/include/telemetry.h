@@ -0,0 +1,300 @@
+#ifndef BRL_TELEMETRY
+#define BRL_TELEMETRY
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <vulkan/vulkan.h>
+
+/**
+ * Host memory and object bookkeeping. Every Vulkan object Boreal
+ * creates goes through brl_allocator, so the driver's host allocations
+ * for it are counted per allocation scope, and through
+ * brl_object_created / BRL_DESTROY, so the number of live objects of
+ * each type is known at any time. A count that does not get back to 0
+ * at shutdown is a leak.
+ *
+ * Drivers call the allocator from any thread, everything here is
+ * atomic.
+ **/
+
+typedef enum brl_object_type
+{
+  BRL_OBJECT_INSTANCE,
+  BRL_OBJECT_DEVICE,
+  BRL_OBJECT_SURFACE,
+  BRL_OBJECT_SWAPCHAIN,
+  BRL_OBJECT_MEMORY,
+  BRL_OBJECT_BUFFER,
+  BRL_OBJECT_IMAGE,
+  BRL_OBJECT_IMAGE_VIEW,
+  BRL_OBJECT_SAMPLER,
+  BRL_OBJECT_SHADER_MODULE,
+  BRL_OBJECT_PIPELINE,
+  BRL_OBJECT_PIPELINE_LAYOUT,
+  BRL_OBJECT_RENDER_PASS,
+  BRL_OBJECT_FRAMEBUFFER,
+  BRL_OBJECT_COMMAND_POOL,
+  BRL_OBJECT_DESCRIPTOR_SET_LAYOUT,
+  BRL_OBJECT_DESCRIPTOR_POOL,
+  BRL_OBJECT_SEMAPHORE,
+  BRL_OBJECT_FENCE,
+  BRL_OBJECT_QUERY_POOL,
+  BRL_OBJECT_TYPE_COUNT,
+} brl_object_type;
+
+// VkSystemAllocationScope goes from COMMAND (0) to INSTANCE (4).
+#define BRL_ALLOCATION_SCOPE_COUNT 5
+
+typedef struct brl_memory_stats
+{
+  atomic_size_t host_bytes[BRL_ALLOCATION_SCOPE_COUNT];
+  atomic_size_t host_live_bytes;
+  atomic_size_t host_peak_bytes;
+  atomic_size_t host_live_allocations;
+  atomic_size_t host_allocations;
+  // Driver allocations that bypass the callbacks, only reported.
+  atomic_size_t internal_bytes;
+  atomic_int objects[BRL_OBJECT_TYPE_COUNT];
+  atomic_int peak_objects[BRL_OBJECT_TYPE_COUNT];
+} brl_memory_stats;
+
+extern brl_memory_stats brl_memory;
+
+VkResult brl_object_created(brl_object_type type, VkResult result);
+void brl_object_destroyed(brl_object_type type, int exists);
+void brl_print_host_memory();
+void brl_print_objects();
+int brl_report_leaks();
+
+static inline int brl_live_objects(brl_object_type type)
+{
+  return atomic_load_explicit(&brl_memory.objects[type], memory_order_relaxed);
+}
+
+#endif
+
+#if defined(BRL_IMPLEMENTATION) && !defined(BRL_TELEMETRY_IMPLEMENTATION)
+#define BRL_TELEMETRY_IMPLEMENTATION
+
+static const char *brl_object_type_names[BRL_OBJECT_TYPE_COUNT] = {
+    "instance", "device", "surface", "swapchain", "device memory",
+    "buffer", "image", "image view", "sampler", "shader module",
+    "pipeline", "pipeline layout", "render pass", "framebuffer",
+    "command pool", "descriptor set layout", "descriptor pool",
+    "semaphore", "fence", "query pool",
+};
+
+static const char *brl_allocation_scope_names[BRL_ALLOCATION_SCOPE_COUNT] = {
+    "command", "object", "cache", "device", "instance",
+};
+
+brl_memory_stats brl_memory;
+
+/**
+ * Sits right before every block handed to the driver, the offset
+ * leads back to what malloc returned when the alignment asked for
+ * more than malloc guarantees.
+ **/
+typedef struct brl_allocation_header
+{
+  size_t size;
+  size_t offset;
+  VkSystemAllocationScope scope;
+} brl_allocation_header;
+
+static inline brl_allocation_header *brl_allocation_header_of(void *memory)
+{
+  return (brl_allocation_header *)((char *)memory - sizeof(brl_allocation_header));
+}
+
+static inline size_t brl_scope_index(VkSystemAllocationScope scope)
+{
+  return (size_t)scope < BRL_ALLOCATION_SCOPE_COUNT ? (size_t)scope : VK_SYSTEM_ALLOCATION_SCOPE_OBJECT;
+}
+
+static void brl_memory_add(VkSystemAllocationScope scope, size_t size)
+{
+  atomic_fetch_add_explicit(&brl_memory.host_bytes[brl_scope_index(scope)], size, memory_order_relaxed);
+  atomic_fetch_add_explicit(&brl_memory.host_live_allocations, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&brl_memory.host_allocations, 1, memory_order_relaxed);
+  size_t live = atomic_fetch_add_explicit(&brl_memory.host_live_bytes, size, memory_order_relaxed) + size;
+
+  size_t peak = atomic_load_explicit(&brl_memory.host_peak_bytes, memory_order_relaxed);
+  while (live > peak && !atomic_compare_exchange_weak_explicit(&brl_memory.host_peak_bytes, &peak, live, memory_order_relaxed, memory_order_relaxed))
+    ;
+}
+
+static void brl_memory_remove(VkSystemAllocationScope scope, size_t size)
+{
+  atomic_fetch_sub_explicit(&brl_memory.host_bytes[brl_scope_index(scope)], size, memory_order_relaxed);
+  atomic_fetch_sub_explicit(&brl_memory.host_live_allocations, 1, memory_order_relaxed);
+  atomic_fetch_sub_explicit(&brl_memory.host_live_bytes, size, memory_order_relaxed);
+}
+
+static void *VKAPI_PTR brl_host_allocate(void *user_data, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+  if (size == 0)
+    return NULL;
+  if (alignment < _Alignof(max_align_t))
+    alignment = _Alignof(max_align_t);
+
+  char *block = malloc(size + alignment + sizeof(brl_allocation_header));
+  if (block == NULL)
+    return NULL;
+
+  uintptr_t start = (uintptr_t)(block + sizeof(brl_allocation_header));
+  char *memory = (char *)((start + alignment - 1) & ~(uintptr_t)(alignment - 1));
+  brl_allocation_header *header = brl_allocation_header_of(memory);
+  header->size = size;
+  header->offset = memory - block;
+  header->scope = scope;
+
+  brl_memory_add(scope, size);
+  return memory;
+}
+
+static void VKAPI_PTR brl_host_free(void *user_data, void *memory)
+{
+  if (memory == NULL)
+    return;
+
+  brl_allocation_header *header = brl_allocation_header_of(memory);
+  brl_memory_remove(header->scope, header->size);
+  free((char *)memory - header->offset);
+}
+
+static void *VKAPI_PTR brl_host_reallocate(void *user_data, void *original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+  if (original == NULL)
+    return brl_host_allocate(user_data, size, alignment, scope);
+  if (size == 0)
+  {
+    brl_host_free(user_data, original);
+    return NULL;
+  }
+
+  void *memory = brl_host_allocate(user_data, size, alignment, scope);
+  if (memory == NULL)
+    return NULL;
+
+  size_t original_size = brl_allocation_header_of(original)->size;
+  memcpy(memory, original, original_size < size ? original_size : size);
+  brl_host_free(user_data, original);
+  return memory;
+}
+
+static void VKAPI_PTR brl_host_internal_allocated(void *user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+{
+  atomic_fetch_add_explicit(&brl_memory.internal_bytes, size, memory_order_relaxed);
+}
+
+static void VKAPI_PTR brl_host_internal_freed(void *user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope)
+{
+  atomic_fetch_sub_explicit(&brl_memory.internal_bytes, size, memory_order_relaxed);
+}
+
+static const VkAllocationCallbacks brl_allocation_callbacks = {
+    .pUserData = &brl_memory,
+    .pfnAllocation = brl_host_allocate,
+    .pfnReallocation = brl_host_reallocate,
+    .pfnFree = brl_host_free,
+    .pfnInternalAllocation = brl_host_internal_allocated,
+    .pfnInternalFree = brl_host_internal_freed,
+};
+
+/**
+ * Allocator given to every vkCreate* and vkDestroy* call, an object
+ * must be destroyed with the same callbacks it was created with.
+ * Building with BRL_NO_TRACKED_ALLOCATOR leaves host allocations to
+ * the driver, object counts are still kept.
+ **/
+#ifdef BRL_NO_TRACKED_ALLOCATOR
+#define BRL_ALLOCATOR NULL
+#else
+#define BRL_ALLOCATOR (&brl_allocation_callbacks)
+#endif
+
+/**
+ * Counts the object on success and passes the result through, meant
+ * to wrap the vkCreate* call itself.
+ **/
+VkResult brl_object_created(brl_object_type type, VkResult result)
+{
+  if (result != VK_SUCCESS)
+    return result;
+
+  int live = atomic_fetch_add_explicit(&brl_memory.objects[type], 1, memory_order_relaxed) + 1;
+  int peak = atomic_load_explicit(&brl_memory.peak_objects[type], memory_order_relaxed);
+  while (live > peak && !atomic_compare_exchange_weak_explicit(&brl_memory.peak_objects[type], &peak, live, memory_order_relaxed, memory_order_relaxed))
+    ;
+  return result;
+}
+
+void brl_object_destroyed(brl_object_type type, int exists)
+{
+  if (exists)
+    atomic_fetch_sub_explicit(&brl_memory.objects[type], 1, memory_order_relaxed);
+}
+
+// Destroying VK_NULL_HANDLE is valid and does not count.
+#define BRL_DESTROY(type, destroy, parent, handle)                 \
+  do                                                               \
+  {                                                                \
+    brl_object_destroyed(type, (handle) != VK_NULL_HANDLE);        \
+    destroy(parent, handle, BRL_ALLOCATOR);                        \
+  } while (0)
+
+void brl_print_host_memory()
+{
+  printf("-> Host memory: %zu bytes in %zu allocations (peak %zu bytes, %zu allocations total)\n",
+         atomic_load(&brl_memory.host_live_bytes), atomic_load(&brl_memory.host_live_allocations),
+         atomic_load(&brl_memory.host_peak_bytes), atomic_load(&brl_memory.host_allocations));
+  for (int i = 0; i < BRL_ALLOCATION_SCOPE_COUNT; i++)
+  {
+    size_t bytes = atomic_load(&brl_memory.host_bytes[i]);
+    if (bytes)
+      printf("   %-10s %10zu bytes\n", brl_allocation_scope_names[i], bytes);
+  }
+  if (atomic_load(&brl_memory.internal_bytes))
+    printf("   %-10s %10zu bytes\n", "internal", atomic_load(&brl_memory.internal_bytes));
+}
+
+void brl_print_objects()
+{
+  printf("-> Live Vulkan objects:\n");
+  for (int i = 0; i < BRL_OBJECT_TYPE_COUNT; i++)
+  {
+    int peak = atomic_load(&brl_memory.peak_objects[i]);
+    if (peak)
+      printf("   %-22s %5d (peak %d)\n", brl_object_type_names[i], brl_live_objects(i), peak);
+  }
+}
+
+/**
+ * Reports whatever is still alive, meant to run once everything has
+ * been destroyed. Returns the number of leaked objects.
+ **/
+int brl_report_leaks()
+{
+  int leaked = 0;
+  for (int i = 0; i < BRL_OBJECT_TYPE_COUNT; i++)
+  {
+    int live = brl_live_objects(i);
+    if (live != 0)
+      printf("BOREAL_WARNING: %d %s object(s) leaked.\n", live, brl_object_type_names[i]);
+    leaked += live;
+  }
+
+  size_t bytes = atomic_load(&brl_memory.host_live_bytes);
+  if (bytes)
+    printf("BOREAL_WARNING: %zu bytes of driver host memory never freed.\n", bytes);
+  else if (leaked == 0)
+    printf("-> No leaked Vulkan objects\n");
+  return leaked;
+}
+
+#endif
@@ -1,56 +1,33 @@
-
-#define BRL_IMPLEMENTATION
-#define BRL_NODEBUG
 #include <boreal.h>
 
+uint32_t checker;
+
 void init(brl_app *app)
 {
+  uint32_t pixels[64 * 64];
+  for (int i = 0; i < 64 * 64; i++)
+    pixels[i] = ((i % 64) / 8 + (i / 64) / 8) % 2 ? brl_rgba(255, 255, 255, 255) : brl_rgba(40, 40, 40, 255);
+
+  brl_create_texture(app, 64, 64, pixels, &checker);
 }
 
 void loop(brl_app *app)
 {
-  VkFence fences[] = {app->fence_in_flight};
-  vkWaitForFences(app->vk_device, 1, fences, VK_TRUE, UINT64_MAX);
-  vkResetFences(app->vk_device, 1, fences);
-
-  uint32_t image_index;
-
-  VkDevice device = app->vk_device;
-  VkSwapchainKHR swp = app->vk_swp;
+  {
+    BRL_ZONE("draw sprites");
+    for (int i = 0; i < 8; i++)
+      brl_draw_quad(app, 20.0f + i * 40.0f, 20.0f, 32.0f, 32.0f, brl_rgba(255, 32 * i, 64, 200));
 
-  vkAcquireNextImageKHR(app->vk_device, app->vk_swp, UINT64_MAX, app->sema_image_available, VK_NULL_HANDLE, &image_index);
+    brl_draw_layer(app, 1);
+    brl_draw_blend(app, BRL_BLEND_ADDITIVE);
+    brl_draw_tri(app, 20.0f, 80.0f, 120.0f, 80.0f, 70.0f, 160.0f, brl_rgba(64, 128, 255, 255));
 
-  vkResetCommandBuffer(app->vk_command_buffer, 0);
-  brl_record_command_buffer(app, app->vk_command_buffer, image_index);
-
-  VkSemaphore wait_semaphores[] = {app->sema_image_available};
-  VkSemaphore sign_semaphores[] = {app->sema_render_finished};
-  VkPipelineStageFlags wait_stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  VkCommandBuffer buffers[] = {app->vk_command_buffer};
-  VkSubmitInfo submit_info = {
-      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-      .commandBufferCount = 1,
-      .pCommandBuffers = buffers,
-      .signalSemaphoreCount = 1,
-      .pSignalSemaphores = sign_semaphores,
-      .waitSemaphoreCount = 1,
-      .pWaitSemaphores = wait_semaphores,
-      .pWaitDstStageMask = wait_stages,
-  };
-
-  vkQueueSubmit(app->vk_queue, 1, &submit_info, app->fence_in_flight);
-
-  VkSwapchainKHR swapchains[] = {app->vk_swp};
-  VkPresentInfoKHR present_info = {
-      .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-      .swapchainCount = 1,
-      .pSwapchains = swapchains,
-      .pImageIndices = &image_index,
-      .waitSemaphoreCount = 1,
-      .pWaitSemaphores = sign_semaphores,
-  };
+    brl_draw_blend(app, BRL_BLEND_ALPHA);
+    brl_draw_texture(app, checker);
+    brl_draw_quad(app, 160.0f, 80.0f, 128.0f, 128.0f, brl_rgba(255, 255, 255, 255));
+  }
 
-  vkQueuePresentKHR(app->vk_present_queue, &present_info);
+  brl_draw_frame(app);
 }
 
 void clean(brl_app *app)
@@ -59,15 +36,19 @@ void clean(brl_app *app)
 
 int main()
 {
-  int t = 10;
   brl_app app = {
       .init = init,
       .loop = loop,
       .clean = clean,
       .width = 800,
       .height = 600,
+      .msaa_samples = VK_SAMPLE_COUNT_4_BIT,
+      .dynamic_rendering = 1,
+      .present_mode = BRL_PRESENT_MODE_MAILBOX,
+      .low_latency = 1,
+      .post_effects = {BRL_POST_BLOOM, BRL_POST_TONEMAP, BRL_POST_FXAA},
+      .post_effects_count = 3,
   };
 
-  brl_create_app(app);
-  return 0;
+  return brl_create_app(app) == VK_SUCCESS ? 0 : 1;
 }
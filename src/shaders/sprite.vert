@@ -0,0 +1,19 @@
+#version 450
+
+layout(push_constant) uniform Sprite {
+    vec2 scale;
+} sprite;
+
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec2 uv;
+layout(location = 2) in vec4 color;
+
+layout(location = 0) out vec2 fragUv;
+layout(location = 1) out vec4 fragColor;
+
+void main() {
+    // Pixels to normalized device coordinates, y already points down.
+    gl_Position = vec4(position * sprite.scale - 1.0, 0.0, 1.0);
+    fragUv = uv;
+    fragColor = color;
+}
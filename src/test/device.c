@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#define BRL_IMPLEMENTATION
+#include <device.h>
+
+// Device selection tests: brl_score_device and brl_select_device run on
+// hand-filled brl_device_info tables, no driver involved.
+
+#define TEST_MIB (1024ull * 1024ull)
+
+int failed;
+int checked;
+
+void test_expect(const char *name, int condition)
+{
+  checked++;
+  failed += !condition;
+  printf("TEST: %-52s %s\n", name, condition ? "passed" : "FAILED");
+}
+
+/**
+ * A usable device of the given type and VRAM, with one family doing
+ * graphics, compute, transfer and present. Its UUID is seed repeated.
+ **/
+brl_device_info test_device(VkPhysicalDeviceType type, uint64_t vram_mib, uint8_t seed)
+{
+  brl_device_info info = {
+      .properties.deviceType = type,
+      .properties.limits.maxImageDimension2D = 16384,
+      .memory.memoryHeapCount = 1,
+      .memory.memoryHeaps[0] = {vram_mib * TEST_MIB, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT},
+      .has_uuid = 1,
+      .queue_family_count = 1,
+      .queue_families[0].queueFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT,
+      .queue_families[0].queueCount = 1,
+      .present_support[0] = VK_TRUE,
+      .extensions_supported = 1,
+      .surface_supported = 1,
+  };
+  memset(info.uuid, seed, VK_UUID_SIZE);
+  return info;
+}
+
+void test_device_types()
+{
+  brl_device_info infos[] = {
+      test_device(VK_PHYSICAL_DEVICE_TYPE_CPU, 65536, 1),
+      test_device(VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU, 16384, 2),
+      test_device(VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 2048, 3),
+  };
+
+  test_expect("discrete beats integrated with less VRAM", brl_score_device(&infos[2]) > brl_score_device(&infos[1]));
+  test_expect("integrated beats CPU with less VRAM", brl_score_device(&infos[1]) > brl_score_device(&infos[0]));
+  test_expect("discrete is selected", brl_select_device(infos, 3, NULL) == 2);
+  test_expect("integrated is selected without a discrete GPU", brl_select_device(infos, 2, NULL) == 1);
+  test_expect("CPU is selected when alone", brl_select_device(infos, 1, NULL) == 0);
+}
+
+void test_vram_ties()
+{
+  brl_device_info infos[] = {
+      test_device(VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 4096, 1),
+      test_device(VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 8192, 2),
+  };
+  test_expect("more VRAM wins between discrete GPUs", brl_select_device(infos, 2, NULL) == 1);
+
+  brl_device_info swapped[] = {infos[1], infos[0]};
+  test_expect("more VRAM wins in any order", brl_select_device(swapped, 2, NULL) == 0);
+
+  // A host visible heap does not count as VRAM.
+  infos[0].memory.memoryHeapCount = 2;
+  infos[0].memory.memoryHeaps[1] = (VkMemoryHeap){65536 * TEST_MIB, 0};
+  test_expect("host heaps are not VRAM", brl_select_device(infos, 2, NULL) == 1);
+}
+
+void test_rejections()
+{
+  brl_device_info no_present = test_device(VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 8192, 1);
+  no_present.present_support[0] = VK_FALSE;
+  test_expect("no present support is rejected", brl_score_device(&no_present) == -1);
+
+  brl_device_info no_surface = test_device(VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 8192, 1);
+  no_surface.surface_supported = 0;
+  test_expect("no usable surface is rejected", brl_score_device(&no_surface) == -1);
+
+  brl_device_info no_extensions = test_device(VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 8192, 1);
+  no_extensions.extensions_supported = 0;
+  test_expect("missing extensions are rejected", brl_score_device(&no_extensions) == -1);
+
+  brl_device_info no_compute = test_device(VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 8192, 1);
+  no_compute.compute_only = 1;
+  no_compute.queue_families[0].queueFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_TRANSFER_BIT;
+  test_expect("compute-only rejects a device without compute", brl_score_device(&no_compute) == -1);
+
+  // Compute-only needs neither graphics nor present.
+  brl_device_info compute = test_device(VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 8192, 1);
+  compute.compute_only = 1;
+  compute.queue_families[0].queueFlags = VK_QUEUE_COMPUTE_BIT;
+  compute.present_support[0] = VK_FALSE;
+  test_expect("compute-only accepts a compute queue alone", brl_score_device(&compute) >= 0);
+
+  brl_device_info infos[] = {no_present, test_device(VK_PHYSICAL_DEVICE_TYPE_CPU, 1024, 2)};
+  test_expect("a rejected device is never selected", brl_select_device(infos, 2, NULL) == 1);
+  test_expect("nothing usable selects nothing", brl_select_device(infos, 1, NULL) == -1);
+}
+
+void test_selectors()
+{
+  brl_device_info infos[] = {
+      test_device(VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU, 8192, 0x11),
+      test_device(VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU, 1024, 0xab),
+      test_device(VK_PHYSICAL_DEVICE_TYPE_CPU, 1024, 0x22),
+  };
+  infos[2].present_support[0] = VK_FALSE;
+
+  test_expect("empty selector picks by score", brl_select_device(infos, 3, "") == 0);
+  test_expect("index selector", brl_select_device(infos, 3, "1") == 1);
+  test_expect("raw UUID selector", brl_select_device(infos, 3, "abababababababababababababababab") == 1);
+  test_expect("canonical UUID selector", brl_select_device(infos, 3, "ABABABAB-ABAB-ABAB-ABAB-ABABABABABAB") == 1);
+
+  printf("Expecting %s warnings:\n", BRL_DEVICE_ENV);
+  test_expect("out of range index falls back to score", brl_select_device(infos, 3, "3") == 0);
+  test_expect("unknown UUID falls back to score", brl_select_device(infos, 3, "cdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcd") == 0);
+  test_expect("short UUID falls back to score", brl_select_device(infos, 3, "abababab") == 0);
+  test_expect("invalid selector falls back to score", brl_select_device(infos, 3, "gpu") == 0);
+  test_expect("unusable device falls back to score", brl_select_device(infos, 3, "2") == 0);
+}
+
+int main()
+{
+  test_device_types();
+  test_vram_ties();
+  test_rejections();
+  test_selectors();
+
+  printf("\nTEST: %d of %d device selection checks passed\n", checked - failed, checked);
+  return failed ? 1 : 0;
+}
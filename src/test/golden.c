@@ -0,0 +1,227 @@
+#include <boreal.h>
+
+// Golden image tests: every scene is rendered offscreen, read back and
+// compared against a stored PNG. Meant to run on lavapipe (see the
+// test target of the makefile), whose output does not depend on the
+// machine, so a mismatch means the rendering changed.
+//
+// BRL_GOLDEN_UPDATE=1 writes the current output as the new goldens.
+// A scene without a golden fails, unless BRL_GOLDEN_ALLOW_MISSING=1
+// is set while a new scene's golden is not recorded yet.
+
+#define TEST_WIDTH 256
+#define TEST_HEIGHT 256
+#define TEST_WARMUP_FRAMES 4
+#define TEST_FRAMES 64
+// Largest per channel difference a pixel can have and still match,
+// and how many pixels may be off before the scene fails.
+#define TEST_TOLERANCE 2
+#define TEST_MAX_MISMATCHED 16
+#define TEST_GOLDEN_DIR "./src/test/golden"
+#define TEST_OUTPUT_DIR "./dist/golden"
+
+typedef struct test_scene
+{
+  const char *name;
+  int dynamic_rendering;
+  VkSampleCountFlagBits msaa_samples;
+  int sprites;
+  int post;
+} test_scene;
+
+static const test_scene scenes[] = {
+    {"triangle", 1, VK_SAMPLE_COUNT_1_BIT, 0, 0},
+    {"triangle_render_pass", 0, VK_SAMPLE_COUNT_1_BIT, 0, 0},
+    {"triangle_msaa", 1, VK_SAMPLE_COUNT_4_BIT, 0, 0},
+    {"sprites", 1, VK_SAMPLE_COUNT_4_BIT, 1, 0},
+    {"post", 1, VK_SAMPLE_COUNT_4_BIT, 1, 1},
+};
+#define TEST_SCENES_COUNT (sizeof(scenes) / sizeof(scenes[0]))
+
+typedef struct test_run
+{
+  const test_scene *scene;
+  uint32_t checker;
+  int frame;
+  double start;
+  double last;
+  double max_frame;
+  double mean_frame;
+  uint8_t *pixels;
+  VkResult read_result;
+} test_run;
+
+test_run run;
+int skipped;
+
+double test_time_ms()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+void test_init(brl_app *app)
+{
+  if (!run.scene->sprites)
+    return;
+
+  uint32_t pixels[64 * 64];
+  for (int i = 0; i < 64 * 64; i++)
+    pixels[i] = ((i % 64) / 8 + (i / 64) / 8) % 2 ? brl_rgba(255, 255, 255, 255) : brl_rgba(40, 40, 40, 255);
+  brl_create_texture(app, 64, 64, pixels, &run.checker);
+}
+
+void test_draw_sprites(brl_app *app)
+{
+  for (int i = 0; i < 5; i++)
+    brl_draw_quad(app, 10.0f + i * 48.0f, 10.0f, 40.0f, 40.0f, brl_rgba(255, 48 * i, 64, 200));
+
+  brl_draw_layer(app, 1);
+  brl_draw_blend(app, BRL_BLEND_ADDITIVE);
+  brl_draw_tri(app, 20.0f, 70.0f, 120.0f, 70.0f, 70.0f, 150.0f, brl_rgba(64, 128, 255, 255));
+
+  brl_draw_blend(app, BRL_BLEND_ALPHA);
+  brl_draw_texture(app, run.checker);
+  brl_draw_quad(app, 136.0f, 120.0f, 96.0f, 96.0f, brl_rgba(255, 255, 255, 255));
+}
+
+/**
+ * Frame times are only taken once the warmup frames filled every
+ * frame in flight, the image read back is the last frame's.
+ **/
+void test_loop(brl_app *app)
+{
+  if (run.scene->sprites)
+    test_draw_sprites(app);
+  brl_draw_frame(app);
+
+  double now = test_time_ms();
+  run.frame++;
+  if (run.frame == TEST_WARMUP_FRAMES)
+    run.start = now;
+  else if (run.frame > TEST_WARMUP_FRAMES && now - run.last > run.max_frame)
+    run.max_frame = now - run.last;
+  run.last = now;
+
+  if (run.frame == TEST_WARMUP_FRAMES + TEST_FRAMES)
+  {
+    run.mean_frame = (now - run.start) / TEST_FRAMES;
+    run.read_result = brl_read_frame(app, run.pixels);
+    brl_close(app);
+  }
+}
+
+/**
+ * Returns 1 when the scene matches its golden image, or when goldens
+ * are being updated. A missing golden only passes with allow_missing.
+ **/
+int test_check(const test_scene *scene, int update, int allow_missing, FILE *times)
+{
+  char golden_path[256], output_path[256], diff_path[256];
+  snprintf(golden_path, sizeof(golden_path), "%s/%s.png", TEST_GOLDEN_DIR, scene->name);
+  snprintf(output_path, sizeof(output_path), "%s/%s.png", TEST_OUTPUT_DIR, scene->name);
+  snprintf(diff_path, sizeof(diff_path), "%s/%s_diff.png", TEST_OUTPUT_DIR, scene->name);
+
+  if (run.read_result != VK_SUCCESS || run.frame < TEST_WARMUP_FRAMES + TEST_FRAMES)
+  {
+    printf("TEST: %-22s FAILED, rendering stopped after %d frames\n", scene->name, run.frame);
+    fprintf(times, "%s,error,,,,\n", scene->name);
+    return 0;
+  }
+
+  brl_png_write(output_path, run.pixels, TEST_WIDTH, TEST_HEIGHT);
+  if (update)
+  {
+    int written = brl_png_write(golden_path, run.pixels, TEST_WIDTH, TEST_HEIGHT) == 0;
+    printf("TEST: %-22s %s %s\n", scene->name, written ? "updated" : "FAILED to write", golden_path);
+    fprintf(times, "%s,updated,%.3f,%.3f,,\n", scene->name, run.mean_frame, run.max_frame);
+    return written;
+  }
+
+  FILE *golden_file = fopen(golden_path, "rb");
+  if (golden_file == NULL && allow_missing)
+  {
+    printf("TEST: %-22s skipped, no golden at %s (make golden-update records it)\n", scene->name, golden_path);
+    fprintf(times, "%s,skipped,%.3f,%.3f,,\n", scene->name, run.mean_frame, run.max_frame);
+    skipped++;
+    return 1;
+  }
+  if (golden_file)
+    fclose(golden_file);
+
+  uint32_t width, height;
+  uint8_t *golden = brl_png_read(golden_path, &width, &height);
+  if (golden == NULL || width != TEST_WIDTH || height != TEST_HEIGHT)
+  {
+    printf("TEST: %-22s FAILED, no usable golden at %s (output in %s)\n", scene->name, golden_path, output_path);
+    fprintf(times, "%s,missing,%.3f,%.3f,,\n", scene->name, run.mean_frame, run.max_frame);
+    free(golden);
+    return 0;
+  }
+
+  uint8_t *diff = malloc(TEST_WIDTH * TEST_HEIGHT * 4);
+  brl_image_diff result = brl_image_compare(run.pixels, golden, TEST_WIDTH, TEST_HEIGHT, TEST_TOLERANCE, diff);
+  int passed = result.mismatched <= TEST_MAX_MISMATCHED;
+  if (!passed)
+    brl_png_write(diff_path, diff, TEST_WIDTH, TEST_HEIGHT);
+
+  printf("TEST: %-22s %s  %6.3f ms/frame (max %6.3f)  %u pixels off, max difference %u\n", scene->name,
+         passed ? "passed" : "FAILED", run.mean_frame, run.max_frame, result.mismatched, result.max_difference);
+  fprintf(times, "%s,%s,%.3f,%.3f,%u,%u\n", scene->name, passed ? "passed" : "failed",
+          run.mean_frame, run.max_frame, result.mismatched, result.max_difference);
+
+  free(diff);
+  free(golden);
+  return passed;
+}
+
+int main()
+{
+  const char *update_env = getenv("BRL_GOLDEN_UPDATE");
+  int update = update_env && *update_env && *update_env != '0';
+  const char *allow_missing_env = getenv("BRL_GOLDEN_ALLOW_MISSING");
+  int allow_missing = allow_missing_env && *allow_missing_env && *allow_missing_env != '0';
+
+  FILE *times = fopen(TEST_OUTPUT_DIR "/times.csv", "w");
+  if (times == NULL)
+  {
+    printf("TEST: cannot write %s, does the directory exist?\n", TEST_OUTPUT_DIR);
+    return 1;
+  }
+  fprintf(times, "scene,result,mean_ms,max_ms,mismatched,max_difference\n");
+
+  int failed = 0;
+  for (size_t i = 0; i < TEST_SCENES_COUNT; i++)
+  {
+    const test_scene *scene = &scenes[i];
+    run = (test_run){.scene = scene, .pixels = calloc(TEST_WIDTH * TEST_HEIGHT, 4)};
+
+    brl_app app = {
+        .init = test_init,
+        .loop = test_loop,
+        .width = TEST_WIDTH,
+        .height = TEST_HEIGHT,
+        .offscreen = 1,
+        .dynamic_rendering = scene->dynamic_rendering,
+        .msaa_samples = scene->msaa_samples,
+    };
+    if (scene->post)
+    {
+      app.post_effects[0] = BRL_POST_BLOOM;
+      app.post_effects[1] = BRL_POST_TONEMAP;
+      app.post_effects[2] = BRL_POST_FXAA;
+      app.post_effects_count = 3;
+    }
+
+    if (brl_create_app(app) != VK_SUCCESS)
+      run.read_result = VK_ERROR_INITIALIZATION_FAILED;
+    failed += !test_check(scene, update, allow_missing, times);
+    free(run.pixels);
+  }
+
+  fclose(times);
+  printf("\nTEST: %d of %d scenes passed, %d skipped without a golden, frame times in %s/times.csv\n",
+         (int)TEST_SCENES_COUNT - failed - skipped, (int)TEST_SCENES_COUNT, skipped, TEST_OUTPUT_DIR);
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#define BRL_IMPLEMENTATION
+#include <image.h>
+
+// PNG and comparison tests for image.h: round trips through
+// brl_png_write and brl_png_read, a hand-made RGB file using every
+// row filter, and brl_image_compare. No driver involved.
+
+#define TEST_OUTPUT_DIR "./dist/image"
+#define TEST_WIDTH 37
+#define TEST_HEIGHT 23
+
+int failed;
+int checked;
+
+void test_expect(const char *name, int condition)
+{
+  checked++;
+  failed += !condition;
+  printf("TEST: %-52s %s\n", name, condition ? "passed" : "FAILED");
+}
+
+uint8_t *test_pattern(uint32_t width, uint32_t height)
+{
+  uint8_t *pixels = malloc((size_t)width * height * 4);
+  for (uint32_t y = 0; y < height; y++)
+  {
+    for (uint32_t x = 0; x < width; x++)
+    {
+      uint8_t *pixel = pixels + ((size_t)y * width + x) * 4;
+      pixel[0] = x * 7;
+      pixel[1] = y * 11;
+      pixel[2] = (x ^ y) * 13;
+      pixel[3] = 255 - x * y;
+    }
+  }
+  return pixels;
+}
+
+void test_round_trip()
+{
+  const char *path = TEST_OUTPUT_DIR "/round_trip.png";
+  uint8_t *pixels = test_pattern(TEST_WIDTH, TEST_HEIGHT);
+  test_expect("write RGBA", brl_png_write(path, pixels, TEST_WIDTH, TEST_HEIGHT) == 0);
+
+  uint32_t width = 0, height = 0;
+  uint8_t *read = brl_png_read(path, &width, &height);
+  test_expect("read back", read != NULL);
+  test_expect("read back size", width == TEST_WIDTH && height == TEST_HEIGHT);
+  test_expect("read back pixels", read && memcmp(read, pixels, (size_t)TEST_WIDTH * TEST_HEIGHT * 4) == 0);
+
+  free(read);
+  free(pixels);
+}
+
+void test_write_chunk(FILE *file, const char *type, const uint8_t *data, uint32_t size)
+{
+  uint8_t length[4] = {size >> 24, size >> 16, size >> 8, size};
+  uLong crc = crc32(0, (const Bytef *)type, 4);
+  if (size)
+    crc = crc32(crc, data, size);
+  uint8_t footer[4] = {crc >> 24, crc >> 16, crc >> 8, crc};
+  fwrite(length, 1, 4, file);
+  fwrite(type, 1, 4, file);
+  if (size)
+    fwrite(data, 1, size, file);
+  fwrite(footer, 1, 4, file);
+}
+
+/**
+ * An 8 bit RGB file whose rows use the None, Sub, Up, Average and
+ * Paeth filters in turn, which brl_png_write never produces.
+ **/
+void test_filters()
+{
+  enum { width = 6, height = 5, stride = width * 3 };
+  uint8_t rgb[height][stride];
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < stride; x++)
+      rgb[y][x] = (x * 29 + y * 71 + x * y * 5) & 0xff;
+
+  uint8_t raw[height * (stride + 1)];
+  for (int y = 0; y < height; y++)
+  {
+    uint8_t *row = raw + y * (stride + 1);
+    row[0] = y;
+    for (int x = 0; x < stride; x++)
+    {
+      int a = x >= 3 ? rgb[y][x - 3] : 0;
+      int b = y ? rgb[y - 1][x] : 0;
+      int c = y && x >= 3 ? rgb[y - 1][x - 3] : 0;
+      int predictor[5] = {0, a, b, (a + b) / 2, brl_png_paeth(a, b, c)};
+      row[1 + x] = rgb[y][x] - predictor[y];
+    }
+  }
+
+  uLongf packed_size = compressBound(sizeof(raw));
+  uint8_t *packed = malloc(packed_size);
+  compress2(packed, &packed_size, raw, sizeof(raw), 6);
+
+  const char *path = TEST_OUTPUT_DIR "/filters.png";
+  FILE *file = fopen(path, "wb");
+  uint8_t ihdr[13] = {0, 0, 0, width, 0, 0, 0, height, 8, 2, 0, 0, 0};
+  fwrite(brl_png_signature, 1, 8, file);
+  test_write_chunk(file, "IHDR", ihdr, sizeof(ihdr));
+  test_write_chunk(file, "IDAT", packed, packed_size);
+  test_write_chunk(file, "IEND", NULL, 0);
+  fclose(file);
+  free(packed);
+
+  uint32_t read_width = 0, read_height = 0;
+  uint8_t *read = brl_png_read(path, &read_width, &read_height);
+  int matches = read != NULL && read_width == width && read_height == height;
+  for (int i = 0; matches && i < width * height; i++)
+    matches = memcmp(read + i * 4, &rgb[0][0] + i * 3, 3) == 0 && read[i * 4 + 3] == 255;
+  test_expect("RGB with every row filter", matches);
+  free(read);
+}
+
+void test_invalid_files()
+{
+  uint32_t width, height;
+  test_expect("missing file reads as NULL", brl_png_read(TEST_OUTPUT_DIR "/missing.png", &width, &height) == NULL);
+
+  const char *path = TEST_OUTPUT_DIR "/truncated.png";
+  uint8_t *pixels = test_pattern(TEST_WIDTH, TEST_HEIGHT);
+  brl_png_write(path, pixels, TEST_WIDTH, TEST_HEIGHT);
+  free(pixels);
+
+  FILE *file = fopen(path, "rb");
+  uint8_t head[64];
+  size_t size = fread(head, 1, sizeof(head), file);
+  fclose(file);
+  file = fopen(path, "wb");
+  fwrite(head, 1, size, file);
+  fclose(file);
+  test_expect("truncated file reads as NULL", brl_png_read(path, &width, &height) == NULL);
+
+  file = fopen(path, "wb");
+  fputs("not a png, not even close to one", file);
+  fclose(file);
+  test_expect("garbage reads as NULL", brl_png_read(path, &width, &height) == NULL);
+}
+
+void test_compare()
+{
+  size_t size = (size_t)TEST_WIDTH * TEST_HEIGHT * 4;
+  uint8_t *a = test_pattern(TEST_WIDTH, TEST_HEIGHT);
+  uint8_t *b = test_pattern(TEST_WIDTH, TEST_HEIGHT);
+  uint8_t *diff = malloc(size);
+
+  brl_image_diff same = brl_image_compare(a, b, TEST_WIDTH, TEST_HEIGHT, 2, diff);
+  test_expect("identical images match", same.mismatched == 0 && same.max_difference == 0);
+
+  b[5 * 4 + 1] += 2;
+  brl_image_diff close = brl_image_compare(a, b, TEST_WIDTH, TEST_HEIGHT, 2, diff);
+  test_expect("difference within tolerance matches", close.mismatched == 0 && close.max_difference == 2);
+
+  b[100 * 4 + 3] -= 40;
+  brl_image_diff off = brl_image_compare(a, b, TEST_WIDTH, TEST_HEIGHT, 2, diff);
+  test_expect("difference above tolerance mismatches", off.mismatched == 1 && off.max_difference == 40);
+
+  const uint8_t red[4] = {255, 0, 0, 255};
+  test_expect("mismatch is red in the diff", memcmp(diff + 100 * 4, red, 4) == 0);
+  test_expect("match is opaque gray in the diff", diff[5 * 4] == diff[5 * 4 + 2] && diff[5 * 4 + 3] == 255 && diff[5 * 4] != 255);
+
+  free(a);
+  free(b);
+  free(diff);
+}
+
+int main()
+{
+  test_round_trip();
+  test_filters();
+  test_invalid_files();
+  test_compare();
+
+  printf("\nTEST: %d of %d image checks passed\n", checked - failed, checked);
+  return failed ? 1 : 0;
+}